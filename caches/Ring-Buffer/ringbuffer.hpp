@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <memory>
+#include <utility>
 #include <stddef.h>
 #include <limits>
 #include <atomic>
@@ -463,13 +465,8 @@ size_t RingBufferSPSC<T, buffer_size, fake_tso, cacheline_size, index_t>::readBu
 }
 } // namespace caches
 
-
 namespace caches
 {
-#include <atomic>
-#include <cstddef>
-#include <utility>
-
 #if defined(__GNUC__) && __GNUC__
 #define lzcnt64(x) __builtin_clzll(x)
 #else
@@ -478,7 +475,11 @@ namespace caches
 
 static constexpr std::size_t cacheline_size = 64;
 
-template <class Ty>
+/*!
+ * @brief Bounded multi-producer/multi-consumer ring buffer, holding at least `size` elements of a trivially movable
+ * type. Producers reserve a slot, fill it and publish in reservation order; consumers claim published slots by CAS.
+ */
+template <class Ty, class Alloc = std::allocator<Ty>>
 class LockFreeRingBufferTrivialMovable {
   private:
     LockFreeRingBufferTrivialMovable() = delete;
@@ -491,16 +492,15 @@ class LockFreeRingBufferTrivialMovable {
 
   public:
     LockFreeRingBufferTrivialMovable(std::size_t size)
-        : pack{{size ? (2ul << lzcnt64(size)) - 1 : 0ul}, {size ? Alloc::Allocate(2ull << lzcnt64(size)) : nullptr}},
-          reserver{0},
-          last{0},
-          first{0}
+        : pack{size ? Allocate(slots(size)) : nullptr, size ? slots(size) - 1 : 0ul}, reserver{0}, last{0}, first{0}
     {
         assert((size != 0 && pack.data != nullptr) || (size == 0 && pack.data == nullptr));
     }
     ~LockFreeRingBufferTrivialMovable() noexcept
     {
-        Alloc::DeAllocate(pack.data);
+        if (pack.data != nullptr) {
+            DeAllocate(pack.data, pack.capacity + 1);
+        }
     }
 
     bool enqueue(const Ty &value) noexcept
@@ -538,7 +538,7 @@ class LockFreeRingBufferTrivialMovable {
         } while (!reserver.compare_exchange_weak(candidate, incremented));
 
         auto reserved = candidate;
-        pack.data[reserved] = std::forward<Ty>(value);
+        pack.data[reserved] = std::move(value);
 
         for (const auto saved_reserved = reserved; !first.compare_exchange_weak(reserved, incremented);
              reserved = saved_reserved) {
@@ -569,7 +569,7 @@ class LockFreeRingBufferTrivialMovable {
 
     std::size_t size_approx() const noexcept
     {
-        return first.load(std::memory_order_relaxed) - last.load(std::memory_order_relaxed);
+        return (first.load(std::memory_order_relaxed) - last.load(std::memory_order_relaxed)) & pack.capacity;
     }
 
   protected:
@@ -580,6 +580,31 @@ class LockFreeRingBufferTrivialMovable {
 
     static_assert(sizeof(Pack) < cacheline_size, "The capacity and the data pointer don't fit into a cache line!");
 
+    // smallest power of 2 above size, one slot always stays empty to tell full from empty
+    static std::size_t slots(std::size_t size) noexcept
+    {
+        return std::size_t(2) << (63 - lzcnt64(size));
+    }
+
+    static Ty *Allocate(std::size_t n)
+    {
+        Alloc alloc;
+        Ty *data = std::allocator_traits<Alloc>::allocate(alloc, n);
+        for (std::size_t i = 0; i < n; i++) {
+            std::allocator_traits<Alloc>::construct(alloc, data + i);
+        }
+        return data;
+    }
+
+    static void DeAllocate(Ty *data, std::size_t n) noexcept
+    {
+        Alloc alloc;
+        for (std::size_t i = 0; i < n; i++) {
+            std::allocator_traits<Alloc>::destroy(alloc, data + i);
+        }
+        std::allocator_traits<Alloc>::deallocate(alloc, data, n);
+    }
+
   protected:
     alignas(cacheline_size) Pack pack;
 
@@ -588,8 +613,12 @@ class LockFreeRingBufferTrivialMovable {
     alignas(cacheline_size) std::atomic_size_t first;
 };
 
-template <class Ty, typename Alloc = std::allocator<Ty>>
-class LockFreeRingBufferNonTrivialMovable : public LockFreeRingBufferTrivialMovable<Ty> {
+/*!
+ * @brief Variant for types whose move may throw or be expensive: consumers claim a slot before moving out of it, and
+ * release it to producers in claim order.
+ */
+template <class Ty, class Alloc = std::allocator<Ty>>
+class LockFreeRingBufferNonTrivialMovable : public LockFreeRingBufferTrivialMovable<Ty, Alloc> {
   private:
     LockFreeRingBufferNonTrivialMovable() = delete;
 
@@ -600,13 +629,10 @@ class LockFreeRingBufferNonTrivialMovable : public LockFreeRingBufferTrivialMova
     LockFreeRingBufferNonTrivialMovable &operator=(LockFreeRingBufferNonTrivialMovable &&) = delete;
 
   protected:
-    using MyBase = LockFreeRingBufferTrivialMovable<Ty>;
+    using MyBase = LockFreeRingBufferTrivialMovable<Ty, Alloc>;
 
   public:
-    LockFreeRingBufferNonTrivialMovable(std::size_t size) LockFreeRingBufferNonTrivialMovable(std::size_t size)
-        : MyBase(size), lastReserver{0}
-    {
-    }
+    LockFreeRingBufferNonTrivialMovable(std::size_t size) : MyBase(size), lastReserver{0} {}
 
     bool dequeue(Ty &value) noexcept(std::is_nothrow_move_assignable<Ty>::value)
     {
@@ -633,6 +659,7 @@ class LockFreeRingBufferNonTrivialMovable : public LockFreeRingBufferTrivialMova
   protected:
     alignas(cacheline_size) std::atomic_size_t lastReserver;
 };
+
 template <class Ty, class Alloc = std::allocator<Ty>>
 using LockFreeRingBuffer =
     typename std::conditional<std::is_trivially_move_assignable<Ty>::value, LockFreeRingBufferTrivialMovable<Ty, Alloc>,
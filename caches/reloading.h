@@ -3,11 +3,26 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "../lockless/atomic-epoch.h"
+#include "../misc/watcher.h"
 
 #ifndef CACHES_TRACE
 #define CACHES_TRACE(fmt, ...)
 #endif
 
+#if !defined(CACHES_SPAN) && defined(LEMON_TRACING)
+#include "../misc/tracing.h"
+#define CACHES_SPAN(name) TRACING_SPAN(name)
+#endif
+
+#ifndef CACHES_SPAN
+#define CACHES_SPAN(name)
+#endif
+
 namespace caches
 {
 template <typename T>
@@ -15,7 +30,8 @@ class Reloading {
   public:
     template <typename... Args>
     Reloading(time_t interval, Args... args)
-        : ping(args...), pong(args...), m_isping(true), m_reloading(false), m_interval(interval), m_reloaded_time(0)
+        : ping(args...), pong(args...), m_isping(true), m_reloading(false), m_changed(false), m_watch(0),
+          m_interval(interval), m_reloaded_time(0)
     {
         ping.Reload();
         m_reloaded_time = time(nullptr);
@@ -27,15 +43,40 @@ class Reloading {
         m_interval = seconds;
     }
 
+    /**
+     * Reload when `path` changes, as told by watching::Watcher, instead of every interval.
+     */
+    int Watch(const std::string &path)
+    {
+        int id = watching::Watch(path, [this](const std::string &) {
+            m_changed.store(true, std::memory_order_relaxed);
+        });
+        if (int previous = id > 0 ? m_watch.exchange(id) : 0; previous > 0) {
+            watching::Unwatch(previous);
+        }
+        return id < 0 ? id : 0;
+    }
+
+    ~Reloading()
+    {
+        if (int id = m_watch.exchange(0); id > 0) {
+            watching::Unwatch(id);
+        }
+    }
+
     T &GetActivated()
     {
         // start thread to switch config only if no worker running in background
-        if (!m_reloading && m_reloaded_time + m_interval <= time(nullptr)) {
+        if (!m_reloading
+            && (m_watch > 0 ? m_changed.load(std::memory_order_relaxed)
+                            : m_reloaded_time + m_interval <= time(nullptr))) {
             bool expected = false;
             if (m_reloading.compare_exchange_strong(expected, true, std::memory_order_release,
                                                     std::memory_order_relaxed)) {
+                m_changed.store(false, std::memory_order_relaxed);
                 std::thread([this]() {
-                    auto elasped = [starttime = std::chrono::steady_clock::now()]() {
+                    CACHES_SPAN("caches::Reloading::Reload");
+                    [[maybe_unused]] auto elasped = [starttime = std::chrono::steady_clock::now()]() {
                         auto duration = std::chrono::steady_clock::now() - starttime;
                         return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
                     };
@@ -77,9 +118,168 @@ class Reloading {
     T ping, pong;                       // double buffering for reloading
     std::atomic_bool m_isping;          // true if ping selected
     std::atomic_bool m_reloading;       // true if reloading in background
+    std::atomic_bool m_changed;         // true if the watched file changed since the last reload
+    std::atomic<int> m_watch;           // watching::Watcher id, 0 if polling
     time_t m_interval, m_reloaded_time; // reloading interval and last reloaded time
 };
 
+/**
+ * Like Reloading, but readers pin an immutable snapshot instead of borrowing a buffer that a later reload may
+ * overwrite under them. A single worker reloads every `interval` seconds (or on Reload()), into the buffer readers
+ * left, publishes it and retires the previous one, which is reused once the grace period of lockfree::atomic_epoch
+ * has elapsed.
+ *
+ *     static caches::SnapshotReloading<Config> config(1, "demo.ini");
+ *     auto snapshot = config.GetSnapshot(); // wait-free
+ *     snapshot->GetValue(...);              // unchanged until snapshot is destroyed
+ *
+ * Snapshots are meant to be short lived: holding one delays every reload of every SnapshotReloading.
+ */
+template <typename T>
+class SnapshotReloading {
+  public:
+    /**
+     * Pinned by the thread that took it and released by the same one, as epochs are announced per thread: neither
+     * copyable nor movable, so that it cannot be handed over to another thread.
+     */
+    class Snapshot {
+      public:
+        ~Snapshot()
+        {
+            lockfree::atomic_epoch::instance().leave();
+        }
+        Snapshot(const Snapshot &) = delete;
+        Snapshot(Snapshot &&) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        Snapshot &operator=(Snapshot &&) = delete;
+
+        const T &operator*() const
+        {
+            return *m_value;
+        }
+        const T *operator->() const
+        {
+            return m_value;
+        }
+
+      private:
+        friend class SnapshotReloading;
+        explicit Snapshot(const T *value) : m_value(value) {}
+        const T *m_value;
+    };
+
+    template <typename... Args>
+    SnapshotReloading(time_t interval, Args... args)
+        : m_current(new T(args...)), m_retired(new T(args...)), m_retired_epoch(0), m_stopped(false),
+          m_requested(false), m_watch(0), m_interval(interval)
+    {
+        m_current->Reload();
+        m_active.store(m_current.get());
+        m_worker = std::thread(&SnapshotReloading::run, this);
+        CACHES_TRACE("reloading procedure finished, snapshot published");
+    }
+
+    ~SnapshotReloading()
+    {
+        if (int id = m_watch.exchange(0); id > 0) {
+            watching::Unwatch(id);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_wakeup.notify_one();
+        m_worker.join();
+    }
+
+    /**
+     * Zero disables periodic reloads, leaving only the ones requested by Reload().
+     */
+    void SetInterval(time_t seconds)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_interval = seconds;
+        m_wakeup.notify_one();
+    }
+
+    /**
+     * Ask the worker to reload now, without waiting for it.
+     */
+    void Reload()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requested = true;
+        m_wakeup.notify_one();
+    }
+
+    /**
+     * Reload when `path` changes, as told by watching::Watcher, use SetInterval(0) to stop polling.
+     */
+    int Watch(const std::string &path)
+    {
+        int id = watching::Watch(path, [this](const std::string &) {
+            Reload();
+        });
+        if (int previous = id > 0 ? m_watch.exchange(id) : 0; previous > 0) {
+            watching::Unwatch(previous);
+        }
+        return id < 0 ? id : 0;
+    }
+
+    Snapshot GetSnapshot() const
+    {
+        lockfree::atomic_epoch::instance().enter();
+        return Snapshot(m_active.load());
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_interval);
+        while (!m_stopped) {
+            if (!m_requested && (m_interval == 0 || std::chrono::steady_clock::now() < deadline)) {
+                m_wakeup.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+            m_requested = false;
+            lock.unlock();
+            reload();
+            lock.lock();
+            deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_interval);
+        }
+    }
+
+    void reload()
+    {
+        CACHES_SPAN("caches::SnapshotReloading::Reload");
+        auto starttime = std::chrono::steady_clock::now();
+        auto &epochs = lockfree::atomic_epoch::instance();
+        while (!epochs.quiescent(m_retired_epoch)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        if (m_retired->Reload() == 0) {
+            m_active.store(m_retired.get());
+            std::swap(m_current, m_retired);
+            m_retired_epoch = epochs.advance();
+            [[maybe_unused]] auto elasped = std::chrono::steady_clock::now() - starttime;
+            CACHES_TRACE("reloading succeed, snapshot published, elasped = %lld us",
+                         (long long)std::chrono::duration_cast<std::chrono::microseconds>(elasped).count());
+        }
+    }
+
+    std::unique_ptr<T> m_current, m_retired; // published and waiting for (or past) its grace period
+    std::atomic<const T *> m_active;          // what readers pin
+    uint64_t m_retired_epoch;                 // m_retired is unreachable once this epoch is quiescent
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stopped, m_requested;
+    std::atomic<int> m_watch; // watching::Watcher id, 0 if not watched
+    time_t m_interval;
+    std::thread m_worker;
+};
+
 #define ONCE_RUNNABLE()                                                                                        \
     ({                                                                                                         \
         bool expected = false;                                                                                 \
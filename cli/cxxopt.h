@@ -66,6 +66,8 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <charconv>
+#include <string_view>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
@@ -101,84 +103,143 @@ namespace details
 {
 // string convertion
 
+/** `s` without its leading and trailing spaces, as a view into it */
+inline std::string_view trimmed(std::string_view s)
+{
+    size_t begin = 0, end = s.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(s[begin]))) {
+        begin++;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
+        end--;
+    }
+    return s.substr(begin, end - begin);
+}
+
 inline std::string trim(std::string s)
 {
-    std::string trimed = s;
-    trimed.erase(trimed.begin(), std::find_if(trimed.begin(), trimed.end(), [](unsigned char ch) {
-                     return !std::isspace(ch);
-                 }));
-
-    trimed.erase(std::find_if(trimed.rbegin(), trimed.rend(),
-                              [](unsigned char ch) {
-                                  return !std::isspace(ch);
-                              })
-                     .base(),
-                 trimed.end());
-    return trimed;
+    return std::string(trimmed(s));
 }
 
-inline bool split(
-    const std::string &self, const std::string &delimiters, std::function<bool(const std::string &)> consume_token,
-    std::function<bool(const std::string &)> consume_delimiter = std::function<bool(const std::string &)>{})
+/**
+ * Call `consume_token` with each non-empty token of `self`, and `consume_delimiter` with each delimiter, as views
+ * into `self`: no copy is made. Delimiters within double quotes belong to the token, unless '"' is a delimiter.
+ * Returns false as soon as `consume_token` does.
+ */
+template <typename TokenConsumer, typename DelimiterConsumer>
+inline bool tokenize(std::string_view self, std::string_view delimiters, TokenConsumer &&consume_token,
+                     DelimiterConsumer &&consume_delimiter)
 {
-    std::string token;
-    bool has_quotes = delimiters.find('"') != std::string::npos, in_token = false;
-    for (auto &ch : self) {
+    bool has_quotes = delimiters.find('"') != std::string_view::npos, in_token = false;
+    bool delimiting[256] = {}; // rather than a search of the delimiters for every character
+    for (char ch : delimiters) {
+        delimiting[static_cast<unsigned char>(ch)] = true;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < self.size(); i++) {
+        char ch = self[i];
         if (ch == '"' && !has_quotes) {
             in_token = !in_token;
         }
-        if (!in_token && delimiters.find_first_of(ch) != std::string::npos) {
-            if (token.size()) {
-                if (consume_token && !consume_token(token)) return false;
-                token.clear();
-            }
-            if (consume_delimiter) {
-                consume_delimiter(std::string(1, ch));
+        if (!in_token && delimiting[static_cast<unsigned char>(ch)]) {
+            if (i > start && !consume_token(self.substr(start, i - start))) {
+                return false;
             }
-        } else {
-            token += ch;
+            consume_delimiter(self.substr(i, 1));
+            start = i + 1;
         }
     }
-    if (!token.empty() && consume_token) {
-        return consume_token(token);
+    if (start < self.size()) {
+        return consume_token(self.substr(start));
     }
     return true;
 }
 
-inline void derive(const std::string &self, bool &to)
+template <typename TokenConsumer>
+inline bool tokenize(std::string_view self, std::string_view delimiters, TokenConsumer &&consume_token)
 {
-    std::string formated = trim(self);
-    const char *p = formated.c_str();
+    return tokenize(self, delimiters, std::forward<TokenConsumer>(consume_token), [](std::string_view) {});
+}
 
-    char l = *p | ' ';
-    if ((l == 't' && strncmp(++p, "rue\0", 4) == 0) || strncmp(p, "1\0", 2) == 0) {
+inline bool split(
+    std::string_view self, std::string_view delimiters, std::function<bool(const std::string &)> consume_token,
+    std::function<bool(const std::string &)> consume_delimiter = std::function<bool(const std::string &)>{})
+{
+    return tokenize(
+        self, delimiters,
+        [&consume_token](std::string_view token) {
+            return !consume_token || consume_token(std::string(token));
+        },
+        [&consume_delimiter](std::string_view delimiter) {
+            if (consume_delimiter) {
+                consume_delimiter(std::string(delimiter));
+            }
+        });
+}
+
+inline void derive(std::string_view self, bool &to)
+{
+    std::string_view formated = trimmed(self);
+    char l = formated.empty() ? '\0' : formated[0] | ' ';
+    if ((l == 't' && formated.substr(1) == "rue") || formated == "1") {
         to = true;
-    } else if (formated.empty() || (l == 'f' && strncmp(++p, "alse\0", 5) == 0) || strncmp(p, "0\0", 2) == 0) {
+    } else if (formated.empty() || (l == 'f' && formated.substr(1) == "alse") || formated == "0") {
         to = false;
     } else {
-        throw std::runtime_error("Not boolean value: \"" + self + "\"");
+        throw std::runtime_error("Not boolean value: \"" + std::string(self) + "\"");
     }
 }
 
-inline void derive(const std::string &self, std::string &to)
+inline void derive(std::string_view self, std::string &to)
 {
-    to = self;
+    to.assign(self.data(), self.size());
 }
 
+/**
+ * Integers are read as strtoull() with base 0 does: hexadecimal after "0x", octal after a leading '0', and what
+ * follows the digits is ignored.
+ */
 template <typename T, typename std::enable_if<std::is_integral<T>::value>::type * = nullptr>
-inline void derive(const std::string &self, T &to)
+inline void derive(std::string_view self, T &to)
 {
-    std::string formated = trim(self);
+    std::string_view formated = trimmed(self);
     if (formated.empty()) {
         to = 0;
-    } else {
-        bool negative = false;
-        if (formated[0] == '-') {
-            negative = true;
+        return;
+    }
+    bool negative = formated[0] == '-';
+    if (negative || formated[0] == '+') {
+        formated.remove_prefix(1);
+    }
+    int base = 10;
+    if (formated.size() > 1 && formated[0] == '0') {
+        base = 8;
+        if ((formated[1] | ' ') == 'x') {
+            base = 16;
+            formated.remove_prefix(2);
         }
-        unsigned long long v = std::stoull(negative ? formated.substr(1) : formated, nullptr, 0);
+    }
+    unsigned long long v = 0;
+    auto [end, ec] = std::from_chars(formated.data(), formated.data() + formated.size(), v, base);
+    if (ec == std::errc::result_out_of_range) {
+        throw std::out_of_range("Out of range: \"" + std::string(self) + "\"");
+    } else if (ec != std::errc() && base != 16) { // "0x" alone is 0
+        throw std::invalid_argument("Not integral value: \"" + std::string(self) + "\"");
+    }
+
+    to = static_cast<T>(v * (negative ? -1 : 1));
+}
 
-        to = static_cast<T>(v * (negative ? -1 : 1));
+template <typename T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
+inline void derive(std::string_view self, T &to)
+{
+    std::string_view formated = trimmed(self);
+    if (!formated.empty() && formated[0] == '+') {
+        formated.remove_prefix(1);
+    }
+    auto [end, ec] = std::from_chars(formated.data(), formated.data() + formated.size(), to);
+    if (ec != std::errc()) {
+        throw std::runtime_error("Unable to convert");
     }
 }
 
@@ -192,59 +253,77 @@ struct has_istream {
     enum { value = (sizeof(test<T>(0)) == sizeof(sizeof(std::true_type))) };
 };
 
-template <typename T, typename std::enable_if<(std::is_arithmetic<T>::value && !std::is_integral<T>::value)
-                                              || has_istream<T>::value>::type * = nullptr>
-inline void derive(const std::string &self, T &to)
+template <typename T,
+          typename std::enable_if<!std::is_arithmetic<T>::value && has_istream<T>::value>::type * = nullptr>
+inline void derive(std::string_view self, T &to)
 {
-    std::stringstream in(self);
+    std::stringstream in{std::string(self)};
     in >> to;
     if (!in) {
         throw std::runtime_error("Unable to convert");
     }
 }
 
-void derive(const bool &from, std::string &to)
+/**
+ * Write `from` as `ostream << from` would into `buffer`, returns the length.
+ */
+template <typename T>
+inline size_t format(char (&buffer)[64], const T &from)
+{
+    if constexpr (std::is_same<T, char>::value || std::is_same<T, signed char>::value
+                  || std::is_same<T, unsigned char>::value) {
+        buffer[0] = static_cast<char>(from);
+        return 1;
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return std::to_chars(buffer, buffer + sizeof(buffer), from, std::chars_format::general, 6).ptr - buffer;
+    } else {
+        return std::to_chars(buffer, buffer + sizeof(buffer), from).ptr - buffer;
+    }
+}
+
+inline void derive(const bool &from, std::string &to)
 {
     to = from ? "true" : "false";
 }
 
-void derive(const char *from, std::string &to)
+inline void derive(const char *from, std::string &to)
 {
     to = std::string(from);
 }
 
 template <typename T, typename std::enable_if<std::is_arithmetic<T>::value>::type * = nullptr>
-void derive(const T &from, std::string &to)
+inline void derive(const T &from, std::string &to)
 {
-    std::stringstream ss;
-    ss << from;
-    to = ss.str();
+    char buffer[64];
+    to.assign(buffer, format(buffer, from));
 }
 
 template <typename T>
-void derive(const std::vector<T> &from, std::string &to)
+inline void derive(const std::vector<T> &from, std::string &to)
 {
     to = "[";
-    const std::string delim = ", ";
+    std::string str;
     for (auto const &e : from) {
-        std::string str;
+        if (&e != &from.front()) {
+            to += ", ";
+        }
         derive(e, str);
-        to += str + delim;
-    }
-    if (from.size() != 0) {
-        to.erase(to.size() - delim.size(), delim.size());
+        to += str;
     }
     to += "]";
 }
 
 template <typename Key, typename Value, class Hasher = std::hash<Key>>
-void derive(const std::map<Key, Value, Hasher> &from, std::string &to)
+inline void derive(const std::map<Key, Value, Hasher> &from, std::string &to)
 {
+    std::string key, value;
     for (auto const &e : from) {
-        std::string key, value;
         derive(e.first, key);
         derive(e.second, value);
-        to += key + ": " + value + "; ";
+        to += key;
+        to += ": ";
+        to += value;
+        to += "; ";
     }
     if (to.size() >= 2) {
         to.erase(to.size() - 2, 2); // pop last delimeters
@@ -252,45 +331,39 @@ void derive(const std::map<Key, Value, Hasher> &from, std::string &to)
 }
 
 template <typename T>
-inline std::vector<T> split(const std::string &self, const std::string &delimiters)
+inline void split(std::string_view self, std::string_view delimiters, std::vector<T> &tokens)
 {
-    std::vector<T> tokens;
-    split(self, delimiters, [&](const std::string &token) {
+    tokenize(self, delimiters, [&](std::string_view token) {
         T t;
         derive(token, t);
-        tokens.emplace_back(t);
+        tokens.emplace_back(std::move(t));
         return true;
     });
-
-    return tokens;
 }
 
 template <typename T>
-inline void split(const std::string &self, const std::string &delimiters, std::vector<T> &tokens)
+inline std::vector<T> split(std::string_view self, std::string_view delimiters)
 {
-    split(self, delimiters, [&](const std::string &token) {
-        T t;
-        derive(token, t);
-        tokens.emplace_back(t);
-        return true;
-    });
+    std::vector<T> tokens;
+    split(self, delimiters, tokens);
+    return tokens;
 }
 
-inline size_t split(std::vector<std::string> &tokens, const std::string &self, const std::string &delimiters)
+inline size_t split(std::vector<std::string> &tokens, std::string_view self, std::string_view delimiters)
 {
     tokens.clear();
-    auto consumer = [&](const std::string &token) {
+    auto consumer = [&](std::string_view token) {
         tokens.emplace_back(token);
         return true;
     };
-    split(self, delimiters, consumer, consumer);
+    tokenize(self, delimiters, consumer, consumer);
     return tokens.size();
 };
 
 template <typename T>
-inline void derive(const std::string &self, std::vector<T> &repeated)
+inline void derive(std::string_view self, std::vector<T> &repeated)
 {
-    char leading = self[0];
+    char leading = self.empty() ? '\0' : self[0];
     if (leading == '[' || leading == '{') {
         if (self.back() == leading + 2 /* ']' or '}' */) {
             split(self.substr(1, self.size() - 2), ",", repeated);
@@ -303,14 +376,16 @@ inline void derive(const std::string &self, std::vector<T> &repeated)
 }
 
 template <typename T>
-inline void derive(const std::string &self, std::vector<std::vector<T>> &matrix)
+inline void derive(std::string_view self, std::vector<std::vector<T>> &matrix)
 {
     int depth = 0;
-    const char *s = self.c_str(), *p = s;
-    const char *e = self.c_str() + self.length();
+    size_t s = 0, p = 0, e = self.size();
+    auto at = [&self](size_t i) {
+        return i < self.size() ? self[i] : '\0';
+    };
 
     while (p <= e) {
-        char leading = *p;
+        char leading = at(p);
         if (leading == '[' || leading == '{') {
             if (depth == 0) {
                 s = ++p;
@@ -319,19 +394,19 @@ inline void derive(const std::string &self, std::vector<std::vector<T>> &matrix)
             }
             depth++;
             do {
-                if (*p == '[' || *p == '{') {
+                if (at(p) == '[' || at(p) == '{') {
                     depth++;
-                } else if (*p == ']' || *p == '}') {
+                } else if (at(p) == ']' || at(p) == '}') {
                     depth--;
                 }
                 p++;
-            } while (*p != '\0' && depth != 1);
+            } while (at(p) != '\0' && depth != 1);
 
             std::vector<T> vec;
-            derive(std::string(s, p++ - s), vec);
-            matrix.push_back(vec);
+            derive(self.substr(s, p++ - s), vec);
+            matrix.push_back(std::move(vec));
 
-            while (*p == ',' || *p == ' ') p++;
+            while (at(p) == ',' || at(p) == ' ') p++;
         } else {
             p++;
         }
@@ -339,23 +414,27 @@ inline void derive(const std::string &self, std::vector<std::vector<T>> &matrix)
 }
 
 template <typename Key, typename Value>
-inline void derive(const std::string &self, std::map<Key, Value> &mapped)
+inline void derive(std::string_view self, std::map<Key, Value> &mapped)
 {
-    split(self, ";", [&](const std::string &pair) {
-        std::vector<std::string> tokens;
-        split(pair, ": \t\r\n", [&](const std::string &token) {
-            tokens.emplace_back(token);
+    tokenize(self, ";", [&](std::string_view pair) {
+        std::string_view tokens[2];
+        size_t count = 0;
+        tokenize(pair, ": \t\r\n", [&](std::string_view token) {
+            if (count < 2) {
+                tokens[count] = token;
+            }
+            count++;
             return true;
         });
-        if (tokens.size() == 2) {
+        if (count == 2) {
             Key key;
             Value value;
             derive(tokens[0], key);
             derive(tokens[1], value);
-            mapped[key] = value;
+            mapped[std::move(key)] = std::move(value);
             return true;
         } else {
-            throw std::runtime_error("Invalid key:value pair: " + pair);
+            throw std::runtime_error("Invalid key:value pair: " + std::string(pair));
         }
     });
 }
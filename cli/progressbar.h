@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <math.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -28,11 +29,15 @@
 #include <sys/types.h>
 
 #include <mutex>
+#include <chrono>
 #include <string>
+#include <thread>
 #include <vector>
 #include <atomic>
 #include <memory>
+#include <algorithm>
 #include <unordered_map>
+#include <condition_variable>
 
 /* CSI sequence: https://www.liquisearch.com/ansi_escape_code/csi_codes */
 
@@ -50,17 +55,226 @@ std::string replace_all(std::string str, const std::string &from, const std::str
 
 class ProgressBar {
   public:
+    /**
+     * Items and bytes processed for a bar, counted per thread so that a worker only ever writes to a counter of its
+     * own, and summed up when the bar is drawn or a snapshot is taken. Rates, and the remaining time they give, are
+     * smoothed by an exponentially weighted moving average over about `window` seconds. The counters of threads that
+     * exited are folded into retired totals, so that pools replacing their threads do not grow the bar.
+     */
+    class ProgressMetrics {
+      public:
+        struct Snapshot {
+            double elapsed = 0.0; // seconds
+            double percentage = 0.0;
+            uint64_t items = 0, bytes = 0;
+            double items_per_second = 0.0, bytes_per_second = 0.0;
+            double remaining = -1.0;                                    // seconds, -1 until there is a rate
+            std::vector<std::pair<std::thread::id, uint64_t>> workers; // items by live thread, in order of arrival
+
+            /* one line for logs */
+            std::string to_string() const
+            {
+                char buff[160];
+                snprintf(buff, sizeof(buff), "%.1f%% in %.1fs, %llu items (%.1f/s), %s (%s/s), ", percentage, elapsed,
+                         static_cast<unsigned long long>(items), items_per_second,
+                         format_bytes(static_cast<double>(bytes)).c_str(), format_bytes(bytes_per_second).c_str());
+                std::string line = buff;
+                if (remaining < 0) {
+                    line += "remaining unknown";
+                } else {
+                    snprintf(buff, sizeof(buff), "remaining %.1fs", remaining);
+                    line += buff;
+                }
+                for (size_t i = 0; i < workers.size(); i++) {
+                    snprintf(buff, sizeof(buff), "%s worker %zu: %llu (%.1f%%)", i == 0 ? "," : ";", i,
+                             static_cast<unsigned long long>(workers[i].second),
+                             items ? 100.0 * workers[i].second / items : 0.0);
+                    line += buff;
+                }
+                return line;
+            }
+        };
+
+        explicit ProgressMetrics(double window = 5.0)
+            : id(next_id()), window(window), starttime(std::chrono::steady_clock::now()),
+              counters(std::make_shared<Counters>())
+        {
+        }
+
+        void add(uint64_t items, uint64_t bytes)
+        {
+            Counter &counter = local();
+            counter.items.store(counter.items.load(std::memory_order_relaxed) + items, std::memory_order_relaxed);
+            if (bytes != 0) {
+                counter.bytes.store(counter.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+            }
+        }
+
+        /* items added since the last call */
+        uint64_t unfolded()
+        {
+            std::lock_guard<std::mutex> guard(counters->mutex);
+            uint64_t items = counters->retired_items;
+            for (auto &counter : counters->live) {
+                items += counter->items.load(std::memory_order_relaxed);
+            }
+            uint64_t delta = items - folded;
+            folded = items;
+            return delta;
+        }
+
+        Snapshot snapshot(double percentage)
+        {
+            Snapshot snapshot;
+            snapshot.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - starttime).count();
+            snapshot.percentage = percentage;
+
+            std::lock_guard<std::mutex> guard(counters->mutex);
+            snapshot.items = counters->retired_items, snapshot.bytes = counters->retired_bytes;
+            for (auto &counter : counters->live) {
+                uint64_t items = counter->items.load(std::memory_order_relaxed);
+                snapshot.items += items;
+                snapshot.bytes += counter->bytes.load(std::memory_order_relaxed);
+                snapshot.workers.emplace_back(counter->owner, items);
+            }
+
+            // samples too close to each other are mostly noise
+            double dt = snapshot.elapsed - last.elapsed;
+            if (dt >= 0.05) {
+                double items_per_second = (snapshot.items - last.items) / dt;
+                double bytes_per_second = (snapshot.bytes - last.bytes) / dt;
+                double percentage_per_second = (percentage - last.percentage) / dt;
+                double alpha = sampled ? 1.0 - exp(-dt / window) : 1.0;
+                rates.items_per_second += alpha * (items_per_second - rates.items_per_second);
+                rates.bytes_per_second += alpha * (bytes_per_second - rates.bytes_per_second);
+                rates.percentage += alpha * (percentage_per_second - rates.percentage);
+                last = snapshot;
+                sampled = true;
+            }
+            snapshot.items_per_second = rates.items_per_second;
+            snapshot.bytes_per_second = rates.bytes_per_second;
+            if (percentage >= 100.0) {
+                snapshot.remaining = 0.0;
+            } else if (sampled && rates.percentage > 1e-9) {
+                snapshot.remaining = (100.0 - percentage) / rates.percentage;
+            }
+            return snapshot;
+        }
+
+        static std::string format_bytes(double bytes)
+        {
+            static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+            size_t unit = 0;
+            while (bytes >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+                bytes /= 1024.0, unit++;
+            }
+            char buff[32];
+            snprintf(buff, sizeof(buff), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+            return buff;
+        }
+
+      private:
+        struct alignas(64) Counter {
+            std::thread::id owner;
+            std::atomic<uint64_t> items{0}, bytes{0};
+        };
+
+        /* shared with the threads which added to them, so that they outlive neither the metrics nor the threads */
+        struct Counters {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Counter>> live;
+            uint64_t retired_items = 0, retired_bytes = 0;
+        };
+
+        /* the counters a thread added to, retired when it exits unless their metrics is gone already */
+        struct Retirer {
+            std::vector<std::pair<std::weak_ptr<Counters>, Counter *>> counters;
+
+            ~Retirer()
+            {
+                for (auto &[weak, counter] : counters) {
+                    if (auto shared = weak.lock()) {
+                        std::lock_guard<std::mutex> guard(shared->mutex);
+                        shared->retired_items += counter->items.load(std::memory_order_relaxed);
+                        shared->retired_bytes += counter->bytes.load(std::memory_order_relaxed);
+                        auto &live = shared->live;
+                        live.erase(std::find_if(live.begin(), live.end(), [counter = counter](const auto &c) {
+                            return c.get() == counter;
+                        }));
+                    }
+                }
+            }
+        };
+
+        static uint64_t next_id()
+        {
+            static std::atomic<uint64_t> ids{1};
+            return ids++;
+        }
+
+        /* the counter of the calling thread, cached per thread by metrics ids which are never reused */
+        Counter &local()
+        {
+            struct Cached {
+                uint64_t id;
+                Counter *counter;
+            };
+            thread_local Cached cache[8] = {};
+            Cached &cached = cache[id % 8];
+            if (cached.id == id) {
+                return *cached.counter;
+            }
+
+            std::lock_guard<std::mutex> guard(counters->mutex);
+            auto &live = counters->live;
+            auto self = std::this_thread::get_id();
+            auto it = std::find_if(live.begin(), live.end(), [self](const std::unique_ptr<Counter> &counter) {
+                return counter->owner == self;
+            });
+            if (it == live.end()) {
+                live.emplace_back(new Counter);
+                live.back()->owner = self;
+                it = live.end() - 1;
+
+                thread_local Retirer retirer;
+                auto &added = retirer.counters;
+                added.erase(std::remove_if(added.begin(), added.end(), [](const auto &c) {
+                                return c.first.expired();
+                            }),
+                            added.end());
+                added.emplace_back(counters, it->get());
+            }
+            cached = {id, it->get()};
+            return **it;
+        }
+
+        const uint64_t id;
+        const double window;
+        const std::chrono::steady_clock::time_point starttime;
+
+        std::shared_ptr<Counters> counters; // its mutex also guards the samples below
+        uint64_t folded = 0;
+        bool sampled = false;
+        Snapshot last;  // as of the last sample
+        Snapshot rates; // smoothed, percentage is per second
+    };
+
     struct ProgressData {
         time_t starttime;
         size_t max_steps;
         std::atomic<double> percentage;
         std::unordered_map<std::string, std::string> args;
+        ProgressMetrics metrics;
 
         ProgressData(size_t max_steps) : starttime(time(nullptr)), max_steps(max_steps), percentage(0.0) {}
 
         double add(double progress)
         {
-            return percentage = std::min(100.0, percentage + progress);
+            double current = percentage, updated;
+            do {
+                updated = current + progress < 100.0 - 1e-9 ? current + progress : 100.0; // rounding of the steps
+            } while (!percentage.compare_exchange_weak(current, updated));
+            return updated;
         }
 
         double set(double progress)
@@ -101,11 +315,22 @@ class ProgressBar {
                     return std::string(buff);
                 };
 
+                auto format_rate = [](double rate) -> std::string {
+                    char buff[32];
+                    snprintf(buff, sizeof(buff), "%.1f/s", rate);
+                    return std::string(buff);
+                };
+
                 time_t now = time(nullptr);
+                auto snapshot = metrics.snapshot(percentage);
                 args["progress"] = format_progress(percentage);
                 args["bar"] = format_bar(percentage, bar_width);
                 args["elapsed"] = format_time(now - starttime);
-                if (percentage >= 1e-3) {
+                args["rate"] = format_rate(snapshot.items_per_second);
+                args["throughput"] = ProgressMetrics::format_bytes(snapshot.bytes_per_second) + "/s";
+                if (snapshot.remaining >= 0) {
+                    args["remaining"] = format_time(static_cast<time_t>(snapshot.remaining + 0.5));
+                } else if (percentage >= 1e-3) {
                     args["remaining"] = format_time((now - starttime) * (100.0 - percentage) / percentage);
                 } else {
                     args["remaining"] = "--:--";
@@ -224,6 +449,20 @@ class ProgressBar {
                 return;
             }
 
+            std::string outputs = render(data);
+            if (write(fd, outputs.c_str(), outputs.size()) < 0) {
+                TRACE("write failed");
+            }
+            TRACE("%s", replace_all(outputs, "\x1B", "ESC ").c_str());
+        }
+
+        /* the output of refresh(), without writing it */
+        std::string render(std::shared_ptr<ProgressData> data)
+        {
+            if (disable) {
+                return "";
+            }
+
             std::string outputs = "\x1B[?25l";
             if (std::get<0>(position) > 0) {
                 outputs += "\x1B[s\x1B[" + std::to_string(std::get<0>(position)) + ";"
@@ -246,10 +485,7 @@ class ProgressBar {
             if (std::get<0>(position) > 0) {
                 outputs += "\x1B[u";
             }
-            if (write(fd, outputs.c_str(), outputs.size()) < 0) {
-                TRACE("write failed");
-            }
-            TRACE("%s", replace_all(outputs, "\x1B", "ESC ").c_str());
+            return outputs;
         }
 
         static std::tuple<int, int> getpos()
@@ -311,6 +547,114 @@ class ProgressBar {
         }
     };
 
+    /**
+     * The thread redrawing the bars rendered in background, see ProgressBar::background(). Every frame, each widget
+     * shows the last of its bars that changed, and what is drawn on an output goes out in one write().
+     */
+    class Renderer {
+      public:
+        static Renderer &instance()
+        {
+            static Renderer renderer;
+            return renderer;
+        }
+
+        ~Renderer()
+        {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                stopped = true;
+            }
+            cond.notify_all();
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+
+        void set_fps(double fps)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            interval = std::chrono::microseconds(static_cast<int64_t>(1e6 / std::max(fps, 0.1)));
+        }
+
+        void attach(ProgressBar *bar)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            bars.push_back(bar);
+            if (!worker.joinable()) {
+                worker = std::thread(&Renderer::run, this);
+            }
+            cond.notify_all();
+        }
+
+        void detach(ProgressBar *bar)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            bars.erase(std::remove(bars.begin(), bars.end(), bar), bars.end());
+            auto shown = drawn.find(bar->widget.get());
+            if (bar->changed() || (shown != drawn.end() && shown->second == bar)) {
+                std::string outputs = bar->render(); // the final state
+                if (write(bar->widget->fd, outputs.c_str(), outputs.size()) < 0) {
+                    TRACE("write failed");
+                }
+            }
+            if (shown != drawn.end() && shown->second == bar) {
+                drawn.erase(shown);
+            }
+        }
+
+      private:
+        Renderer() : stopped(false), interval(std::chrono::milliseconds(100)) {}
+
+        void run()
+        {
+            std::unique_lock<std::mutex> latch(mutex);
+            while (!stopped) {
+                if (bars.empty()) {
+                    cond.wait(latch);
+                    continue;
+                }
+                frame();
+                cond.wait_for(latch, interval);
+            }
+        }
+
+        void frame()
+        {
+            std::unordered_map<ProgressWidget *, ProgressBar *> latest;
+            for (auto bar : bars) {
+                if (bar->changed()) {
+                    latest[bar->widget.get()] = bar;
+                }
+            }
+            time_t now = time(nullptr);
+            for (auto &shown : drawn) {
+                if (latest.count(shown.first) == 0 && shown.second->shown_at != now) { // elapsed, remaining
+                    latest[shown.first] = shown.second;
+                }
+            }
+
+            std::unordered_map<int, std::string> outputs;
+            for (auto &it : latest) {
+                outputs[it.first->fd] += it.second->render();
+                drawn[it.first] = it.second;
+            }
+            for (auto &it : outputs) {
+                if (write(it.first, it.second.c_str(), it.second.size()) < 0) {
+                    TRACE("write failed");
+                }
+            }
+        }
+
+        bool stopped;
+        std::chrono::microseconds interval;
+        std::vector<ProgressBar *> bars;
+        std::unordered_map<ProgressWidget *, ProgressBar *> drawn; // last bar drawn on each widget
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::thread worker;
+    };
+
     ProgressBar(bool disable) : widget(std::make_shared<ProgressWidget>(disable)) {}
     ProgressBar(std::shared_ptr<ProgressWidget> widget, std::shared_ptr<ProgressData> data) : data(data), widget(widget)
     {
@@ -332,9 +676,37 @@ class ProgressBar {
     {
     }
 
-    double advance(size_t steps)
+    ~ProgressBar()
     {
-        if (data.get()) {
+        if (background) {
+            Renderer::instance().detach(this);
+        }
+    }
+
+    /**
+     * Render in background, for bars updated from hot loops or many threads: advance() is then an atomic add,
+     * set_progress() an atomic store, and the bar is redrawn at most `fps` times a second by a thread shared by all
+     * the bars rendered in background. Both return the progress as last drawn, and are not meant to be mixed.
+     */
+    ProgressBar &render_in_background(double fps = 10)
+    {
+        Renderer::instance().set_fps(fps);
+        if (!background && widget.get() && !widget->disable && data.get()) {
+            data->metrics.unfolded(); // already in the percentage
+            background = true;
+            Renderer::instance().attach(this);
+        }
+        return *this;
+    }
+
+    /* `bytes` processed with these steps count for the throughput, see snapshot() */
+    double advance(size_t steps, size_t bytes = 0)
+    {
+        if (data.get() && background) {
+            data->metrics.add(steps, bytes);
+            return data->percentage;
+        } else if (data.get()) {
+            data->metrics.add(steps, bytes);
             std::lock_guard<std::mutex> guard(lock);
             if (data->percentage != data->advance(steps) && widget.get()) {
                 widget->refresh(data);
@@ -347,7 +719,9 @@ class ProgressBar {
 
     double set_progress(double progress)
     {
-        if (data.get()) {
+        if (data.get() && background) {
+            return data->set(progress);
+        } else if (data.get()) {
             std::lock_guard<std::mutex> guard(lock);
             if (data->percentage != data->set(progress) && widget.get()) {
                 widget->refresh(data);
@@ -360,17 +734,21 @@ class ProgressBar {
 
     void add_arg(std::string key, std::string value)
     {
+        std::lock_guard<std::mutex> guard(lock);
         if (data.get()) {
             data->args[key] = value;
+            edited = true;
         }
     }
 
     void add_args(std::initializer_list<std::pair<std::string, std::string>> _args)
     {
+        std::lock_guard<std::mutex> guard(lock);
         if (data.get()) {
             for (auto arg : _args) {
                 data->args[arg.first] = arg.second;
             }
+            edited = true;
         }
     }
 
@@ -379,9 +757,25 @@ class ProgressBar {
         std::lock_guard<std::mutex> guard(lock);
         if (data.get()) {
             data->args = std::unordered_map<std::string, std::string>(_args.begin(), _args.end());
+            edited = true;
         }
     }
 
+    /**
+     * Progress, rates, remaining time and the items of each worker as of now, to report without drawing, as with a
+     * disabled widget.
+     */
+    ProgressMetrics::Snapshot snapshot()
+    {
+        if (!data.get()) {
+            return ProgressMetrics::Snapshot();
+        }
+        if (background) {
+            data->advance(data->metrics.unfolded());
+        }
+        return data->metrics.snapshot(data->percentage);
+    }
+
     ProgressBar &overall()
     {
         return overall_bar.get() ? *overall_bar : *ProgressBar::disabled_bar();
@@ -403,6 +797,31 @@ class ProgressBar {
     std::shared_ptr<ProgressData> data;
     std::shared_ptr<ProgressWidget> widget;
     std::shared_ptr<ProgressBar> overall_bar;
+
+    // rendering in background, what was drawn last
+    bool background = false;
+    std::atomic<bool> edited{false};
+    double shown = -1.0;
+    time_t shown_at = 0;
+
+    /* in background, has the bar changed since it was drawn, the steps advanced are folded into the percentage */
+    bool changed()
+    {
+        uint64_t steps = data->metrics.unfolded();
+        if (steps != 0) {
+            data->advance(steps);
+        }
+        return data->percentage != shown || edited;
+    }
+
+    std::string render()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        edited = false;
+        shown = data->percentage;
+        shown_at = time(nullptr);
+        return widget->render(data);
+    }
 };
 
 class ProgressBars {
@@ -429,13 +848,13 @@ class ProgressBars {
     ~ProgressBars()
     {
         size_t off = 0;
+        routine_bars.clear(); // those rendered in background are drawn a last time
         if (overall_bar.get()) {
             off += 1;
             overall_bar.reset(); // destory before widgets
         }
         if (leave) {
             off += widgets.size();
-            routine_bars.clear();
             widgets.clear();
         } else {
             for (auto widget : widgets) {
@@ -456,11 +875,27 @@ class ProgressBars {
         }
     }
 
+    /* render the bars in background, see ProgressBar::render_in_background() */
+    ProgressBars &render_in_background(double fps = 10)
+    {
+        background_fps = fps;
+        if (overall_bar.get()) {
+            overall_bar->render_in_background(fps);
+        }
+        for (auto &bar : routine_bars) {
+            bar->render_in_background(fps);
+        }
+        return *this;
+    }
+
     ProgressBar &operator[](size_t index)
     {
         if (index >= routine_bars.size()) {
             assert(widgets.size() > 0);
             routine_bars.push_back(std::make_shared<ProgressBar>(widgets[index % widgets.size()], 100, overall_bar));
+            if (background_fps > 0) {
+                routine_bars.back()->render_in_background(background_fps);
+            }
         }
         assert(routine_bars.size() > 0);
         return *routine_bars[index % routine_bars.size()];
@@ -469,6 +904,7 @@ class ProgressBars {
   private:
     bool leave;
     bool disable;
+    double background_fps = 0;
     std::tuple<int, int> position;
     std::shared_ptr<ProgressBar> overall_bar;
     std::vector<std::shared_ptr<ProgressBar>> routine_bars;
@@ -20,17 +20,21 @@
 #include <cassert>
 #include <sstream>
 #include <functional>
-#include <locale>
-#include <clocale>
-#include <wchar.h>
 #include <math.h>
+#include <errno.h>
+#include <unistd.h>
 #include <iostream>
 #include <algorithm>
-#include <regex>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <memory>
 #include <iomanip>
 #include <map>
 #include <array>
 
+#include "../misc/parallel.h"
+
 #if defined(__GNUC__)
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 #elif defined(__clang__)
@@ -299,56 +303,107 @@ namespace tabulate
 {
 static const std::string NEWLINE = "\n";
 
-static size_t display_width_of(const std::string &text, const std::string &locale, bool wchar_enabled)
+/**
+ * Index past the ANSI escape sequence at `text[i]`, which is ESC: CSI sequences ("\x1b[...m" and alike) and two bytes
+ * sequences. A lone ESC is skipped alone.
+ */
+static size_t skip_escape(const std::string &text, size_t i)
 {
-    // delete ansi escape sequences
-    std::regex e("\x1b(?:[@-Z\\-_]|\\[[0-?]*[ -/]*[@-~])");
-    std::string str = std::regex_replace(text, e, "");
-
-    if (!wchar_enabled) {
-        return str.length();
+    size_t size = text.size();
+    if (i + 1 >= size) {
+        return i + 1;
+    }
+    unsigned char ch = text[i + 1];
+    if (ch != '[') {
+        return ch >= '@' && ch <= '_' ? i + 2 : i + 1;
     }
+    size_t j = i + 2;
+    while (j < size && text[j] >= '0' && text[j] <= '?') { // parameter bytes
+        j++;
+    }
+    while (j < size && text[j] >= ' ' && text[j] <= '/') { // intermediate bytes
+        j++;
+    }
+    return j < size && text[j] >= '@' && text[j] <= '~' ? j + 1 : i + 1;
+}
 
-    if (str.size() == 0) {
+/**
+ * Columns taken by a code point on a terminal, after Markus Kuhn's wcwidth(): 0 for combining marks, 2 for East Asian
+ * wide and fullwidth characters and emoji, 1 otherwise.
+ */
+static int code_point_width(uint32_t ucs)
+{
+    static const uint32_t combining[][2] = {
+        {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+        {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+        {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0902},
+        {0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A},
+        {0x0E47, 0x0E4E}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F},
+        {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+        {0xFEFF, 0xFEFF}, {0xE0100, 0xE01EF},
+    };
+    static const uint32_t wide[][2] = {
+        {0x1100, 0x115F},   {0x2329, 0x232A},   {0x2E80, 0x303E},   {0x3040, 0xA4CF},   {0xAC00, 0xD7A3},
+        {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},   {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},
+        {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+    };
+    auto within = [ucs](const uint32_t(*table)[2], size_t n) {
+        size_t lo = 0, hi = n;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (ucs > table[mid][1]) {
+                lo = mid + 1;
+            } else if (ucs < table[mid][0]) {
+                hi = mid;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (ucs < 0x300) {
+        return 1;
+    }
+    if (within(combining, sizeof(combining) / sizeof(combining[0]))) {
         return 0;
     }
+    return ucs >= 0x1100 && within(wide, sizeof(wide) / sizeof(wide[0])) ? 2 : 1;
+}
 
-    // XXX: Markus Kuhn's open-source wcswidth.c
-#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
-    {
-        // The behavior of wcswidth() depends on the LC_CTYPE category of the current locale.
-        // Set the current locale based on cell properties before computing width
-        auto old_locale = std::locale::global(std::locale(locale));
-
-        // Convert from narrow std::string to wide string
-        wchar_t stackbuff[128], *wstr = stackbuff;
-        if (str.size() > 128) {
-            wstr = new wchar_t[str.size()];
+/**
+ * Columns taken by `text` on a terminal, ANSI escape sequences excluded. With `wchar_enabled`, the text is decoded as
+ * UTF-8 and East Asian wide characters count for two columns, otherwise every byte counts for one. This neither
+ * depends on nor changes the global locale, `locale` is kept for compatibility.
+ */
+static size_t display_width_of(const std::string &text, const std::string &locale, bool wchar_enabled)
+{
+    (void)locale;
+    size_t width = 0, size = text.size();
+    for (size_t i = 0; i < size;) {
+        unsigned char ch = text[i];
+        if (ch == '\x1b') {
+            i = skip_escape(text, i);
+            continue;
         }
-
-        std::mbstowcs(wstr, str.c_str(), str.size());
-
-        // Compute display width of wide string
-        int len = wcswidth(wstr, str.size());
-
-        if (wstr != stackbuff) {
-            delete[] wstr;
+        if (ch < 0x80 || !wchar_enabled) { // fast path of ASCII
+            width++, i++;
+            continue;
         }
 
-        // Restore old locale
-        std::locale::global(old_locale);
-
-        if (len >= 0) {
-            return len;
+        size_t length = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : ch >= 0xC0 ? 2 : 1;
+        uint32_t ucs = length == 4 ? ch & 0x07 : length == 3 ? ch & 0x0F : ch & 0x1F;
+        size_t k = 1;
+        for (; k < length && i + k < size && (text[i + k] & 0xC0) == 0x80; k++) {
+            ucs = (ucs << 6) | (text[i + k] & 0x3F);
         }
+        if (length == 1 || k < length) { // not UTF-8, one column per byte
+            width++, i++;
+            continue;
+        }
+        width += code_point_width(ucs);
+        i += length;
     }
-#endif
-
-    {
-        return (str.length() - std::count_if(str.begin(), str.end(), [](char c) -> bool {
-                    return (c & 0xC0) == 0x80;
-                }));
-    }
+    return width;
 }
 } // namespace tabulate
 
@@ -426,26 +481,30 @@ static std::vector<std::string> wrap_lines(const std::string &str, size_t width,
         std::stringstream ss(str);
         while (std::getline(ss, line, '\n')) {
             std::string wrapped;
+            size_t wrapped_width = 0; // of `wrapped`, kept up to date rather than measured again for every word
             for (auto &word : explode_string(line, {" ", "-", "\t"})) {
-                if (display_width_of(wrapped, locale, multi_bytes_character)
-                        + display_width_of(word, locale, multi_bytes_character)
-                    > width) {
-                    if (display_width_of(wrapped, locale, multi_bytes_character) > 0) {
+                size_t word_width = display_width_of(word, locale, multi_bytes_character);
+                if (wrapped_width + word_width > width) {
+                    if (wrapped_width > 0) {
                         lines.push_back(wrapped);
                         wrapped = "";
+                        wrapped_width = 0;
                     }
 
-                    while (display_width_of(word, locale, multi_bytes_character) > width) {
+                    while (word_width > width) {
                         wrapped = word.substr(0, width - 1) + "-";
                         lines.push_back(wrapped);
                         wrapped = "";
                         word = word.substr(width - 1);
+                        word_width = display_width_of(word, locale, multi_bytes_character);
                     }
 
                     word = lstrip(word);
+                    word_width = display_width_of(word, locale, multi_bytes_character);
                 }
 
                 wrapped += word;
+                wrapped_width += word_width;
             }
             lines.push_back(wrapped);
         }
@@ -682,6 +741,7 @@ class Format {
         // internationlization
         internationlization.locale = "";
         internationlization.multi_bytes_character = false;
+        internationlization.revision = 0;
     }
 
     size_t width() const
@@ -1059,6 +1119,7 @@ class Format {
     Format &locale(const std::string &value)
     {
         internationlization.locale = value;
+        internationlization.revision = revise();
         return *this;
     }
 
@@ -1070,9 +1131,19 @@ class Format {
     Format &multi_bytes_character(bool value)
     {
         internationlization.multi_bytes_character = value;
+        internationlization.revision = revise();
         return *this;
     }
 
+    /**
+     * Changes whenever the locale or multi_bytes_character do, unique among all formats, so that copies of a
+     * format share it only as long as they share those settings.
+     */
+    uint64_t revision() const
+    {
+        return internationlization.revision;
+    }
+
   public:
     struct {
         Align align;
@@ -1100,7 +1171,15 @@ class Format {
     struct {
         std::string locale;
         bool multi_bytes_character;
+        uint64_t revision;
     } internationlization;
+
+  private:
+    static uint64_t revise()
+    {
+        static std::atomic<uint64_t> revisions{0};
+        return revisions.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
 };
 
 class Cell {
@@ -1115,17 +1194,25 @@ class Cell {
     void set(const std::string &content)
     {
         m_content = content;
+        forget();
     }
 
     template <typename T>
     void set(const T value)
     {
         m_content = to_string(value);
+        forget();
     }
 
     size_t size()
     {
-        return display_width_of(m_content, m_format.locale(), m_format.multi_bytes_character());
+        std::atomic<size_t> &size = widths()[m_format.multi_bytes_character() ? 1 : 0];
+        size_t value = size.load(std::memory_order_relaxed);
+        if (value == npos) {
+            value = display_width_of(m_content, m_format.locale(), m_format.multi_bytes_character());
+            size.store(value, std::memory_order_relaxed);
+        }
+        return value;
     }
 
     Format &format()
@@ -1145,17 +1232,21 @@ class Cell {
         } else {
             if (m_content.empty()) {
                 return 0;
-            } else {
+            }
+            std::atomic<size_t> &width = widths()[2];
+            size_t max_width = width.load(std::memory_order_relaxed);
+            if (max_width == npos) {
                 std::string line;
                 std::stringstream ss(m_content.c_str());
 
-                size_t max_width = 0;
+                max_width = 0;
                 while (std::getline(ss, line, '\n')) {
                     max_width = std::max(max_width, display_width_of(line, m_format.locale(), true));
                 }
 
-                return max_width;
+                width.store(max_width, std::memory_order_relaxed);
             }
+            return max_width;
         }
     }
 
@@ -1180,8 +1271,35 @@ class Cell {
     }
 
   private:
+    void forget() const
+    {
+        for (auto &width : m_widths) {
+            width.store(npos, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * The cached widths, forgotten first if the format changed its locale since. Blocks of rows render on several
+     * threads, which may all measure the same cell: the widths are atomic, and any thread computes the same ones.
+     */
+    std::array<std::atomic<size_t>, 3> &widths() const
+    {
+        uint64_t revision = m_format.revision();
+        if (m_revision.load(std::memory_order_acquire) != revision) {
+            forget();
+            m_revision.store(revision, std::memory_order_release);
+        }
+        return m_widths;
+    }
+
     Format m_format;
     std::string m_content;
+
+    // display widths of the content, by bytes, by characters and of its widest line, npos until computed for the
+    // revision of the format
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    mutable std::array<std::atomic<size_t>, 3> m_widths{npos, npos, npos};
+    mutable std::atomic<uint64_t> m_revision{0};
 };
 
 template <template <typename, typename> class Container, typename Value>
@@ -2168,6 +2286,132 @@ std::string cornerformatter(Which which, const Cell *self, const Cell *top_left,
     return "";
 }
 } // namespace xterm
+
+namespace markdown
+{
+inline std::string cellformatter(const Cell &cell)
+{
+    std::string applied;
+
+    auto styles = cell.format().styles();
+    auto foreground_color = cell.format().color();
+    auto background_color = cell.format().background_color();
+    bool have = !foreground_color.none() || !background_color.none() || styles.size() != 0;
+
+    if (have) {
+        applied += "<span style=\"";
+
+        if (!foreground_color.none()) {
+            // color: <color>
+            applied += "color:" + to_string(foreground_color) + ";";
+        }
+
+        if (!background_color.none()) {
+            // color: <color>
+            applied += "background-color:" + to_string(background_color) + ";";
+        }
+
+        for (auto const &style : styles) {
+            switch (style) {
+                case Style::bold:
+                    applied += "font-weight:bold;";
+                    break;
+                case Style::italic:
+                    applied += "font-style:italic;";
+                    break;
+                // text-decoration: none|underline|overline|line-through|blink
+                case Style::crossed:
+                    applied += "text-decoration:line-through;";
+                    break;
+                case Style::underline:
+                    applied += "text-decoration:underline;";
+                    break;
+                case Style::blink:
+                    applied += "text-decoration:blink;";
+                    break;
+                default:
+                    // unsupported, do nothing
+                    break;
+            }
+        }
+        applied += "\">";
+    }
+
+    applied += replace_all(cell.get(), NEWLINE, "<br>");
+
+    if (have) {
+        applied += "</span>";
+    }
+
+    return applied;
+}
+
+inline std::string rowformatter(const Row &row)
+{
+    std::string exported = "| ";
+    for (auto const &cell : row) {
+        exported += cellformatter(cell) + " | ";
+    }
+    return exported;
+}
+
+/* alignment line following the header */
+inline std::string alignment(const Row &header)
+{
+    std::string alignment = "|";
+    for (auto const &cell : header) {
+        switch (cell.align()) {
+            case Align::left:
+                alignment += " :--";
+                break;
+            case Align::right:
+                alignment += " --:";
+                break;
+            case Align::center:
+                alignment += " :-:";
+                break;
+            default:
+                alignment += " ---";
+                break;
+        }
+        alignment += " |";
+    }
+    return alignment;
+}
+} // namespace markdown
+
+namespace latex
+{
+inline std::string rowformatter(const Row &row)
+{
+    std::string exported;
+    for (size_t j = 0; j < row.size(); j++) {
+        auto const &cell = row[j];
+        exported += replace_all(cell.get(), "#", "\\#");
+        if (!(cell.format().background_color().none())) {
+            exported += "\\cellcolor[HTML]{" + to_string(cell.format().background_color()) + "} ";
+        }
+        exported += (j < row.size() - 1) ? " & " : " \\\\";
+    }
+    return exported;
+}
+
+/* column specification of the tabular environment */
+inline std::string alignment(const Row &header)
+{
+    std::string alignment = "{";
+    for (auto const &cell : header) {
+        if (cell.align() & Align::left) {
+            alignment += 'l';
+        } else if (cell.align() & Align::hcenter) {
+            alignment += 'c';
+        } else if (cell.align() & Align::right) {
+            alignment += 'r';
+        }
+    }
+    return alignment + "}";
+}
+} // namespace latex
 } // namespace tabulate
 
 class Table : public std::enable_shared_from_this<Table> {
@@ -2185,6 +2429,16 @@ class Table : public std::enable_shared_from_this<Table> {
         this->title = std::move(title);
     }
 
+    /**
+     * Render blocks of rows of large tables on `pool`, anything with push(std::function<void()>) such as
+     * multiprocessing::threadpool, NULL to render them one after another. The pool must outlive the renderings.
+     */
+    template <typename Pool>
+    void set_thread_pool(Pool *pool)
+    {
+        executor = multiprocessing::executor_of(pool);
+    }
+
     BatchFormat format()
     {
         return BatchFormat(cells);
@@ -2339,13 +2593,14 @@ class Table : public std::enable_shared_from_this<Table> {
         }
 
         // add table content
-        for (size_t i = 1; i < rows.size(); i++) {
+        __render(exported, 1, [&](size_t i, std::string &rendered) {
             auto const &row = *rows[i];
             for (auto const &line : row.dump(stringformatter, tabulate::xterm::borderformatter,
                                              tabulate::xterm::cornerformatter, true, i == rows.size() - 1)) {
-                exported += line + NEWLINE;
+                rendered += line;
+                rendered += NEWLINE;
             }
-        }
+        });
         if (exported.size() >= NEWLINE.size()) {
             exported.erase(exported.size() - NEWLINE.size(), NEWLINE.size()); // pop last NEWLINE
         }
@@ -2428,95 +2683,12 @@ class Table : public std::enable_shared_from_this<Table> {
     std::string markdown() const
     {
         std::string exported;
-
-        auto format_cell = [](Cell &cell) {
-            std::string applied;
-
-            auto styles = cell.format().styles();
-            auto foreground_color = cell.format().color();
-            auto background_color = cell.format().background_color();
-            bool have = !foreground_color.none() || !background_color.none() || styles.size() != 0;
-
-            if (have) {
-                applied += "<span style=\"";
-
-                if (!foreground_color.none()) {
-                    // color: <color>
-                    applied += "color:" + to_string(foreground_color) + ";";
-                }
-
-                if (!background_color.none()) {
-                    // color: <color>
-                    applied += "background-color:" + to_string(background_color) + ";";
-                }
-
-                for (auto const &style : styles) {
-                    switch (style) {
-                        case Style::bold:
-                            applied += "font-weight:bold;";
-                            break;
-                        case Style::italic:
-                            applied += "font-style:italic;";
-                            break;
-                        // text-decoration: none|underline|overline|line-through|blink
-                        case Style::crossed:
-                            applied += "text-decoration:line-through;";
-                            break;
-                        case Style::underline:
-                            applied += "text-decoration:underline;";
-                            break;
-                        case Style::blink:
-                            applied += "text-decoration:blink;";
-                            break;
-                        default:
-                            // unsupported, do nothing
-                            break;
-                    }
-                }
-                applied += "\">";
-            }
-
-            applied += [&]() {
-                return replace_all(cell.get(), NEWLINE, "<br>");
-            }();
-
-            if (have) {
-                applied += "</span>";
-            }
-
-            return applied;
-        };
-
-        for (size_t i = 0; i < rows.size(); i++) {
-            exported += "| ";
-            for (auto cell : *rows[i]) {
-                exported += format_cell(cell) + " | ";
-            }
-            exported += NEWLINE;
-
+        __render(exported, 0, [this](size_t i, std::string &rendered) {
+            rendered += tabulate::markdown::rowformatter(*rows[i]) + NEWLINE;
             if (i == 0) {
-                // add alignentment
-                std::string alignment = "|";
-                for (auto const &cell : *rows[0]) {
-                    switch (cell.align()) {
-                        case Align::left:
-                            alignment += " :--";
-                            break;
-                        case Align::right:
-                            alignment += " --:";
-                            break;
-                        case Align::center:
-                            alignment += " :-:";
-                            break;
-                        default:
-                            alignment += " ---";
-                            break;
-                    }
-                    alignment += " |";
-                }
-                exported += alignment + NEWLINE;
+                rendered += tabulate::markdown::alignment(*rows[0]) + NEWLINE;
             }
-        }
+        });
         if (exported.size() >= NEWLINE.size()) {
             exported.erase(exported.size() - NEWLINE.size(), NEWLINE.size()); // pop last NEWLINE
         }
@@ -2531,49 +2703,20 @@ class Table : public std::enable_shared_from_this<Table> {
             exported += "\\caption{" + title + "}" + NEWLINE;
             exported += "\\centering" + NEWLINE; // used for centering table
         }
-        exported += "\\begin{tabular}";
-
-        // add alignment header
-        {
-            exported += "{";
-            for (auto &cell : *rows[0]) {
-                if (cell.align() & Align::left) {
-                    exported += 'l';
-                } else if (cell.align() & Align::hcenter) {
-                    exported += 'c';
-                } else if (cell.align() & Align::right) {
-                    exported += 'r';
-                }
-            }
-            exported += "}" + NEWLINE;
-        }
+        exported += "\\begin{tabular}" + tabulate::latex::alignment(*rows[0]) + NEWLINE;
         exported += "\\hline\\hline" + NEWLINE; // %inserts double horizontal lines
 
         // iterate content and put text into the table.
-        for (size_t i = 0; i < rows.size(); i++) {
-            auto &row = *rows[i];
+        __render(exported, 0, [this, indentation](size_t i, std::string &rendered) {
             // apply row content indentation
             if (indentation != 0) {
-                exported += std::string(indentation, ' ');
-            }
-
-            for (size_t j = 0; j < row.size(); j++) {
-                auto cell = row[j];
-                auto transfer = [](Cell &cell) {
-                    std::string tmp = replace_all(cell.get(), "#", "\\#");
-                    if (!(cell.format().background_color().none())) {
-                        tmp += "\\cellcolor[HTML]{" + to_string(cell.format().background_color()) + "} ";
-                    }
-                    return tmp;
-                };
-                exported += transfer(cell);
-                exported += (j < row.size() - 1) ? " & " : " \\\\";
+                rendered += std::string(indentation, ' ');
             }
-            exported += NEWLINE;
+            rendered += tabulate::latex::rowformatter(*rows[i]) + NEWLINE;
             if (i == 0) {
-                exported += "\\hline" + NEWLINE;
+                rendered += "\\hline" + NEWLINE;
             }
-        }
+        });
         exported += "\\hline" + NEWLINE;
         exported += "\\end{tabular}" + NEWLINE;
         exported += "\\end{table}";
@@ -2588,6 +2731,7 @@ class Table : public std::enable_shared_from_this<Table> {
     std::vector<std::tuple<int, int, int, int>> merges;
 
     size_t cached_width;
+    multiprocessing::executor executor;
 
     Row &__add_row()
     {
@@ -2598,21 +2742,35 @@ class Table : public std::enable_shared_from_this<Table> {
 
     void __on_add_auto_update()
     {
-        // auto update width
-        size_t headerwidth = 0;
-        for (size_t i = 0; i < column_size(); i++) {
-            Column col = column(i);
+        // rows are kept as wide as the widest one, the header as a witness unless a row was widened meanwhile
+        Row &added = *rows.back();
+        size_t columns = std::max(rows[0]->size(), added.size());
+        if (columns > rows[0]->size()) {
+            columns = column_size();
+            for (auto &row : rows) {
+                if (row->size() < columns) {
+                    (*row)[columns - 1];
+                }
+            }
+        } else if (added.size() < columns) {
+            added[columns - 1];
+        }
 
-            size_t oldwidth = col.size() == 0 ? 0 : col[0].width();
-            size_t newwidth = col[col.size() - 1].width();
+        // auto update width, all the cells of a column have its width but those of the row added
+        size_t headerwidth = 0;
+        for (size_t i = 0; i < columns; i++) {
+            size_t oldwidth = rows[0]->cell(i)->width();
+            size_t newwidth = added.cell(i)->width();
 
             if (newwidth != oldwidth) {
                 if (newwidth > oldwidth) {
                     headerwidth += newwidth;
-                    col.format().width(newwidth);
+                    for (auto &row : rows) {
+                        row->cell(i)->format().width(newwidth);
+                    }
                 } else {
                     headerwidth += oldwidth;
-                    col[col.size() - 1].format().width(oldwidth);
+                    added.cell(i)->format().width(oldwidth);
                 }
             } else {
                 headerwidth += oldwidth;
@@ -2627,6 +2785,46 @@ class Table : public std::enable_shared_from_this<Table> {
         }
     }
 
+    /**
+     * Append rows from `first` on, rendered by `render(index, rendered)`. With an executor, blocks of rows are rendered
+     * into buffers of their own, the first one by the caller, then appended in order.
+     */
+    template <typename Render>
+    void __render(std::string &exported, size_t first, Render render) const
+    {
+        static constexpr size_t block = 256;
+        size_t count = rows.size() > first ? rows.size() - first : 0;
+        if (!executor || count < 2 * block) {
+            for (size_t i = first; i < rows.size(); i++) {
+                render(i, exported);
+            }
+            return;
+        }
+
+        std::vector<std::string> rendered((count + block - 1) / block);
+        auto render_block = [&](size_t b) {
+            std::string &out = rendered[b];
+            size_t begin = first + b * block, end = std::min(begin + block, rows.size());
+            for (size_t i = begin; i < end; i++) {
+                render(i, out);
+                if (i == begin) {
+                    out.reserve(out.size() * (end - begin) * 9 / 8); // rows of a table render to similar sizes
+                }
+            }
+        };
+
+        multiprocessing::parallel_for(executor, rendered.size(), render_block);
+
+        size_t size = exported.size();
+        for (auto const &out : rendered) {
+            size += out.size();
+        }
+        exported.reserve(size);
+        for (auto const &out : rendered) {
+            exported += out;
+        }
+    }
+
     size_t __width() const
     {
         size_t size = 0;
@@ -2646,6 +2844,548 @@ class Table : public std::enable_shared_from_this<Table> {
     }
 };
 
+/**
+ * Write all of `data` to `fd` unless it fails, returns whether it was written.
+ */
+static bool write_all(int fd, const char *data, size_t size)
+{
+    for (size_t written = 0; written < size;) {
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+/**
+ * Row by row counterpart of Table for outputs too long to be held in memory, such as millions of records: rows are
+ * rendered as they are added and written through a reusable buffer into a std::ostream or a file descriptor.
+ *
+ *     tabulate::TableStream stream(std::cout);
+ *     stream.widths({8, 24, 10});          // or measured on the first rows, see sample()
+ *     stream.column(2).align(Align::right);
+ *     stream.add("id", "name", "latency"); // the first row is the header, as for a Table
+ *     for (auto &record : records) {
+ *         stream.add(record.id, record.name, record.latency);
+ *     }
+ *     stream.finish();                     // bottom border, also done when destroyed
+ *
+ * Widths must be known before anything is written, columns without a fixed width get the widest content of the
+ * first sample() rows, which are held back until then, and later cells wider than their column are wrapped. Given the
+ * same widths, the output is the one of Table::xterm(), markdown() or latex(), ending with a newline.
+ */
+class TableStream {
+  public:
+    enum Output { XTERM, XTERM_NO_COLOR, MARKDOWN, LATEX };
+
+    explicit TableStream(std::ostream &out, Output output = XTERM, size_t buffer_size = 64 * 1024)
+        : m_out(&out), m_fd(-1), m_output(output), m_buffer_size(buffer_size)
+    {
+        m_buffer.reserve(buffer_size);
+    }
+
+    explicit TableStream(int fd, Output output = XTERM, size_t buffer_size = 64 * 1024)
+        : m_out(nullptr), m_fd(fd), m_output(output), m_buffer_size(buffer_size)
+    {
+        m_buffer.reserve(buffer_size);
+    }
+
+    TableStream(const TableStream &) = delete;
+    TableStream &operator=(const TableStream &) = delete;
+
+    ~TableStream()
+    {
+        finish();
+    }
+
+    /* fixed widths of the first columns, nothing is held back if all columns have one */
+    TableStream &widths(const std::vector<size_t> &widths)
+    {
+        for (size_t i = 0; i < widths.size(); i++) {
+            m_header[i].format().width(widths[i]);
+            m_body[i].format().width(widths[i]);
+        }
+        return *this;
+    }
+
+    /* number of rows, header included, measured for the columns without a fixed width */
+    TableStream &sample(size_t rows)
+    {
+        m_sample = std::max<size_t>(rows, 1);
+        return *this;
+    }
+
+    /* format of the header cell of a column */
+    Format &header(size_t index)
+    {
+        return m_header[index].format();
+    }
+
+    /* format of the other cells of a column */
+    Format &column(size_t index)
+    {
+        return m_body[index].format();
+    }
+
+    template <typename... Args>
+    TableStream &add(Args... args)
+    {
+        std::vector<std::string> row;
+        row.reserve(sizeof...(args));
+        (row.push_back(to_string(args)), ...);
+        return add_multiple(std::move(row));
+    }
+
+    TableStream &add_multiple(std::vector<std::string> row)
+    {
+        if (m_measuring) {
+            m_sampled.push_back(std::move(row));
+            if (m_sampled.size() >= m_sample || __fixed()) {
+                __layout();
+            }
+        } else {
+            __write(std::move(row));
+        }
+        return *this;
+    }
+
+    /* write what has been rendered so far, rows held back for widths or a bottom border stay */
+    void flush()
+    {
+        __drain();
+        if (m_out) {
+            m_out->flush();
+        }
+    }
+
+    /* write the rows held back and end the table, the next row added starts a new table with the same layout */
+    void finish()
+    {
+        if (m_measuring) {
+            __layout();
+        }
+        if (m_rows > 0) {
+            if (m_output == XTERM || m_output == XTERM_NO_COLOR) {
+                __render(m_pending, m_rows - 1, true);
+            } else if (m_output == LATEX) {
+                m_buffer += "\\hline" + NEWLINE;
+                m_buffer += "\\end{tabular}" + NEWLINE;
+                m_buffer += "\\end{table}" + NEWLINE;
+            }
+        }
+        m_rows = 0;
+        m_measuring = true;
+        flush();
+    }
+
+  private:
+    std::ostream *m_out;
+    int m_fd;
+    Output m_output;
+    size_t m_buffer_size;
+    std::string m_buffer;
+
+    // formats and, while rendering, contents of the header and of any other row
+    Row m_header, m_body;
+    size_t m_sample = 100;
+    bool m_measuring = true;
+    std::vector<std::vector<std::string>> m_sampled;
+
+    size_t m_rows = 0;                  // rows written or pending in this table
+    std::vector<std::string> m_pending; // xterm: last row, waiting to know if the bottom border is due
+
+    bool __fixed()
+    {
+        size_t columns = std::max(m_body.size(), m_sampled.empty() ? 0 : m_sampled.front().size());
+        for (size_t i = 0; i < columns; i++) {
+            if (m_body[i].format().width() == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void __layout()
+    {
+        size_t columns = 0;
+        for (auto const &row : m_sampled) {
+            columns = std::max(columns, row.size());
+        }
+        for (size_t i = 0; i < columns; i++) {
+            size_t width = m_body[i].format().width();
+            if (width == 0) {
+                for (auto const &row : m_sampled) {
+                    if (i < row.size()) {
+                        Cell cell(row[i]);
+                        width = std::max(width, cell.width());
+                    }
+                }
+                m_body[i].format().width(width);
+            }
+            if (m_header[i].format().width() == 0) {
+                m_header[i].format().width(width);
+            }
+        }
+
+        m_measuring = false;
+        for (auto &row : m_sampled) {
+            __write(std::move(row));
+        }
+        m_sampled.clear();
+    }
+
+    void __write(std::vector<std::string> row)
+    {
+        if (m_output == XTERM || m_output == XTERM_NO_COLOR) {
+            // the bottom border of a row is only drawn by the last one
+            if (m_rows > 0) {
+                __render(m_pending, m_rows - 1, false);
+            }
+            m_pending.swap(row);
+        } else {
+            __render(row, m_rows, false);
+        }
+        m_rows++;
+        if (m_buffer.size() >= m_buffer_size) {
+            __drain();
+        }
+    }
+
+    void __render(const std::vector<std::string> &contents, size_t index, bool last)
+    {
+        Row &row = index == 0 ? m_header : m_body;
+        if (row.size() < contents.size()) {
+            row[contents.size() - 1];
+        }
+        for (size_t i = 0; i < row.size(); i++) {
+            row[i].set(i < contents.size() ? contents[i] : std::string());
+        }
+
+        switch (m_output) {
+            case XTERM:
+            case XTERM_NO_COLOR: {
+                auto plain = [](const std::string &str, TrueColor, TrueColor, const Styles &) {
+                    return str;
+                };
+                auto lines = row.dump(m_output == XTERM ? StringFormatter(tabulate::xterm::stringformatter) : plain,
+                                      tabulate::xterm::borderformatter, tabulate::xterm::cornerformatter, true, last);
+                for (auto const &line : lines) {
+                    m_buffer += line;
+                    m_buffer += NEWLINE;
+                }
+                break;
+            }
+            case MARKDOWN:
+                m_buffer += tabulate::markdown::rowformatter(row) + NEWLINE;
+                if (index == 0) {
+                    m_buffer += tabulate::markdown::alignment(row) + NEWLINE;
+                }
+                break;
+            case LATEX:
+                if (index == 0) {
+                    m_buffer += "\\begin{table}[ht]" + NEWLINE;
+                    m_buffer += "\\begin{tabular}" + tabulate::latex::alignment(row) + NEWLINE;
+                    m_buffer += "\\hline\\hline" + NEWLINE;
+                }
+                m_buffer += tabulate::latex::rowformatter(row) + NEWLINE;
+                if (index == 0) {
+                    m_buffer += "\\hline" + NEWLINE;
+                }
+                break;
+        }
+    }
+
+    void __drain()
+    {
+        if (m_out) {
+            m_out->write(m_buffer.data(), m_buffer.size());
+        } else {
+            write_all(m_fd, m_buffer.data(), m_buffer.size()); // if nowhere to write, the rows are dropped
+        }
+        m_buffer.clear();
+    }
+};
+
+/**
+ * Redraw of a table in place on a terminal, for top like dashboards: the last frame drawn is kept and only the glyphs
+ * that changed are written, at their position through cursor movements, with a single write() per frame and at most
+ * `fps` frames a second. Over slow links this saves most of the bytes of full redraws, and the flicker.
+ *
+ *     tabulate::LiveTable live(STDOUT_FILENO, 10);
+ *     while (running) {
+ *         live.update(Collect());       // dropped unless a frame is due
+ *     }
+ *     live.update(Collect(), true);     // the final state, whatever the rate
+ *
+ * The first frame is drawn where the cursor is, and the cursor is left below each frame. Nothing else should be written
+ * to the terminal meanwhile, and lines are expected to fit in it, as wrapped lines would shift the next ones.
+ */
+class LiveTable {
+  public:
+    explicit LiveTable(int fd = STDOUT_FILENO, double fps = 10)
+        : m_fd(fd),
+          m_interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(fps > 0 ? 1 / fps : 0)))
+    {
+    }
+
+    /* whether the rate allows a frame now */
+    bool due() const
+    {
+        return m_height == npos || std::chrono::steady_clock::now() - m_last >= m_interval;
+    }
+
+    /* draw the table if a frame is due or if `force`, returns whether it was drawn */
+    bool update(const Table &table, bool force = false)
+    {
+        if (!force && !due()) {
+            return false;
+        }
+        __draw(table.xterm());
+        return true;
+    }
+
+    /* same for a frame rendered by the caller, such as Table::xterm() */
+    bool update(const std::string &frame, bool force = false)
+    {
+        if (!force && !due()) {
+            return false;
+        }
+        __draw(frame);
+        return true;
+    }
+
+    /* a literal frame, which would be ambiguous between the two above as Table converts from anything */
+    bool update(const char *frame, bool force = false)
+    {
+        return update(std::string(frame), force);
+    }
+
+    /* forget the last frame, the next one is drawn in full where the cursor is */
+    void reset()
+    {
+        m_height = npos;
+        m_lines.clear();
+    }
+
+    /* bytes written to the terminal so far */
+    size_t written() const
+    {
+        return m_written;
+    }
+
+  private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // a character and its combining marks, as offsets in the frame because views would not survive its move
+    struct Glyph {
+        uint32_t offset;
+        uint16_t size;
+        uint8_t width;
+        uint32_t column;
+        uint32_t style; // index in m_styles of the SGR sequences in effect
+    };
+
+    struct Line {
+        std::string text;
+        std::vector<Glyph> glyphs;
+        size_t width = 0;
+    };
+
+    int m_fd;
+    std::chrono::steady_clock::duration m_interval;
+    std::chrono::steady_clock::time_point m_last;
+    size_t m_written = 0;
+
+    size_t m_height = npos; // lines of the last frame, npos if there is none
+    std::vector<Line> m_lines;
+    std::vector<std::string> m_styles{""};
+    std::map<std::string, uint32_t> m_style_ids{{"", 0}};
+
+    uint32_t __style(const std::string &sgr)
+    {
+        auto it = m_style_ids.find(sgr);
+        if (it != m_style_ids.end()) {
+            return it->second;
+        }
+        m_styles.push_back(sgr);
+        return m_style_ids[sgr] = static_cast<uint32_t>(m_styles.size() - 1);
+    }
+
+    Line __parse(std::string text)
+    {
+        Line line;
+        line.text = std::move(text);
+        const std::string &s = line.text;
+        std::string sgr;
+        uint32_t style = 0;
+        for (size_t i = 0, size = s.size(); i < size;) {
+            unsigned char ch = s[i];
+            if (ch == '\x1b') {
+                size_t end = skip_escape(s, i);
+                if (s[end - 1] == 'm' && end - i > 2) {
+                    std::string seq = s.substr(i, end - i);
+                    if (seq == "\033[m" || seq == "\033[0m" || seq == "\033[00m") {
+                        sgr.clear();
+                    } else {
+                        sgr += seq;
+                    }
+                    style = __style(sgr);
+                }
+                i = end;
+                continue;
+            }
+
+            size_t length = 1;
+            int width = 1;
+            if (ch >= 0xC0) {
+                size_t expected = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : 2;
+                uint32_t ucs = expected == 4 ? ch & 0x07 : expected == 3 ? ch & 0x0F : ch & 0x1F;
+                size_t k = 1;
+                for (; k < expected && i + k < size && (s[i + k] & 0xC0) == 0x80; k++) {
+                    ucs = (ucs << 6) | (s[i + k] & 0x3F);
+                }
+                if (k == expected) {
+                    length = expected;
+                    width = code_point_width(ucs);
+                }
+            }
+            if (width == 0 && !line.glyphs.empty() && line.glyphs.back().offset + line.glyphs.back().size == i) {
+                line.glyphs.back().size += static_cast<uint16_t>(length); // combining mark
+            } else {
+                line.glyphs.push_back({static_cast<uint32_t>(i), static_cast<uint16_t>(length),
+                                       static_cast<uint8_t>(width), static_cast<uint32_t>(line.width), style});
+                line.width += width;
+            }
+            i += length;
+        }
+        return line;
+    }
+
+    /* cursor from line `row` to line `to`, below the lines on the screen a newline scrolls where moving down would not */
+    void __move(std::string &out, size_t &row, size_t to, size_t screen)
+    {
+        if (to < row) {
+            out += "\033[" + std::to_string(row - to) + "A";
+        } else if (to > row) {
+            size_t within = std::min(to, screen);
+            if (within > row) {
+                out += "\033[" + std::to_string(within - row) + "B";
+            }
+            for (size_t i = std::max(row, within); i < to; i++) {
+                out += "\n";
+            }
+        }
+        row = to;
+    }
+
+    /* changes turning `old` into `line` on the screen, the cursor being somewhere on the line */
+    void __patch(std::string &out, const Line &old, const Line &line)
+    {
+        auto same = [&](size_t i) {
+            if (i >= old.glyphs.size() || i >= line.glyphs.size()) {
+                return false;
+            }
+            const Glyph &a = old.glyphs[i], &b = line.glyphs[i];
+            return a.column == b.column && a.style == b.style && a.size == b.size
+                   && old.text.compare(a.offset, a.size, line.text, b.offset, b.size) == 0;
+        };
+
+        std::string patch;
+        uint32_t style = 0;
+        for (size_t i = 0, n = line.glyphs.size(); i < n;) {
+            if (same(i)) {
+                i++;
+                continue;
+            }
+            // a run of changes, short runs of unchanged glyphs between changes cost less than a cursor movement
+            size_t end = i + 1, equal = 0;
+            for (size_t j = end; j < n && equal < 6; j++) {
+                if (same(j)) {
+                    equal++;
+                } else {
+                    end = j + 1, equal = 0;
+                }
+            }
+            patch += "\033[" + std::to_string(line.glyphs[i].column + 1) + "G";
+            for (; i < end; i++) {
+                const Glyph &glyph = line.glyphs[i];
+                if (glyph.style != style) {
+                    patch += "\033[00m" + m_styles[glyph.style];
+                    style = glyph.style;
+                }
+                patch.append(line.text, glyph.offset, glyph.size);
+            }
+        }
+        if (style != 0) {
+            patch += "\033[00m";
+        }
+        if (line.width < old.width) {
+            patch += "\033[" + std::to_string(line.width + 1) + "G\033[K";
+        }
+
+        // rewriting the whole line may be shorter
+        if (patch.size() > line.text.size() + 12) {
+            out += "\r" + line.text + "\033[00m\033[K";
+        } else {
+            out += patch;
+        }
+    }
+
+    void __draw(const std::string &frame)
+    {
+        if (m_styles.size() > 4096) { // styles of truecolor gradients, start over rather than grow
+            m_styles.resize(1);
+            m_style_ids = {{"", 0}};
+            for (auto &line : m_lines) {
+                line.glyphs.clear(); // compares as different from anything, the frame is rewritten
+            }
+        }
+
+        std::vector<Line> lines;
+        for (size_t pos = 0; pos <= frame.size();) {
+            size_t end = std::min(frame.find('\n', pos), frame.size());
+            lines.push_back(__parse(frame.substr(pos, end - pos)));
+            pos = end + 1;
+        }
+
+        std::string out = "\033[?25l"; // hide the cursor while it moves
+        if (m_height == npos) {
+            out += frame + "\033[00m\n";
+        } else {
+            // the cursor is at the beginning of the line below the last frame
+            size_t row = m_height;
+            Line unknown;
+            unknown.width = npos; // lines below the last frame, cleared once written
+            for (size_t i = 0; i < lines.size(); i++) {
+                const Line &old = i < m_lines.size() ? m_lines[i] : unknown;
+                std::string patch;
+                __patch(patch, old, lines[i]);
+                if (!patch.empty()) {
+                    __move(out, row, i, m_height);
+                    out += patch;
+                }
+            }
+            __move(out, row, lines.size(), m_height);
+            out += "\r";
+            if (lines.size() < m_height) {
+                out += "\033[J";
+            }
+        }
+        out += "\033[?25h";
+
+        write_all(m_fd, out.data(), out.size());
+        m_written += out.size();
+        m_last = std::chrono::steady_clock::now();
+        m_height = lines.size();
+        m_lines = std::move(lines);
+    }
+};
+
 template <>
 inline std::string to_string<Row>(const Row &v)
 {
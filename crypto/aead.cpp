@@ -1,11 +1,25 @@
 #include <string>
+#include <atomic>
+#include <algorithm>
 #include <stdio.h>
-#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
 #include "aead.h"
 
+#if defined(LEMON_ASYNC_TRACE)
+#include "../misc/logger.h"
+#define AEAD_TRACE(...) LOGGER_ERROR(__VA_ARGS__)
+#else
 #define AEAD_TRACE(...) printf("%s:%d ", __FILE__, __LINE__), printf(__VA_ARGS__), printf("\n")
+#endif
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 #define EVP_CIPHER_CTX_encrypting(ctx) ((ctx)->encrypt)
@@ -162,7 +176,35 @@ int AEAD_WITH_EVP::crypt(const std::string &aad, const std::string &input, std::
         /* fallthough to verify gcm tag if outsz == 0 */
     }
     output.resize(outsz);
-    unsigned char *out = (unsigned char *)output.c_str();
+
+    return crypt(aad, input, output.data(), nullptr, taglen);
+}
+
+int AEAD_WITH_EVP::crypt(const struct iovec *aad, size_t aadcnt, const struct iovec *input, size_t incnt,
+                         void *output, void *tag, size_t taglen)
+{
+    if (m_context == nullptr) {
+        AEAD_TRACE("Unintialized context");
+        return -EINVAL;
+    }
+    if (taglen == 0 || taglen > EVP_GCM_TLS_TAG_LEN) {
+        AEAD_TRACE("Invalid tag length %zu", taglen);
+        return -EINVAL;
+    }
+    bool encrypting = EVP_CIPHER_CTX_encrypting(m_context);
+
+    size_t inlen = 0;
+    for (size_t i = 0; i < incnt; i++) {
+        inlen += input[i].iov_len;
+    }
+    if (!encrypting && tag == nullptr) {
+        if (inlen < taglen) {
+            AEAD_TRACE("Invalid size of input, maybe no tag included");
+            return -EINVAL;
+        }
+        inlen -= taglen;
+        /* fallthough to verify gcm tag if inlen == 0 */
+    }
 
     if (m_dirty) {
         /* Reset the context(key/iv and mode not changed) */
@@ -170,35 +212,53 @@ int AEAD_WITH_EVP::crypt(const std::string &aad, const std::string &input, std::
             AEAD_TRACE("Failed to initialise key and IV");
             return -EINVAL; // static_cast<int>(ERR_get_error());
         }
-        // AEAD_TRACE("Succeed to reset the context(key/iv and mode not changed)");
     }
     m_dirty = true;
 
     /* Provide any AAD data. */
     int outl = 0;
-    if (aad.size() && !EVP_CipherUpdate(m_context, NULL, &outl, (const unsigned char *)aad.data(), aad.size())) {
-        AEAD_TRACE("Failed to intialize additional application data");
-        return -EINVAL; // static_cast<int>(ERR_get_error());
+    for (size_t i = 0; i < aadcnt; i++) {
+        const unsigned char *in = (const unsigned char *)aad[i].iov_base;
+        for (size_t left = aad[i].iov_len, len; left > 0; in += len, left -= len) {
+            len = std::min<size_t>(left, INT_MAX);
+            if (!EVP_CipherUpdate(m_context, NULL, &outl, in, len)) {
+                AEAD_TRACE("Failed to intialize additional application data");
+                return -EINVAL; // static_cast<int>(ERR_get_error());
+            }
+        }
     }
-    size_t inlen = input.size() - (!EVP_CIPHER_CTX_encrypting(m_context) ? taglen : 0);
 
-    /* Provide the message to be crypted, and obtain the crypted output. */
-    if (inlen) {
-        assert(outsz < INT_MAX);
-        outl = outsz;
-        if (!EVP_CipherUpdate(m_context, out, &outl, (const unsigned char *)input.data(), inlen)) {
-            AEAD_TRACE("Failed to obtain the crypted output");
-            return -EINVAL; // static_cast<int>(ERR_get_error());
+    /**
+     * Provide the message to be crypted piece by piece, and obtain the crypted output. GCM is a stream mode, as many
+     * bytes are written as read, so in-place cryption never overwrites input not yet read.
+     */
+    unsigned char *out = (unsigned char *)output;
+    unsigned char appended[EVP_GCM_TLS_TAG_LEN];
+    size_t gathered = 0, remaining = inlen;
+    for (size_t i = 0; i < incnt; i++) {
+        const unsigned char *in = (const unsigned char *)input[i].iov_base;
+        size_t piece = std::min(input[i].iov_len, remaining);
+        for (size_t left = piece, len; left > 0; in += len, left -= len) {
+            len = std::min<size_t>(left, INT_MAX);
+            outl = len;
+            if (!EVP_CipherUpdate(m_context, out, &outl, in, len)) {
+                AEAD_TRACE("Failed to obtain the crypted output");
+                return -EINVAL; // static_cast<int>(ERR_get_error());
+            }
+            out += outl;
+        }
+        remaining -= piece;
+        if (piece < input[i].iov_len) {
+            /* the rest is the tag, which may span pieces too */
+            memcpy(appended + gathered, in, input[i].iov_len - piece);
+            gathered += input[i].iov_len - piece;
         }
-        assert(outsz >= outl);
-        out += outl, outsz -= outl;
     }
 
-    if (!EVP_CIPHER_CTX_encrypting(m_context)) {
+    if (!encrypting) {
         /* Set the tag */
-        if (!EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_SET_TAG, taglen,
-                                 (void *)((unsigned char *)input.data() + inlen))) {
-            AEAD_TRACE("Failed to get the tag");
+        if (!EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_SET_TAG, taglen, tag ? tag : appended)) {
+            AEAD_TRACE("Failed to set the tag");
             return -EINVAL; // static_cast<int>(ERR_get_error());
         }
     }
@@ -207,23 +267,403 @@ int AEAD_WITH_EVP::crypt(const std::string &aad, const std::string &input, std::
      * Finalise the cryption. Normally output bytes may be written at this stage,
      * but this does not occur in GCM mode
      */
-    outl = outsz;
     if (!EVP_CipherFinal_ex(m_context, out, &outl)) {
         AEAD_TRACE("Failed to finalise the cryption");
         return -EINVAL; // static_cast<int>(ERR_get_error());
     }
-    assert(outsz >= outl);
-    out += outl, outsz -= outl;
+    out += outl;
 
-    if (EVP_CIPHER_CTX_encrypting(m_context)) {
+    if (encrypting) {
         /* Get the tag */
-        if (!EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_GET_TAG, taglen, out)) {
+        if (!EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_GET_TAG, taglen, tag ? tag : out)) {
             AEAD_TRACE("Failed to get the tag");
             return -EINVAL; // static_cast<int>(ERR_get_error());
         }
-        assert(outsz >= taglen);
-        out += taglen, outsz -= taglen;
     }
 
     return 0;
 }
+
+int AEAD_WITH_EVP::set_iv(std::string_view iv)
+{
+    if (m_context == nullptr) {
+        AEAD_TRACE("Unintialized context");
+        return -EINVAL;
+    }
+    if (iv.size() != m_iv.size()) {
+        if (!EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_SET_IVLEN, iv.size(), NULL)) {
+            AEAD_TRACE("Failed to set IV length");
+            return -EINVAL; // static_cast<int>(ERR_get_error());
+        }
+    }
+    m_iv.assign(iv.data(), iv.size());
+    m_dirty = true; /* the next cryption initialises the new IV */
+
+    return 0;
+}
+
+AEAD_WITH_EVP *AEAD_WITH_EVP::pooled(int mode, const std::string &key, std::string_view iv)
+{
+    struct Pooled {
+        int mode;
+        std::string key;
+        uint64_t used;
+        AEAD_WITH_EVP context; // cleansed by EVP_CIPHER_CTX_free()
+
+        ~Pooled()
+        {
+            OPENSSL_cleanse(key.data(), key.size());
+        }
+    };
+    static constexpr size_t capacity = 8;
+    thread_local std::vector<std::unique_ptr<Pooled>> pool;
+    thread_local uint64_t clock = 0;
+
+    Pooled *found = nullptr;
+    for (auto &pooled : pool) {
+        if (pooled->mode == mode && pooled->key.size() == key.size()
+            && CRYPTO_memcmp(pooled->key.data(), key.data(), key.size()) == 0) {
+            found = pooled.get();
+            break;
+        }
+    }
+    if (found == nullptr) {
+        auto evicted = pool.size() < capacity ? pool.insert(pool.end(), nullptr)
+                                              : std::min_element(pool.begin(), pool.end(), [](auto &a, auto &b) {
+                                                    return a->used < b->used;
+                                                });
+        evicted->reset(new Pooled{mode, key, 0, AEAD_WITH_EVP(select_default(key.size()))});
+        found = evicted->get();
+        if (found->context.reset(mode, key, std::string(iv)) != 0) {
+            pool.erase(evicted);
+            return nullptr;
+        }
+    } else if (found->context.set_iv(iv) != 0) {
+        return nullptr;
+    }
+    found->used = ++clock;
+
+    return &found->context;
+}
+
+void AEAD_BATCH::nonce(std::string_view iv, uint64_t counter, std::string &nonce)
+{
+    nonce.assign(iv.data(), iv.size());
+    for (size_t i = 0; i < 8 && i < nonce.size(); i++) {
+        nonce[nonce.size() - 1 - i] ^= static_cast<char>(counter >> (8 * i));
+    }
+}
+
+int AEAD_BATCH::crypt(Record *records, size_t count, uint64_t counter, std::string &nonce) const
+{
+    int status = 0;
+    AEAD_BATCH::nonce(m_iv, counter, nonce);
+    AEAD_WITH_EVP *context = AEAD_WITH_EVP::pooled(m_mode, m_key, nonce);
+    for (size_t i = 0; i < count; i++) {
+        Record &record = records[i];
+        if (context == nullptr) {
+            record.status = -EINVAL;
+        } else {
+            if (i != 0) {
+                AEAD_BATCH::nonce(m_iv, counter + i, nonce);
+                context->set_iv(nonce);
+            }
+            record.status = context->crypt(record.aad, record.aadcnt, record.input, record.incnt, record.output,
+                                           record.tag, m_taglen);
+        }
+        status = status ? status : record.status;
+    }
+    return status;
+}
+
+int AEAD_BATCH::crypt(Record *records, size_t count, uint64_t counter)
+{
+    if (m_iv.size() < 8) {
+        AEAD_TRACE("Invalid size of IV to derive nonces from, %zu", m_iv.size());
+        return -EINVAL;
+    }
+    thread_local std::string nonce;
+    if (!m_executor || count < 2 * m_block) {
+        return crypt(records, count, counter, nonce);
+    }
+
+    std::atomic<int> status{0};
+    multiprocessing::parallel_for(m_executor, (count + m_block - 1) / m_block, [&](size_t b) {
+        thread_local std::string nonce;
+        size_t begin = b * m_block, end = std::min(begin + m_block, count);
+        if (int err = crypt(records + begin, end - begin, counter + begin, nonce); err != 0) {
+            int none = 0;
+            status.compare_exchange_strong(none, err);
+        }
+    });
+    return status;
+}
+
+int AEAD_STREAM::Writer::write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -errno;
+        }
+        data += n, size -= n;
+    }
+    return 0;
+}
+
+ssize_t AEAD_STREAM::opened_size(size_t size) const
+{
+    size_t n = chunks(size);
+    if (size < TAGLEN || size - TAGLEN - (n - 1) * (m_chunk + TAGLEN) > m_chunk) {
+        return -EBADMSG;
+    }
+    return size - n * TAGLEN;
+}
+
+int AEAD_STREAM::crypt(uint64_t index, bool last, const void *input, size_t inlen, void *output) const
+{
+    if (m_iv.size() < 5 || index > UINT32_MAX) {
+        AEAD_TRACE("Invalid size of IV(size=%zu) or chunk index %llu", m_iv.size(), (unsigned long long)index);
+        return -EINVAL;
+    }
+    char nonce[EVP_MAX_IV_LENGTH];
+    size_t ivlen = std::min(m_iv.size(), sizeof(nonce));
+    memcpy(nonce, m_iv.data(), ivlen);
+    for (size_t i = 0; i < 4; i++) {
+        nonce[ivlen - 2 - i] ^= static_cast<char>(index >> (8 * i));
+    }
+    nonce[ivlen - 1] ^= last ? 1 : 0;
+
+    AEAD_WITH_EVP *context = AEAD_WITH_EVP::pooled(m_mode, m_key, std::string_view(nonce, ivlen));
+    if (context == nullptr) {
+        return -EINVAL;
+    }
+    struct iovec aad = {const_cast<char *>(m_aad.data()), m_aad.size()};
+    struct iovec in = {const_cast<void *>(input), inlen};
+    return context->crypt(&aad, 1, &in, 1, output, nullptr, TAGLEN);
+}
+
+ssize_t AEAD_STREAM::open_chunk(const void *sealed, size_t size, uint64_t index, void *output) const
+{
+    size_t n = chunks(size);
+    if (opened_size(size) < 0 || index >= n) {
+        return -EINVAL;
+    }
+    size_t offset = index * (m_chunk + TAGLEN);
+    size_t length = index + 1 < n ? m_chunk + TAGLEN : size - offset;
+    if (crypt(index, index + 1 == n, (const char *)sealed + offset, length, output) != 0) {
+        return -EBADMSG;
+    }
+    return length - TAGLEN;
+}
+
+ssize_t AEAD_STREAM::pread_chunk(int fd, uint64_t index, void *output) const
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -errno;
+    }
+    size_t size = st.st_size, n = chunks(size);
+    if (opened_size(size) < 0 || index >= n) {
+        return -EINVAL;
+    }
+    size_t offset = index * (m_chunk + TAGLEN);
+    size_t length = index + 1 < n ? m_chunk + TAGLEN : size - offset;
+    for (size_t done = 0; done < length;) {
+        ssize_t got = pread(fd, (char *)output + done, length - done, offset + done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return got < 0 ? -errno : -EBADMSG;
+        }
+        done += got;
+    }
+    if (crypt(index, index + 1 == n, output, length, output) != 0) {
+        return -EBADMSG;
+    }
+    return length - TAGLEN;
+}
+
+AEAD_STREAM::Writer::Writer(const AEAD_STREAM &stream, int fd)
+    : m_stream(stream), m_fd(fd), m_index(0), m_finished(false), m_filled(0), m_plaintext(stream.chunk()),
+      m_sealed(stream.chunk() + TAGLEN)
+{
+}
+
+int AEAD_STREAM::Writer::flush(const void *data, size_t size, bool last)
+{
+    if (int err = m_stream.crypt(m_index, last, data, size, m_sealed.data()); err != 0) {
+        return err;
+    }
+    m_index++;
+    return write_all(m_fd, m_sealed.data(), size + TAGLEN);
+}
+
+ssize_t AEAD_STREAM::Writer::write(const void *data, size_t size)
+{
+    if (m_finished) {
+        return -EPIPE;
+    }
+    const char *from = (const char *)data;
+    for (size_t left = size; left > 0;) {
+        /* a full chunk is sealed once more follows, the last one is only known by finish() */
+        if (m_filled == m_plaintext.size()) {
+            if (int err = flush(m_plaintext.data(), m_filled, false); err != 0) {
+                return err;
+            }
+            m_filled = 0;
+        }
+        if (m_filled == 0 && left > m_plaintext.size()) {
+            if (int err = flush(from, m_plaintext.size(), false); err != 0) {
+                return err;
+            }
+            from += m_plaintext.size(), left -= m_plaintext.size();
+            continue;
+        }
+        size_t len = std::min(left, m_plaintext.size() - m_filled);
+        memcpy(m_plaintext.data() + m_filled, from, len);
+        m_filled += len, from += len, left -= len;
+    }
+    return size;
+}
+
+ssize_t AEAD_STREAM::Writer::write_mapped(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -errno;
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return -errno;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    ssize_t written = write(data, st.st_size);
+    munmap(data, st.st_size);
+    return written;
+}
+
+int AEAD_STREAM::Writer::finish()
+{
+    if (m_finished) {
+        return 0;
+    }
+    m_finished = true;
+    return flush(m_plaintext.data(), m_filled, true);
+}
+
+AEAD_STREAM::Reader::Reader(const AEAD_STREAM &stream, int fd)
+    : m_stream(stream), m_fd(fd), m_index(0), m_done(false), m_error(0), m_pending(0), m_offset(0), m_available(0),
+      m_sealed(stream.chunk() + TAGLEN + 1)
+{
+}
+
+int AEAD_STREAM::Reader::next()
+{
+    size_t full = m_sealed.size() - 1;
+    while (m_pending < m_sealed.size()) {
+        ssize_t n = ::read(m_fd, m_sealed.data() + m_pending, m_sealed.size() - m_pending);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -errno;
+        }
+        if (n == 0) {
+            break;
+        }
+        m_pending += n;
+    }
+
+    bool last = m_pending <= full;
+    size_t length = last ? m_pending : full;
+    if (length < TAGLEN || m_stream.crypt(m_index, last, m_sealed.data(), length, m_sealed.data()) != 0) {
+        return -EBADMSG;
+    }
+    m_index++;
+    m_offset = 0, m_available = length - TAGLEN;
+    m_done = last;
+    m_pending = last ? 0 : 1; // the byte read ahead, moved once the chunk is consumed
+    return 0;
+}
+
+ssize_t AEAD_STREAM::Reader::read(void *data, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        if (m_offset == m_available) {
+            if (m_done) {
+                break;
+            }
+            if (m_pending) {
+                m_sealed[0] = m_sealed.back();
+            }
+            if (m_error == 0) {
+                m_error = next();
+            }
+            if (m_error != 0) {
+                return done ? static_cast<ssize_t>(done) : m_error;
+            }
+            continue;
+        }
+        size_t len = std::min(size - done, m_available - m_offset);
+        memcpy((char *)data + done, m_sealed.data() + m_offset, len);
+        m_offset += len, done += len;
+    }
+    return done;
+}
+
+AEAD_STREAM::Mapped::Mapped(const AEAD_STREAM &stream, const std::string &path)
+    : m_stream(stream), m_error(0), m_data(nullptr), m_length(0), m_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        m_error = -errno;
+    } else if (ssize_t size = stream.opened_size(st.st_size); size < 0) {
+        m_error = size;
+    } else if ((m_data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        m_error = -errno, m_data = nullptr;
+    } else {
+        m_length = st.st_size, m_size = size;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+AEAD_STREAM::Mapped::~Mapped()
+{
+    if (m_data) {
+        munmap(m_data, m_length);
+    }
+}
+
+ssize_t AEAD_STREAM::Mapped::pread(void *data, size_t size, size_t offset) const
+{
+    if (m_error) {
+        return m_error;
+    }
+    thread_local std::vector<char> chunk;
+    chunk.resize(m_stream.chunk());
+    size_t done = 0;
+    while (done < size && offset + done < m_size) {
+        uint64_t index = (offset + done) / m_stream.chunk();
+        size_t skip = (offset + done) % m_stream.chunk();
+        ssize_t got = read_chunk(index, chunk.data());
+        if (got < 0) {
+            return got;
+        }
+        size_t len = std::min(size - done, static_cast<size_t>(got) - skip);
+        memcpy((char *)data + done, chunk.data() + skip, len);
+        done += len;
+    }
+    return done;
+}
@@ -1,7 +1,17 @@
 #pragma once
 
+#include <errno.h>
 #include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <string_view>
+#include <sys/uio.h>
+#include <sys/types.h>
 #include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include "../misc/parallel.h"
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 #define EVP_CIPHER_CTX_encrypting(ctx) ((ctx)->encrypt)
@@ -37,6 +47,14 @@ class AEAD_WITH_EVP {
     enum { AUTO = -1, ENCRYPT = 0, DECRYPT = 1 };
     int reset(int mode, const std::string &key, const std::string &iv);
 
+    /**
+     * @brief change the iv only, the key schedule is kept
+     *
+     * @param iv initial vector of the next cryption
+     * @return int 0 if success; error occurred otherwise
+     */
+    int set_iv(std::string_view iv);
+
     /**
      * @brief stateless cryption
      *
@@ -49,6 +67,32 @@ class AEAD_WITH_EVP {
     int crypt(const std::string &aad, const std::string &input, std::string &output,
               size_t taglen = EVP_GCM_TLS_TAG_LEN);
 
+    /**
+     * @brief stateless cryption into a caller buffer, without copies nor allocations
+     *
+     * Both aad and input are gathered from pieces, e.g. the header and the payload of a framed message, as if they
+     * were concatenated. Output may be the input itself for in-place cryption, provided that the pieces of input are
+     * laid out one after another at output.
+     *
+     * @param aad, aadcnt pieces of application additional data
+     * @param input, incnt pieces of |plaintext| for encryption; |ciphertext| (+ |tag| if appended) for decryption
+     * @param output |ciphertext| (+ |tag| if appended) for encryption; |plaintext| for decryption
+     * @param tag separate tag, written by encryption and verified by decryption; appended to output, or expected
+     *            at the end of input, if null
+     * @param taglen tag length for gcm
+     * @return int 0 if success; error occurred otherwise
+     */
+    int crypt(const struct iovec *aad, size_t aadcnt, const struct iovec *input, size_t incnt, void *output,
+              void *tag = nullptr, size_t taglen = EVP_GCM_TLS_TAG_LEN);
+
+    inline int crypt(std::string_view aad, std::string_view input, void *output, void *tag = nullptr,
+                     size_t taglen = EVP_GCM_TLS_TAG_LEN)
+    {
+        struct iovec aadv = {const_cast<char *>(aad.data()), aad.size()};
+        struct iovec inputv = {const_cast<char *>(input.data()), input.size()};
+        return crypt(&aadv, 1, &inputv, 1, output, tag, taglen);
+    }
+
     static inline int encrypt(const std::string &key, const std::string &iv, const std::string &aad,
                               const std::string &input, std::string &output)
     {
@@ -63,6 +107,18 @@ class AEAD_WITH_EVP {
         return context.crypt(aad, input, output);
     }
 
+    /**
+     * @brief context of the calling thread for the given mode and key, set to iv
+     *
+     * A few contexts are kept per thread, the least recently used is reinitialized when none matches, so that
+     * cryptions with the same keys only pay for the key schedule once. The keys, and their schedules, stay in the
+     * memory of the thread until evicted or the thread exits, they are cleansed then. Only batches and streams use
+     * the pool, one-shot cryptions by encrypt() and decrypt() do not.
+     *
+     * @return AEAD_WITH_EVP* the context, valid until the next call by the thread; nullptr if failed
+     */
+    static AEAD_WITH_EVP *pooled(int mode, const std::string &key, std::string_view iv);
+
     /**
      * @brief select default method
      *
@@ -91,3 +147,242 @@ class AEAD_WITH_EVP {
     EVP_CIPHER_CTX m_legacy_context;
 #endif
 };
+
+/**
+ * Seal or open batches of records with one key, record i of a batch using the nonce derived from `counter + i`,
+ * as TLS does: the big-endian counter XORed into the last 8 bytes of the base iv.
+ *
+ *     AEAD_BATCH sealer(AEAD_WITH_EVP::ENCRYPT, key, iv);
+ *     sealer.set_thread_pool(&pool);
+ *     sealer.crypt(records.data(), records.size(), sequence), sequence += records.size();
+ *
+ * Records are crypted with the pooled contexts of the threads, large batches are fanned out in blocks on the
+ * thread pool if any.
+ */
+class AEAD_BATCH {
+  public:
+    struct Record {
+        const struct iovec *aad = nullptr;
+        size_t aadcnt = 0;
+        const struct iovec *input = nullptr;
+        size_t incnt = 0;
+        void *output = nullptr; // see AEAD_WITH_EVP::crypt()
+        void *tag = nullptr;    // separate tag, appended if null
+        int status = 0;         // of the last cryption
+    };
+
+    AEAD_BATCH(int mode, const std::string &key, const std::string &iv, size_t taglen = EVP_GCM_TLS_TAG_LEN)
+        : m_mode(mode), m_key(key), m_iv(iv), m_taglen(taglen)
+    {
+    }
+
+    ~AEAD_BATCH()
+    {
+        OPENSSL_cleanse(m_key.data(), m_key.size());
+    }
+
+    /**
+     * Crypt blocks of records of large batches on `pool`, anything with push(std::function<void()>) such as
+     * multiprocessing::threadpool, NULL to crypt them all on the calling thread. The pool must outlive the batches.
+     */
+    template <typename Pool>
+    void set_thread_pool(Pool *pool, size_t block = 1024)
+    {
+        m_block = block;
+        m_executor = multiprocessing::executor_of(pool);
+    }
+
+    /**
+     * @brief crypt `count` records, with nonces from `counter` on
+     *
+     * @return int 0 if all succeeded; the status of a record failed otherwise, see the records for which
+     */
+    int crypt(Record *records, size_t count, uint64_t counter);
+
+    /**
+     * @brief nonce for a counter, the base iv must be of 8 bytes at least
+     */
+    static void nonce(std::string_view iv, uint64_t counter, std::string &nonce);
+
+  private:
+    int crypt(Record *records, size_t count, uint64_t counter, std::string &nonce) const;
+
+    int m_mode;
+    std::string m_key, m_iv;
+    size_t m_taglen;
+    size_t m_block = 1024;
+    multiprocessing::executor m_executor;
+};
+
+/**
+ * Segmented cryption of streams too large to be held in memory, the STREAM construction of online authenticated
+ * encryption: the plaintext is cut into chunks of a fixed size, each sealed on its own with its tag appended and a
+ * nonce made of the base iv XORed with the big-endian chunk index and a final chunk flag in its last 5 bytes. The
+ * flag makes truncation at a chunk boundary detected, the index makes reordering detected.
+ *
+ * A sealed stream of n chunks is laid out as n - 1 chunks of `chunk() + TAGLEN` bytes and a last one of 1 to
+ * `chunk() + TAGLEN` bytes, or `TAGLEN` bytes for an empty stream, so that chunks are opened in any order with
+ * open_chunk() or pread_chunk(). Chunks are crypted with the pooled contexts of the calling threads, a stream may be
+ * used from several threads.
+ *
+ *     AEAD_STREAM stream(AEAD_WITH_EVP::ENCRYPT, key, iv);
+ *     AEAD_STREAM::Writer writer(stream, fd);
+ *     writer.write(data, size), ..., writer.finish();
+ */
+class AEAD_STREAM {
+  public:
+    static constexpr size_t TAGLEN = EVP_GCM_TLS_TAG_LEN;
+
+    AEAD_STREAM(int mode, const std::string &key, const std::string &iv, size_t chunk = 64 * 1024,
+                const std::string &aad = "")
+        : m_mode(mode), m_key(key), m_iv(iv), m_aad(aad), m_chunk(chunk)
+    {
+    }
+
+    ~AEAD_STREAM()
+    {
+        OPENSSL_cleanse(m_key.data(), m_key.size());
+    }
+
+    size_t chunk() const
+    {
+        return m_chunk;
+    }
+
+    /* size of the sealed stream of `size` plaintext bytes */
+    size_t sealed_size(size_t size) const
+    {
+        size_t chunks = size == 0 ? 1 : (size + m_chunk - 1) / m_chunk;
+        return size + chunks * TAGLEN;
+    }
+
+    /* size of the plaintext of a sealed stream of `size` bytes, -EBADMSG if no stream is of this size */
+    ssize_t opened_size(size_t size) const;
+
+    /* number of chunks of a sealed stream of `size` bytes */
+    size_t chunks(size_t size) const
+    {
+        return size <= TAGLEN ? 1 : (size - TAGLEN + m_chunk + TAGLEN - 1) / (m_chunk + TAGLEN);
+    }
+
+    /**
+     * @brief crypt chunk `index` of a stream
+     *
+     * @param last whether it is the last chunk of the stream
+     * @param input |plaintext| for encryption, at most chunk() bytes; |ciphertext| + |tag| for decryption
+     * @param output |ciphertext| + |tag| for encryption; |plaintext| for decryption, may be input
+     * @return int 0 if success; error occurred otherwise
+     */
+    int crypt(uint64_t index, bool last, const void *input, size_t inlen, void *output) const;
+
+    /**
+     * @brief open chunk `index` of a whole sealed stream in memory, e.g. mapped
+     *
+     * @param output chunk() bytes at least
+     * @return ssize_t size of the plaintext of the chunk if success; -errno otherwise
+     */
+    ssize_t open_chunk(const void *sealed, size_t size, uint64_t index, void *output) const;
+
+    /**
+     * @brief open chunk `index` of the sealed stream of regular file `fd`
+     *
+     * @param output chunk() + TAGLEN bytes at least, the sealed chunk is read then opened in place
+     * @return ssize_t size of the plaintext of the chunk if success; -errno otherwise
+     */
+    ssize_t pread_chunk(int fd, uint64_t index, void *output) const;
+
+    /**
+     * Seals what is written to a file, a pipe or a socket with constant memory, a chunk being only sealed once
+     * the next one starts or finish() is called. Large writes are sealed from the memory of the caller.
+     */
+    class Writer {
+      public:
+        Writer(const AEAD_STREAM &stream, int fd);
+
+        /* returns size if success; -errno otherwise */
+        ssize_t write(const void *data, size_t size);
+
+        /* seal the content of regular file `fd` mapped in memory, returns its size if success; -errno otherwise */
+        ssize_t write_mapped(int fd);
+
+        /* seal the last chunk, the stream is incomplete until then */
+        int finish();
+
+      private:
+        int flush(const void *data, size_t size, bool last);
+        static int write_all(int fd, const char *data, size_t size);
+
+        const AEAD_STREAM &m_stream;
+        int m_fd;
+        uint64_t m_index;
+        bool m_finished;
+        size_t m_filled;
+        std::vector<char> m_plaintext, m_sealed;
+    };
+
+    /**
+     * Opens a sealed stream read from a file, a pipe or a socket with constant memory, one byte of the next chunk is
+     * read ahead to tell the last chunk.
+     */
+    class Reader {
+      public:
+        Reader(const AEAD_STREAM &stream, int fd);
+
+        /* returns bytes read, 0 at the end of the stream; -EBADMSG if tampered or truncated, -errno otherwise */
+        ssize_t read(void *data, size_t size);
+
+      private:
+        int next();
+
+        const AEAD_STREAM &m_stream;
+        int m_fd;
+        uint64_t m_index;
+        bool m_done;
+        int m_error; // sticky, chunks are opened in place
+        size_t m_pending, m_offset, m_available;
+        std::vector<char> m_sealed;
+    };
+
+    /**
+     * Random access to the plaintext of a sealed file mapped in memory, only the chunks read are opened.
+     */
+    class Mapped {
+      public:
+        Mapped(const AEAD_STREAM &stream, const std::string &path);
+        ~Mapped();
+        Mapped(const Mapped &) = delete;
+        Mapped &operator=(const Mapped &) = delete;
+
+        /* 0 if mapped; -errno otherwise */
+        int error() const
+        {
+            return m_error;
+        }
+
+        /* size of the plaintext */
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        /* open chunk `index` into `output` of chunk() bytes at least, returns its size or -errno */
+        ssize_t read_chunk(uint64_t index, void *output) const
+        {
+            return m_error ? m_error : m_stream.open_chunk(m_data, m_length, index, output);
+        }
+
+        /* plaintext bytes at `offset`, returns bytes read or -errno */
+        ssize_t pread(void *data, size_t size, size_t offset) const;
+
+      private:
+        const AEAD_STREAM &m_stream;
+        int m_error;
+        void *m_data;
+        size_t m_length, m_size;
+    };
+
+  private:
+    int m_mode;
+    std::string m_key, m_iv, m_aad;
+    size_t m_chunk;
+};
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include <functional>
+#include <string_view>
 #include <unordered_map>
 
 namespace lemon
@@ -15,9 +21,22 @@ namespace lemon
 
 namespace lemon
 {
+/**
+ * Registry of the constructors of the implementations of `Base`, filled by LEMON_FACTORY_REGISTRAR at static
+ * initialization.
+ *
+ * Once registration is over, seal() freezes the registry into a perfect hash table: fetch() then hashes the name
+ * once, without building a std::string, and compares it with a single candidate. Constructors registered by
+ * registrar are plain function pointers and are called without going through std::function. A sealed registry
+ * also hands out ids, fetch(id) skips the lookup altogether. offer() and revoke() are refused once sealed, and
+ * lookups are safe from any thread as long as seal() happened before.
+ */
 template <typename Base, typename... Args>
 class factory final : private std::unordered_map<std::string, std::function<Base *(Args...)>> {
   public:
+    using creator = Base *(*)(Args...);
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
     factory(factory const &) = delete;
     factory &operator=(factory const &) = delete;
 
@@ -29,31 +48,151 @@ class factory final : private std::unordered_map<std::string, std::function<Base
 
     inline void offer(const std::string &name, std::function<Base *(Args...)> func)
     {
-        this->insert({name, std::move(func)});
+        if (!m_sealed) {
+            this->insert({name, std::move(func)});
+        }
     }
 
     inline void revoke(const std::string &name)
     {
-        this->erase(name);
+        if (!m_sealed) {
+            this->erase(name);
+        }
     }
 
-    inline Base *fetch(const std::string &name, Args... args)
+    inline Base *fetch(std::string_view name, Args... args)
     {
-        auto it = this->find(name);
+        if (m_sealed) {
+            return fetch(id(name), args...);
+        }
+        auto it = this->find(std::string(name));
         return it == this->end() ? nullptr : it->second.operator()(args...);
     }
 
-    inline bool has(const std::string &name)
+    /**
+     * Create by an id from id(), nullptr if unknown.
+     */
+    inline Base *fetch(size_t id, Args... args)
+    {
+        if (id >= m_slots.size() || m_slots[id].func == nullptr) {
+            return nullptr;
+        }
+        const slot &s = m_slots[id];
+        return s.direct ? s.direct(args...) : s.func->operator()(args...);
+    }
+
+    inline bool has(std::string_view name)
     {
-        return this->find(name) != this->end();
+        return m_sealed ? id(name) != npos : this->find(std::string(name)) != this->end();
     }
 
+    /**
+     * Id of `name` for fetch(), valid until exit, npos if unknown or not sealed yet.
+     */
+    inline size_t id(std::string_view name) const
+    {
+        if (!m_sealed) {
+            return npos;
+        }
+        uint64_t hash = Hash(name);
+        size_t slot = Slot(hash, m_seeds[hash & (m_seeds.size() - 1)], m_shift);
+        return m_slots[slot].name == name && m_slots[slot].func ? slot : npos;
+    }
+
+    /**
+     * Freeze the registry, see the class comment. Call it from main(), once all the registrars ran. Returns false
+     * if no perfect hash table was found, e.g. for names with the same hash, the registry then stays unsealed and
+     * works as before, without ids.
+     */
+    inline bool seal()
+    {
+        if (m_sealed) {
+            return true;
+        }
+        // hash and displace: the names are spread into buckets, then from the most crowded bucket on, a seed is
+        // searched for which the names of the bucket all land in free slots. Names are hashed once, the seeds only
+        // displace the hash.
+        size_t buckets = 1;
+        while (buckets < this->size()) {
+            buckets *= 2;
+        }
+        std::vector<std::vector<std::pair<uint64_t, typename factory::iterator>>> names(buckets);
+        for (auto it = this->begin(); it != this->end(); ++it) {
+            uint64_t hash = Hash(it->first);
+            names[hash & (buckets - 1)].emplace_back(hash, it);
+        }
+        std::vector<size_t> order(buckets);
+        for (size_t i = 0; i < buckets; i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&names](size_t a, size_t b) {
+            return names[a].size() > names[b].size();
+        });
+
+        std::vector<uint64_t> seeds(buckets, 0);
+        int shift = 63;
+        while ((size_t(1) << (64 - shift)) < this->size() + this->size() / 4) {
+            shift--;
+        }
+        std::vector<slot> slots(size_t(1) << (64 - shift));
+        std::vector<size_t> taken;
+        for (size_t bucket : order) {
+            for (uint64_t seed = 1; !names[bucket].empty(); seed++) {
+                if (seed > (1 << 20)) {
+                    return false; // names with the same hash, stay unsealed
+                }
+                taken.clear();
+                for (auto &[hash, it] : names[bucket]) {
+                    size_t i = Slot(hash, seed, shift);
+                    if (slots[i].func || std::find(taken.begin(), taken.end(), i) != taken.end()) {
+                        break;
+                    }
+                    taken.push_back(i);
+                }
+                if (taken.size() == names[bucket].size()) {
+                    for (size_t k = 0; k < taken.size(); k++) {
+                        auto it = names[bucket][k].second;
+                        creator *direct = it->second.template target<creator>();
+                        slots[taken[k]] = slot{it->first, &it->second, direct ? *direct : nullptr};
+                    }
+                    seeds[bucket] = seed;
+                    break;
+                }
+            }
+        }
+        m_seeds.swap(seeds);
+        m_slots.swap(slots);
+        m_shift = shift;
+        m_sealed = true;
+        return true;
+    }
+
+    inline bool sealed() const
+    {
+        return m_sealed;
+    }
+
+    /**
+     * Names matching the regular expression `filter`. The last few filters stay compiled, the least recently used
+     * one is dropped for a new one.
+     */
     inline std::vector<std::string> query(const std::string &filter)
     {
         std::vector<std::string> names;
-        auto pattern = std::regex(filter);
+        std::lock_guard<std::mutex> lock(m_querying);
+        auto pattern = std::find_if(m_patterns.begin(), m_patterns.end(), [&filter](const auto &p) {
+            return p.first == filter;
+        });
+        if (pattern == m_patterns.end()) {
+            if (m_patterns.size() == PATTERNS) {
+                m_patterns.pop_back();
+            }
+            m_patterns.emplace(m_patterns.begin(), filter, std::regex(filter));
+        } else {
+            std::rotate(m_patterns.begin(), pattern, pattern + 1);
+        }
         for (auto it = this->begin(); it != this->end(); ++it) {
-            if (!filter.empty() && !std::regex_match(it->first, pattern)) {
+            if (!filter.empty() && !std::regex_match(it->first, m_patterns.front().second)) {
                 continue;
             }
             names.push_back(it->first);
@@ -64,6 +203,54 @@ class factory final : private std::unordered_map<std::string, std::function<Base
 
   private:
     factory() {}
+
+    struct slot {
+        std::string_view name; // into the keys of the map, which no longer change once sealed
+        const std::function<Base *(Args...)> *func = nullptr;
+        creator direct = nullptr;
+    };
+
+    /** Multiplicative hashing of the name hash displaced by the seed of its bucket, into 2^(64 - shift) slots */
+    static inline size_t Slot(uint64_t hash, uint64_t seed, int shift)
+    {
+        return static_cast<size_t>(((hash ^ seed) * 0x9e3779b97f4a7c15ULL) >> shift);
+    }
+
+    /** Hash of a name, 8 bytes at a time */
+    static inline uint64_t Hash(std::string_view name)
+    {
+        uint64_t hash = name.size() * 0x9e3779b97f4a7c15ULL;
+        size_t i = 0;
+        for (; i + 8 <= name.size(); i += 8) {
+            uint64_t word;
+            memcpy(&word, name.data() + i, 8);
+            hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 32;
+        }
+        if (i < name.size()) {
+            uint64_t word = 0;
+            if (name.size() >= 8) {
+                memcpy(&word, name.data() + name.size() - 8, 8); // overlapping the last word
+            } else {
+                for (; i < name.size(); i++) {
+                    word = (word << 8) | static_cast<unsigned char>(name[i]);
+                }
+            }
+            hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        }
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    bool m_sealed = false;
+    std::vector<uint64_t> m_seeds;
+    std::vector<slot> m_slots;
+    int m_shift = 63;
+
+    static constexpr size_t PATTERNS = 8;
+    std::mutex m_querying;
+    std::vector<std::pair<std::string, std::regex>> m_patterns; // most recently used first
 };
 
 template <typename Derived, typename Base, typename... Args>
@@ -71,7 +258,8 @@ class registrar {
   public:
     registrar(const std::string &name)
     {
-        lemon::factory<Base, Args...>::instance().offer(name, [](Args... args) -> Base * {
+        // a plain function pointer, which a sealed factory calls directly
+        lemon::factory<Base, Args...>::instance().offer(name, +[](Args... args) -> Base * {
             return new Derived(args...);
         });
     }
@@ -81,7 +269,7 @@ class registrar {
 };
 
 template <typename Base, typename... Args>
-inline bool has(const std::string &name)
+inline bool has(std::string_view name)
 {
     return lemon::factory<Base, Args...>::instance().has(name);
 }
@@ -93,13 +281,31 @@ inline std::vector<std::string> query(const std::string &filter)
 }
 
 template <typename Base, typename... Args>
-inline std::shared_ptr<Base> fetch(const std::string &name, Args... args)
+inline std::shared_ptr<Base> fetch(std::string_view name, Args... args)
 {
     return std::shared_ptr<Base>(lemon::factory<Base, Args...>::instance().fetch(name, args...));
 }
 
+template <typename Base, typename... Args>
+inline std::shared_ptr<Base> fetch(size_t id, Args... args)
+{
+    return std::shared_ptr<Base>(lemon::factory<Base, Args...>::instance().fetch(id, args...));
+}
+
+template <typename Base, typename... Args>
+inline bool seal()
+{
+    return lemon::factory<Base, Args...>::instance().seal();
+}
+
+template <typename Base, typename... Args>
+inline size_t id(std::string_view name)
+{
+    return lemon::factory<Base, Args...>::instance().id(name);
+}
+
 #define LEMON_DEFINE_FACTORY(Base, ...)                                       \
-    inline bool has(const std::string &name)                                  \
+    inline bool has(std::string_view name)                                    \
     {                                                                         \
         return lemon::has<Base, ##__VA_ARGS__>(name);                         \
     }                                                                         \
@@ -108,9 +314,22 @@ inline std::shared_ptr<Base> fetch(const std::string &name, Args... args)
         return lemon::query<Base, ##__VA_ARGS__>(filter);                     \
     }                                                                         \
     template <typename... Args>                                               \
-    inline std::shared_ptr<Base> fetch(const std::string &name, Args... args) \
+    inline std::shared_ptr<Base> fetch(std::string_view name, Args... args)   \
     {                                                                         \
         return lemon::fetch<Base, ##__VA_ARGS__>(name, args...);              \
+    }                                                                         \
+    template <typename... Args>                                               \
+    inline std::shared_ptr<Base> fetch(size_t id, Args... args)               \
+    {                                                                         \
+        return lemon::fetch<Base, ##__VA_ARGS__>(id, args...);                \
+    }                                                                         \
+    inline bool seal()                                                        \
+    {                                                                         \
+        return lemon::seal<Base, ##__VA_ARGS__>();                            \
+    }                                                                         \
+    inline size_t id(std::string_view name)                                   \
+    {                                                                         \
+        return lemon::id<Base, ##__VA_ARGS__>(name);                          \
     }
 
 #define LEMON_FACTORY_REGISTRAR(name, Derived, Base, ...) \
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <strings.h>
 #include <assert.h>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <list>
 #include <string>
 #include <algorithm>
@@ -12,8 +18,36 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string_view>
+#include <type_traits>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <utility>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-#if 0
+#include "../lockless/atomic-epoch.h"
+#include "../misc/watcher.h"
+#include "../caches/reloading.h"
+#include "../misc/parallel.h"
+
+#if defined(LEMON_ASYNC_TRACE)
+#include "../misc/logger.h"
+#define PARSERS_TRACE(fmt, ...) LOGGER_TRACE(fmt, ##__VA_ARGS__)
+#elif 0
 #include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
@@ -37,6 +71,15 @@
 #define PARSERS_TRACE(fmt, ...)
 #endif
 
+#if !defined(PARSERS_SPAN) && defined(LEMON_TRACING)
+#include "../misc/tracing.h"
+#define PARSERS_SPAN(name) TRACING_SPAN(name)
+#endif
+
+#ifndef PARSERS_SPAN
+#define PARSERS_SPAN(name)
+#endif
+
 namespace lemon
 {
 enum {
@@ -51,6 +94,175 @@ enum {
 #define INI_NEWLINE        "\n"
 #define INI_UTF8_SIGNATURE "\xEF\xBB\xBF"
 
+namespace details
+{
+/**
+ * Structural bitmasks of INI text, with a bit set for each character the parser stops at: line ends, '[', ']', '=',
+ * the comment starts ';' and '#', and NUL. Like the first stage of simdjson, the text is classified 64 bytes at a
+ * time, with AVX2 or SSE4.2 if the CPU has them, and the parser jumps from set bit to set bit rather than testing
+ * every byte of keys and values. Blocks are classified as the parser reaches them instead of being flattened into
+ * an array of offsets up front, which costs more than it saves on files of short lines.
+ */
+class StructuralIndex {
+  public:
+    enum Isa { NONE, SCALAR, SSE42, AVX2 };
+
+    /** Instruction set of Build(), the best one of the CPU by default, NONE to parse without an index */
+    static Isa &Using()
+    {
+        static Isa isa = Detect();
+        return isa;
+    }
+
+    static Isa Detect()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return SSE42;
+        }
+#endif
+        return NONE; // byte by byte is faster than scalar bitmasks
+    }
+
+    /**
+     * Index `length` bytes of `text`, which must be followed by a NUL. Returns false if the index is disabled.
+     */
+    bool Build(char *text, size_t length, Isa isa = Using())
+    {
+        m_text = text;
+        m_length = length;
+        m_isa = isa;
+        m_block = SIZE_MAX;
+        return isa != NONE;
+    }
+
+    /**
+     * First character at or after `text` for which `stop` is true, or the NUL ending the text. `stop` must be true for
+     * structural characters only, and the text from `text` on must be unchanged since Build().
+     */
+    template <typename Stop>
+    char *Seek(char *text, Stop stop)
+    {
+        size_t offset = static_cast<size_t>(text - m_text);
+        size_t block = offset & ~size_t(63);
+        uint64_t mask = (block == m_block ? m_mask : Load(block)) & (~uint64_t(0) << (offset & 63));
+        for (;;) {
+            while (mask) {
+                char *p = m_text + block + __builtin_ctzll(mask);
+                if (*p == 0 || stop(*p)) {
+                    return p;
+                }
+                mask &= mask - 1;
+            }
+            block += 64;
+            if (block > m_length) {
+                return m_text + m_length;
+            }
+            mask = Load(block);
+        }
+    }
+
+    /** Bitmask of the 64 bytes of text from `offset`, which is a multiple of 64 */
+    uint64_t Load(size_t offset)
+    {
+        m_block = offset;
+        if (offset + 64 <= m_length) {
+            m_mask = Classify(m_isa, m_text + offset);
+        } else { // the tail is classified in a padded copy, the text may end right before a guard page
+            alignas(64) char block[64] = {};
+            memcpy(block, m_text + offset, m_length - offset);
+            m_mask = Classify(m_isa, block);
+        }
+        return m_mask;
+    }
+
+    static uint64_t Classify(Isa isa, const char *block)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa == AVX2) {
+            return ClassifyAVX2(block);
+        }
+        if (isa == SSE42) {
+            return ClassifySSE42(block);
+        }
+#endif
+        uint64_t mask = 0;
+        for (int i = 0; i < 64; i++) {
+            mask |= static_cast<uint64_t>(IsStructural(block[i])) << i;
+        }
+        return mask;
+    }
+
+  private:
+    static bool IsStructural(char ch)
+    {
+        switch (ch) {
+            case 0:
+            case '\n':
+            case '\r':
+            case '[':
+            case ']':
+            case '=':
+            case ';':
+            case '#':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // A byte is structural if the entries of its low and high nibbles in the lo/hi tables share a bit:
+    //   bit 0: NUL '\n' '\r'     bit 1: '#'     bit 2: ';' '=' '[' ']'
+    __attribute__((target("sse4.2"))) static uint64_t ClassifySSE42(const char *block)
+    {
+        const __m128i lo = _mm_setr_epi8(1, 0, 0, 2, 0, 0, 0, 0, 0, 0, 1, 4, 0, 5, 0, 0);
+        const __m128i hi = _mm_setr_epi8(1, 0, 2, 4, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        uint64_t mask = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+            __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+            __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            __m128i none = _mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128());
+            mask |= static_cast<uint64_t>(static_cast<uint16_t>(~_mm_movemask_epi8(none))) << (16 * i);
+        }
+        return mask;
+    }
+
+    __attribute__((target("avx2"))) static uint64_t ClassifyAVX2(const char *block)
+    {
+        const __m256i lo = _mm256_setr_epi8(1, 0, 0, 2, 0, 0, 0, 0, 0, 0, 1, 4, 0, 5, 0, 0, //
+                                            1, 0, 0, 2, 0, 0, 0, 0, 0, 0, 1, 4, 0, 5, 0, 0);
+        const __m256i hi = _mm256_setr_epi8(1, 0, 2, 4, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
+                                            1, 0, 2, 4, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        uint64_t mask = 0;
+        for (int i = 0; i < 2; i++) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * i));
+            __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+            __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            __m256i none = _mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256());
+            mask |= static_cast<uint64_t>(static_cast<uint32_t>(~_mm256_movemask_epi8(none))) << (32 * i);
+        }
+        return mask;
+    }
+#endif
+
+    char *m_text = nullptr;
+    size_t m_length = 0;
+    Isa m_isa = NONE;
+    size_t m_block = SIZE_MAX; //!> offset of the block of m_mask
+    uint64_t m_mask = 0;
+};
+} // namespace details
+
+struct INI_GenericCase;
+
 template <typename Compare>
 class SimpleINIParser {
   public:
@@ -113,7 +325,11 @@ class SimpleINIParser {
           m_allow_multikey(allow_multikey),
           m_allow_multiline(allow_multiline),
           m_add_spaces(true),
-          m_order(0)
+          m_order(0),
+          m_flat(false),
+          m_indexed(false),
+          m_mapped(0),
+          m_materialized(false)
     {
     }
     ~SimpleINIParser()
@@ -125,10 +341,22 @@ class SimpleINIParser {
     void Reset()
     {
         // remove all data
-        delete[] m_text;
+        if (m_mapped) {
+            munmap(m_text, m_mapped);
+            m_mapped = 0;
+        } else {
+            delete[] m_text;
+        }
         m_text = NULL;
         m_textlen = 0;
+        m_records.clear();
+        m_index.clear();
+        m_used = 0;
+        m_indexed = false;
+        m_materialized.store(false, std::memory_order_relaxed);
         m_filecomment = NULL;
+        m_included.clear();
+        Touch(NULL);
         if (!m_data.empty()) {
             m_data.erase(m_data.begin(), m_data.end());
         }
@@ -146,7 +374,7 @@ class SimpleINIParser {
     /** Has any data been loaded */
     bool IsEmpty() const
     {
-        return m_data.empty();
+        return m_indexed ? m_records.empty() : m_data.empty();
     }
 
     bool IsUnicode() const
@@ -174,10 +402,72 @@ class SimpleINIParser {
     void SetMultiLine(bool allow_multiline = true)
     {
         m_allow_multiline = allow_multiline;
+        Touch(NULL);
+    }
+
+    bool UsingSpaces() const
+    {
+        return m_add_spaces;
+    }
+    void SetSpaces(bool add_spaces = true)
+    {
+        m_add_spaces = add_spaces;
+        Touch(NULL);
+    }
+
+    bool UsingIncludes() const
+    {
+        return m_includes;
+    }
+    /**
+     * Honour "@include <pattern>" lines in LoadFile(), patterns are glob(3) ones relative to the directory of the
+     * file they appear in. The included files are parsed in parallel on the pool of SetThreadPool() and merged as if
+     * each directive were replaced by the files it matches in sorted order, so later entries override earlier ones
+     * as with sequential loads. A file is loaded once, later includes of it are ignored, and a missing file is an
+     * error unless the pattern has wildcards.
+     */
+    void SetIncludes(bool includes = true)
+    {
+        m_includes = includes;
+    }
+
+    /**
+     * Parse included files on `pool`, anything with push(std::function<void()>) such as multiprocessing::threadpool,
+     * NULL to parse them one after another. The pool must outlive the loads.
+     */
+    template <typename Pool>
+    void SetThreadPool(Pool *pool)
+    {
+        m_executor = multiprocessing::executor_of(pool);
+    }
+
+    bool IsFlat() const
+    {
+        return m_flat;
+    }
+    /**
+     * Flat mode: LoadFile() maps the file and parses it in place, entries are kept in load order and indexed by a
+     * hash of (section, key) in an open addressing table, so loading allocates nothing per key and GetValue() is
+     * O(1). The section/key maps are only built if something asks for them (GetAllKeys(), Dump(), ...), and the
+     * first modification (SetValue(), Delete(), loading more data) leaves flat mode for good, until Reset().
+     *
+     * The index treats keys as equal if they are equal bytes or, unless Compare is INI_GenericCase, equal ASCII
+     * case-insensitively, which is what INI_GenericCase and INI_GenericNoCase do.
+     */
+    void SetFlat(bool flat = true)
+    {
+        if (!m_text) m_flat = flat;
     }
 
     int LoadFile(const char *file)
     {
+        PARSERS_SPAN("lemon::SimpleINIParser::LoadFile");
+        if (m_includes && !m_capturing) {
+            return LoadIncluding(file);
+        }
+        if (m_flat && !m_text) {
+            return MapFile(file);
+        }
         std::ifstream rf(file, std::ios::in | std::ios::binary);
         if (!rf.good()) {
             return INI_FILE;
@@ -228,26 +518,13 @@ class SimpleINIParser {
         memset(pdata, 0, sizeof(char) * (textlen + 1));
         memcpy(pdata, text, textlen);
 
-        // parse it
-        const static char empty = 0;
-        char *pnext = pdata;
-        const char *psection = &empty;
-        const char *pkey = NULL, *pvalue = NULL, *comment = NULL;
-
         // We copy the strings if we are loading data into this class when we
         // already have stored some.
         bool needcopy = (m_text != NULL);
-
-        // find a file comment if it exists, this is a comment that starts at the
-        // beginning of the file and continues until the first blank line.
-        int rc = FindFileComment(pnext, needcopy);
-        if (rc < 0) return rc;
-
-        // add every entry in the file to the data table
-        while (FindEntry(pnext, psection, pkey, pvalue, comment)) {
-            rc = AddEntry(psection, pkey, pvalue, comment, false, needcopy);
-            if (rc < 0) return rc;
+        if (needcopy) {
+            Thaw();
         }
+        int rc = Parse(pdata, textlen, needcopy);
 
         // store these strings if we didn't copy them
         if (needcopy) {
@@ -257,145 +534,69 @@ class SimpleINIParser {
             m_textlen = textlen + 1;
         }
 
-        return INI_OK;
+        return rc;
     }
 
+    /**
+     * Write the file atomically: the content goes to a temporary file with writev(), which is synced and renamed
+     * over `file`. Sections are rendered once and kept until they are modified, so that a dump after a few
+     * SetValue() only renders the sections they touched, and nothing is written if nothing changed since the last
+     * DumpFile() of the same file and the file is still the one written then. Within BeginBatch()/EndBatch(), the
+     * writing is deferred to EndBatch().
+     */
     int DumpFile(const char *file, bool add_signature = true) const
     {
-        int err;
-        std::string dumped;
-        if ((err = Dump(dumped, add_signature)) == 0) {
-            std::string tmpfile = std::string(file) + ".saving."
-                                  + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                       std::chrono::system_clock::now().time_since_epoch())
-                                                       .count());
-            std::ofstream wf(tmpfile, std::ios::out | std::ios::binary | std::ios::trunc);
-            if (!wf.good()) {
-                return -errno;
-            }
-            wf.write(dumped.data(), dumped.size());
-            wf.close();
-            if (rename(tmpfile.c_str(), file) != 0) {
-                return -errno;
-            }
+        if (m_batching > 0) {
+            m_pending[file] = add_signature;
+            return INI_OK;
         }
-
-        return err;
+        return WriteFile(file, add_signature);
     }
 
-    int Dump(std::string &dumpped, bool add_signature = false) const
+    /**
+     * Group modifications and DumpFile() calls, e.g. those of one user action, each file dumped meanwhile is written
+     * once by the outermost EndBatch().
+     */
+    void BeginBatch()
     {
-        // add the UTF-8 signature if it is desired
-        if (m_is_utf8 && add_signature) {
-            dumpped += INI_UTF8_SIGNATURE;
-        }
-
-        // get all of the sections sorted in load order
-        Entries oSections;
-        GetAllSections(oSections);
-        oSections.sort(typename Entry::LoadOrder());
+        m_batching++;
+    }
 
-        // if there is an empty section name, then it must be written out first
-        // regardless of the load order
-        typename Entries::iterator is = oSections.begin();
-        for (; is != oSections.end(); ++is) {
-            if (!*is->item) {
-                // move the empty section name to the front of the section list
-                if (is != oSections.begin()) {
-                    oSections.splice(oSections.begin(), oSections, is, std::next(is));
-                }
-                break;
-            }
+    int EndBatch()
+    {
+        if (m_batching == 0 || --m_batching > 0) {
+            return INI_OK;
         }
-
-        // write the file comment if we have one
-        bool neednewline = false;
-        if (m_filecomment) {
-            if (!OutputMultiLineText(dumpped, m_filecomment)) {
-                return INI_FAIL;
-            }
-            neednewline = true;
+        int rc = INI_OK;
+        for (auto &[file, add_signature] : std::exchange(m_pending, {})) {
+            int err = WriteFile(file.c_str(), add_signature);
+            rc = rc == INI_OK ? err : rc;
         }
+        return rc;
+    }
 
-        // iterate through our sections and output the data
-        typename Entries::const_iterator iSection = oSections.begin();
-        for (; iSection != oSections.end(); ++iSection) {
-            // write out the comment if there is one
-            if (iSection->comment) {
-                if (neednewline) {
-                    dumpped += INI_NEWLINE INI_NEWLINE;
-                }
-                if (!OutputMultiLineText(dumpped, iSection->comment)) {
-                    return INI_FAIL;
-                }
-                neednewline = false;
-            }
-
-            if (neednewline) {
-                dumpped += INI_NEWLINE INI_NEWLINE;
-                neednewline = false;
-            }
-
-            // write the section (unless there is no section name)
-            if (*iSection->item) {
-                dumpped += "[";
-                dumpped += iSection->item;
-                dumpped += "]";
-                dumpped += INI_NEWLINE;
+    int Dump(std::string &dumpped, bool add_signature = false) const
+    {
+        std::lock_guard<std::mutex> lock(m_rendering);
+        std::vector<std::string_view> parts;
+        std::string filecomment;
+        int rc = Render(parts, filecomment, add_signature);
+        if (rc == INI_OK) {
+            size_t size = dumpped.size();
+            for (auto &part : parts) {
+                size += part.size();
             }
-
-            // get all of the keys sorted in load order
-            Entries oKeys;
-            GetAllKeys(iSection->item, oKeys);
-            oKeys.sort(typename Entry::LoadOrder());
-
-            // write all keys and values
-            typename Entries::const_iterator iKey = oKeys.begin();
-            for (; iKey != oKeys.end(); ++iKey) {
-                // get all values for this key
-                Entries oValues;
-                GetAllValues(iSection->item, iKey->item, oValues);
-
-                typename Entries::const_iterator iValue = oValues.begin();
-                for (; iValue != oValues.end(); ++iValue) {
-                    // write out the comment if there is one
-                    if (iValue->comment) {
-                        dumpped += INI_NEWLINE;
-                        if (!OutputMultiLineText(dumpped, iValue->comment)) {
-                            return INI_FAIL;
-                        }
-                    }
-
-                    // write the key
-                    dumpped += iKey->item;
-                    PARSERS_TRACE("Dump Key = %s", iKey->item);
-
-                    // write the value
-                    dumpped += m_add_spaces ? " = " : "=";
-                    if (m_allow_multiline && IsMultiLineData(iValue->item)) {
-                        // multi-line data needs to be processed specially to ensure
-                        // that we use the correct newline format for the current system
-                        dumpped += "<<<END_OF_TEXT" INI_NEWLINE;
-                        if (!OutputMultiLineText(dumpped, iValue->item)) {
-                            return INI_FAIL;
-                        }
-                        PARSERS_TRACE("Dump Value = %s", iValue->item);
-                        dumpped += "END_OF_TEXT";
-                    } else {
-                        dumpped += iValue->item;
-                    }
-                    dumpped += INI_NEWLINE;
-                }
+            dumpped.reserve(size);
+            for (auto &part : parts) {
+                dumpped += part;
             }
-
-            neednewline = true;
         }
-
-        return INI_OK;
+        return rc;
     }
 
     void GetAllSections(Entries &entries) const
     {
+        Materialize();
         entries.clear();
         for (auto it = m_data.cbegin(); it != m_data.cend(); ++it) {
             entries.push_back(it->first);
@@ -404,6 +605,7 @@ class SimpleINIParser {
 
     bool GetAllKeys(const char *section, Entries &entries) const
     {
+        Materialize();
         entries.clear();
         if (!section) {
             return false;
@@ -429,6 +631,7 @@ class SimpleINIParser {
 
     bool GetAllValues(const char *section, const char *key, Entries &entries) const
     {
+        Materialize();
         entries.clear();
         if (!section || !key) {
             return false;
@@ -460,6 +663,7 @@ class SimpleINIParser {
         if (!section) {
             return -1;
         }
+        Materialize();
 
         typename Sections::const_iterator iSection = m_data.find(section);
         if (iSection == m_data.end()) {
@@ -488,6 +692,7 @@ class SimpleINIParser {
 
     const Pairs *GetSection(const char *section) const
     {
+        Materialize();
         if (section) {
             typename Sections::const_iterator i = m_data.find(section);
             if (i != m_data.end()) {
@@ -506,6 +711,16 @@ class SimpleINIParser {
         if (!section || !key) {
             return default_value;
         }
+        if (m_indexed) {
+            const Record *record = Find(section, key);
+            if (record == nullptr) {
+                return default_value;
+            }
+            if (has_multiple) {
+                *has_multiple = record->multiple;
+            }
+            return record->value;
+        }
         typename Sections::const_iterator iSection = m_data.find(section);
         if (iSection == m_data.end()) {
             return default_value;
@@ -528,6 +743,20 @@ class SimpleINIParser {
         return iKeyVal->second;
     }
 
+    /**
+     * GetValue() without NUL-terminated arguments, nor a strlen() of the value in flat mode.
+     */
+    std::string_view GetValueView(std::string_view section, std::string_view key,
+                                  std::string_view default_value = std::string_view()) const
+    {
+        if (m_indexed) {
+            const Record *record = Find(section, key);
+            return record ? std::string_view(record->value, record->value_len) : default_value;
+        }
+        const char *value = GetValue(std::string(section).c_str(), std::string(key).c_str());
+        return value ? std::string_view(value) : default_value;
+    }
+
     long GetLongValue(const char *section, const char *key, long default_value = 0, bool *has_multiple = NULL) const
     {
         // return the default if we don't have a value
@@ -610,6 +839,7 @@ class SimpleINIParser {
     int SetValue(const char *section, const char *key, const char *value, const char *comment = NULL,
                  bool replace = false)
     {
+        Thaw();
         return AddEntry(section, key, value, comment, replace, true);
     }
 
@@ -624,6 +854,7 @@ class SimpleINIParser {
         snprintf(szInput, sizeof(szInput), usehex ? "0x%lx" : "%ld", value);
 
         // actually add it
+        Thaw();
         return AddEntry(section, key, szInput, comment, replace, true);
     }
 
@@ -637,6 +868,7 @@ class SimpleINIParser {
         snprintf(szInput, sizeof(szInput), "%f", value);
 
         // actually add it
+        Thaw();
         return AddEntry(section, key, szInput, comment, replace, true);
     }
 
@@ -649,6 +881,7 @@ class SimpleINIParser {
         const char *pszInput = value ? "true" : "false";
 
         // actually add it
+        Thaw();
         return AddEntry(section, key, pszInput, comment, replace, true);
     }
 
@@ -662,11 +895,13 @@ class SimpleINIParser {
         if (!section) {
             return false;
         }
+        Thaw();
 
         auto sectionit = m_data.find(section);
         if (sectionit == m_data.end()) {
             return false;
         }
+        Touch(sectionit->first.item);
 
         // remove a single key if we have a keyname
         if (key) {
@@ -690,38 +925,630 @@ class SimpleINIParser {
                 }
             } while (pairit != sectionit->second.end() && !IsLess(key, pairit->first.item));
 
-            if (!deleted) {
-                return false;
+            if (!deleted) {
+                return false;
+            }
+
+            // done now if the section is not empty or we are not pruning away
+            // the empty sections. Otherwise let it fall through into the section
+            // deletion code
+            if (!remove_empty || !sectionit->second.empty()) {
+                return true;
+            }
+        } else {
+            // delete all copied strings from this section. The actual
+            // entries will be removed when the section is removed.
+            typename Pairs::iterator pairit = sectionit->second.begin();
+            for (; pairit != sectionit->second.end(); ++pairit) {
+                DeleteString(pairit->first.item);
+                DeleteString(pairit->second);
+            }
+        }
+
+        // delete the section itself
+        DeleteString(sectionit->first.item);
+        m_data.erase(sectionit);
+
+        return true;
+    }
+
+  private:
+    // copying is not permitted
+    SimpleINIParser(const SimpleINIParser &);            // disabled
+    SimpleINIParser &operator=(const SimpleINIParser &); // disabled
+
+    /** Entry of flat mode, in load order. Section only entries have no key nor value. */
+    struct Record {
+        const char *section, *key, *value, *comment;
+        uint32_t section_len, key_len, value_len;
+        bool multiple; //!< another value follows for the same key (multi-key only)
+    };
+
+    /** Slot of the flat index, `record` is the value GetValue() returns, or EMPTY. */
+    struct Slot {
+        uint64_t hash;
+        uint32_t record;
+    };
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr bool FOLDCASE = !std::is_same_v<Compare, INI_GenericCase>;
+
+    static char Fold(char ch)
+    {
+        return FOLDCASE && ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+    }
+
+    /** FNV-1a of the section, a separator that is not text and the key, case folded as Compare does */
+    static uint64_t Hash(std::string_view section, std::string_view key)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char ch : section) {
+            hash = (hash ^ static_cast<unsigned char>(Fold(ch))) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xFF) * 1099511628211ULL;
+        for (char ch : key) {
+            hash = (hash ^ static_cast<unsigned char>(Fold(ch))) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static bool Equals(std::string_view lhs, const char *rhs, uint32_t rhs_len)
+    {
+        if (lhs.size() != rhs_len) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (Fold(lhs[i]) != Fold(rhs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const Record *Find(std::string_view section, std::string_view key) const
+    {
+        if (m_index.empty()) {
+            return nullptr;
+        }
+        uint64_t hash = Hash(section, key);
+        size_t mask = m_index.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = m_index[i];
+            if (slot.record == EMPTY) {
+                return nullptr;
+            }
+            if (slot.hash == hash) {
+                const Record &record = m_records[slot.record];
+                if (Equals(section, record.section, record.section_len) && Equals(key, record.key, record.key_len)) {
+                    return &record;
+                }
+            }
+        }
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> index(m_index.empty() ? 1024 : 2 * m_index.size(), Slot{0, EMPTY});
+        size_t mask = index.size() - 1;
+        for (const Slot &slot : m_index) {
+            if (slot.record != EMPTY) {
+                size_t i = slot.hash & mask;
+                while (index[i].record != EMPTY) {
+                    i = (i + 1) & mask;
+                }
+                index[i] = slot;
+            }
+        }
+        m_index.swap(index);
+    }
+
+    /** AddEntry() of flat mode while loading, strings are never copied */
+    int AddRecord(const char *section, const char *key, const char *value, const char *comment)
+    {
+        if (m_records.size() >= EMPTY) {
+            return INI_NOMEM;
+        }
+        Touch(NULL);
+        Record record{section, key, value, comment, static_cast<uint32_t>(strlen(section)), 0, 0, false};
+        if (!key || !value) {
+            record.key = record.value = NULL;
+            m_records.push_back(record);
+            return INI_OK;
+        }
+        record.key_len = static_cast<uint32_t>(strlen(key));
+        record.value_len = static_cast<uint32_t>(strlen(value));
+        uint32_t position = static_cast<uint32_t>(m_records.size());
+        m_records.push_back(record);
+
+        if (2 * (m_used + 1) > m_index.size()) {
+            Grow();
+        }
+        std::string_view section_view(section, record.section_len), key_view(key, record.key_len);
+        uint64_t hash = Hash(section_view, key_view);
+        size_t mask = m_index.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = m_index[i];
+            if (slot.record == EMPTY) {
+                slot.hash = hash, slot.record = position;
+                m_used++;
+                return INI_OK;
+            }
+            Record &existing = m_records[slot.record];
+            if (slot.hash == hash && Equals(section_view, existing.section, existing.section_len)
+                && Equals(key_view, existing.key, existing.key_len)) {
+                if (m_allow_multikey) {
+                    existing.multiple = true; // GetValue() returns the first of them
+                } else {
+                    slot.record = position; // the last one wins, as AddEntry() updates the value
+                }
+                return INI_OK;
+            }
+        }
+    }
+
+    /**
+     * The parts of the dump in order, pointing into `filecomment` and the rendered sections, which stay valid until
+     * the next modification.
+     */
+    int Render(std::vector<std::string_view> &parts, std::string &filecomment, bool add_signature) const
+    {
+        // add the UTF-8 signature if it is desired
+        if (m_is_utf8 && add_signature) {
+            parts.emplace_back(INI_UTF8_SIGNATURE);
+        }
+
+        // get all of the sections sorted in load order
+        Entries oSections;
+        GetAllSections(oSections);
+        oSections.sort(typename Entry::LoadOrder());
+
+        // if there is an empty section name, then it must be written out first
+        // regardless of the load order
+        typename Entries::iterator is = oSections.begin();
+        for (; is != oSections.end(); ++is) {
+            if (!*is->item) {
+                // move the empty section name to the front of the section list
+                if (is != oSections.begin()) {
+                    oSections.splice(oSections.begin(), oSections, is, std::next(is));
+                }
+                break;
+            }
+        }
+
+        // write the file comment if we have one
+        bool neednewline = false;
+        if (m_filecomment) {
+            if (!OutputMultiLineText(filecomment, m_filecomment)) {
+                return INI_FAIL;
+            }
+            parts.emplace_back(filecomment);
+            neednewline = true;
+        }
+
+        // iterate through our sections, rendering those modified since the last dump
+        typename Entries::const_iterator iSection = oSections.begin();
+        for (; iSection != oSections.end(); ++iSection) {
+            auto rendered = m_rendered.find(iSection->item);
+            if (rendered == m_rendered.end()) {
+                rendered = m_rendered.emplace(iSection->item, std::string()).first;
+                if (!RenderSection(rendered->second, *iSection)) {
+                    m_rendered.erase(rendered);
+                    return INI_FAIL;
+                }
+            }
+            if (neednewline) {
+                parts.emplace_back(INI_NEWLINE INI_NEWLINE);
+            }
+            parts.emplace_back(rendered->second);
+            neednewline = true;
+        }
+
+        return INI_OK;
+    }
+
+    bool RenderSection(std::string &dumpped, const Entry &section) const
+    {
+        // write out the comment if there is one
+        if (section.comment) {
+            if (!OutputMultiLineText(dumpped, section.comment)) {
+                return false;
+            }
+        }
+
+        // write the section (unless there is no section name)
+        if (*section.item) {
+            dumpped += "[";
+            dumpped += section.item;
+            dumpped += "]";
+            dumpped += INI_NEWLINE;
+        }
+
+        // get all of the keys sorted in load order
+        Entries oKeys;
+        GetAllKeys(section.item, oKeys);
+        oKeys.sort(typename Entry::LoadOrder());
+
+        // write all keys and values
+        typename Entries::const_iterator iKey = oKeys.begin();
+        for (; iKey != oKeys.end(); ++iKey) {
+            // get all values for this key
+            Entries oValues;
+            GetAllValues(section.item, iKey->item, oValues);
+
+            typename Entries::const_iterator iValue = oValues.begin();
+            for (; iValue != oValues.end(); ++iValue) {
+                // write out the comment if there is one
+                if (iValue->comment) {
+                    dumpped += INI_NEWLINE;
+                    if (!OutputMultiLineText(dumpped, iValue->comment)) {
+                        return false;
+                    }
+                }
+
+                // write the key
+                dumpped += iKey->item;
+                PARSERS_TRACE("Dump Key = %s", iKey->item);
+
+                // write the value
+                dumpped += m_add_spaces ? " = " : "=";
+                if (m_allow_multiline && IsMultiLineData(iValue->item)) {
+                    // multi-line data needs to be processed specially to ensure
+                    // that we use the correct newline format for the current system
+                    dumpped += "<<<END_OF_TEXT" INI_NEWLINE;
+                    if (!OutputMultiLineText(dumpped, iValue->item)) {
+                        return false;
+                    }
+                    PARSERS_TRACE("Dump Value = %s", iValue->item);
+                    dumpped += "END_OF_TEXT";
+                } else {
+                    dumpped += iValue->item;
+                }
+                dumpped += INI_NEWLINE;
+            }
+        }
+        return true;
+    }
+
+    /** Forget the rendering of a modified section, or of all of them if `section` is NULL */
+    void Touch(const char *section)
+    {
+        m_dirty = true;
+        if (!m_rendered.empty()) {
+            if (section) {
+                m_rendered.erase(section);
+            } else {
+                m_rendered.clear();
+            }
+        }
+    }
+
+    int WriteFile(const char *file, bool add_signature) const
+    {
+        std::lock_guard<std::mutex> lock(m_rendering);
+        struct stat st;
+        if (!m_dirty && m_written.path == file && stat(file, &st) == 0 && st.st_ino == m_written.inode
+            && st.st_size == m_written.size && st.st_mtim.tv_sec == m_written.mtime.tv_sec
+            && st.st_mtim.tv_nsec == m_written.mtime.tv_nsec && add_signature == m_written.signature) {
+            return INI_OK;
+        }
+
+        std::vector<std::string_view> parts;
+        std::string filecomment;
+        int rc = Render(parts, filecomment, add_signature);
+        if (rc != INI_OK) {
+            return rc;
+        }
+
+        /**
+         * A fresh file of our own next to `file`, never one planted there nor one of another writer. The file replaced
+         * keeps its permissions, and its owner where permitted, the new one is private until then so that nobody
+         * opens it meanwhile.
+         */
+        struct stat existing;
+        bool replacing = stat(file, &existing) == 0;
+        std::string tmpfile;
+        int fd = -1;
+        static std::atomic<uint64_t> saves{0};
+        for (int attempt = 0; fd < 0 && attempt < 100; attempt++) {
+            tmpfile = std::string(file) + ".saving." + std::to_string(getpid()) + "."
+                      + std::to_string(saves++ ^ std::chrono::steady_clock::now().time_since_epoch().count());
+            fd = open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, replacing ? 0600 : 0666);
+            if (fd < 0 && errno != EEXIST) {
+                return -errno;
+            }
+        }
+        if (fd < 0) {
+            return -EEXIST;
+        }
+        if (replacing) {
+            if ((existing.st_uid != geteuid() || existing.st_gid != getegid())
+                && fchown(fd, existing.st_uid, existing.st_gid) != 0) {
+                [[maybe_unused]] int ignored = fchown(fd, -1, existing.st_gid); // unprivileged, the group at least
+            }
+            if (fchmod(fd, existing.st_mode & 07777) != 0) {
+                rc = -errno;
+            }
+        }
+        std::vector<struct iovec> iov;
+        for (size_t i = 0; i < parts.size() && rc == INI_OK; i += iov.size()) {
+            iov.clear();
+            for (size_t k = i; k < parts.size() && iov.size() < IOV_MAX; k++) {
+                iov.push_back({const_cast<char *>(parts[k].data()), parts[k].size()});
+            }
+            rc = WriteAll(fd, iov);
+        }
+        if (rc == INI_OK && fsync(fd) != 0) {
+            rc = -errno;
+        }
+        if (close(fd) != 0 && rc == INI_OK) {
+            rc = -errno;
+        }
+        if (rc == INI_OK && rename(tmpfile.c_str(), file) != 0) {
+            rc = -errno;
+        }
+        if (rc != INI_OK) {
+            unlink(tmpfile.c_str());
+            return rc;
+        }
+
+        // the rename is only durable once the directory is synced
+        std::string directory(file, strrchr(file, '/') ? strrchr(file, '/') - file + 1 : 0);
+        if (int dirfd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            dirfd >= 0) {
+            fsync(dirfd);
+            close(dirfd);
+        }
+        if (stat(file, &st) == 0) {
+            m_written = Written{file, st.st_ino, st.st_size, st.st_mtim, add_signature};
+            m_dirty = false;
+        }
+        return INI_OK;
+    }
+
+    /** writev() all of `iov`, resuming after partial writes */
+    static int WriteAll(int fd, std::vector<struct iovec> &iov)
+    {
+        struct iovec *next = iov.data(), *end = iov.data() + iov.size();
+        while (next < end) {
+            ssize_t n = writev(fd, next, static_cast<int>(end - next));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -errno;
+            }
+            for (size_t left = static_cast<size_t>(n); left > 0 || (next < end && next->iov_len == 0);) {
+                size_t done = std::min(left, next->iov_len);
+                next->iov_base = static_cast<char *>(next->iov_base) + done;
+                next->iov_len -= done;
+                left -= done;
+                if (next->iov_len == 0) {
+                    ++next;
+                }
+            }
+        }
+        return INI_OK;
+    }
+
+    /** Build the section/key maps from the records of flat mode, if not done yet */
+    void Materialize() const
+    {
+        if (!m_indexed || m_materialized.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_materializing);
+        if (!m_materialized.load(std::memory_order_relaxed)) {
+            auto *self = const_cast<SimpleINIParser *>(this);
+            for (const Record &record : m_records) {
+                self->AddEntry(record.section, record.key, record.value, record.comment, false, false);
+            }
+            m_materialized.store(true, std::memory_order_release);
+        }
+    }
+
+    /** Leave flat mode before a modification, the maps become the only copy */
+    void Thaw()
+    {
+        if (m_indexed) {
+            Materialize();
+            m_indexed = false;
+            m_records = std::vector<Record>();
+            m_index = std::vector<Slot>();
+            m_used = 0;
+        }
+    }
+
+    /** Parse `length` bytes of NUL-terminated text, which must live as long as the entries unless `needcopy` */
+    int Parse(char *pdata, size_t length, bool needcopy)
+    {
+        details::StructuralIndex structurals;
+        m_structurals = structurals.Build(pdata, length) ? &structurals : NULL;
+        int rc = ParseEntries(pdata, needcopy);
+        m_structurals = NULL;
+        return rc;
+    }
+
+    int ParseEntries(char *pdata, bool needcopy)
+    {
+        const static char empty = 0;
+        char *pnext = pdata;
+        const char *psection = &empty;
+        const char *pkey = NULL, *pvalue = NULL, *comment = NULL;
+
+        // find a file comment if it exists, this is a comment that starts at the
+        // beginning of the file and continues until the first blank line.
+        int rc = FindFileComment(pnext, needcopy);
+        if (rc < 0) return rc;
+
+        // add every entry in the file to the data table
+        if (m_capturing) {
+            while (FindEntry(pnext, psection, pkey, pvalue, comment)) {
+                m_parsed.push_back(Parsed{psection, pkey, pvalue, comment});
+            }
+            return INI_OK;
+        }
+        if (m_flat && !needcopy) {
+            m_indexed = true;
+            while (FindEntry(pnext, psection, pkey, pvalue, comment)) {
+                rc = AddRecord(psection, pkey, pvalue, comment);
+                if (rc < 0) return rc;
+            }
+            return INI_OK;
+        }
+        while (FindEntry(pnext, psection, pkey, pvalue, comment)) {
+            rc = AddEntry(psection, pkey, pvalue, comment, false, needcopy);
+            if (rc < 0) return rc;
+        }
+        return INI_OK;
+    }
+
+    /** See SetIncludes(), the files of a level of the include tree are parsed in parallel */
+    int LoadIncluding(const char *file)
+    {
+        struct Node {
+            std::string path;
+            std::unique_ptr<SimpleINIParser> parser;
+            int rc;
+            std::vector<std::vector<size_t>> includes; //!> nodes matched by each directive
+        };
+        std::vector<Node> nodes;
+        std::set<std::string> loaded;
+        auto add = [&nodes, &loaded](const std::string &path) {
+            char *resolved = realpath(path.c_str(), NULL);
+            bool inserted = loaded.insert(resolved ? resolved : path).second;
+            free(resolved);
+            if (inserted) {
+                nodes.push_back(Node{path, NULL, INI_OK, {}});
+            }
+            return inserted;
+        };
+        add(file);
+
+        for (size_t begin = 0, end = 1; begin < end; begin = end, end = nodes.size()) {
+            for (size_t i = begin; i < end; i++) {
+                Node &node = nodes[i];
+                node.parser.reset(new SimpleINIParser(m_is_utf8, m_allow_multikey, m_allow_multiline));
+                node.parser->m_flat = true; // mapped and parsed in place
+                node.parser->m_capturing = true;
             }
 
-            // done now if the section is not empty or we are not pruning away
-            // the empty sections. Otherwise let it fall through into the section
-            // deletion code
-            if (!remove_empty || !sectionit->second.empty()) {
-                return true;
+            multiprocessing::parallel_for(m_executor, end - begin, [&nodes, begin](size_t k) {
+                Node &node = nodes[begin + k];
+                node.rc = node.parser->LoadFile(node.path.c_str());
+            });
+
+            for (size_t i = begin; i < end; i++) {
+                if (nodes[i].rc < 0) {
+                    return nodes[i].rc;
+                }
+                std::string directory = nodes[i].path.substr(0, nodes[i].path.rfind('/') + 1);
+                for (const Parsed &parsed : nodes[i].parser->m_parsed) {
+                    if (parsed.section) {
+                        continue;
+                    }
+                    std::string pattern = parsed.value[0] == '/' ? parsed.value : directory + parsed.value;
+                    std::vector<size_t> children;
+                    glob_t matched;
+                    int rc = glob(pattern.c_str(), GLOB_ERR, NULL, &matched);
+                    if (rc != 0 && (rc != GLOB_NOMATCH || strpbrk(parsed.value, "*?[") == NULL)) {
+                        globfree(&matched);
+                        return rc == GLOB_NOSPACE ? INI_NOMEM : INI_FILE; // missing file, or unreadable directory
+                    }
+                    for (size_t k = 0; rc == 0 && k < matched.gl_pathc; k++) {
+                        if (add(matched.gl_pathv[k])) {
+                            children.push_back(nodes.size() - 1);
+                        }
+                    }
+                    globfree(&matched);
+                    nodes[i].includes.push_back(std::move(children));
+                }
             }
+        }
+
+        // merge in load order, whatever the order the files were parsed in
+        bool flat = m_flat && !m_text && m_included.empty() && IsEmpty();
+        if (flat) {
+            m_indexed = true;
         } else {
-            // delete all copied strings from this section. The actual
-            // entries will be removed when the section is removed.
-            typename Pairs::iterator pairit = sectionit->second.begin();
-            for (; pairit != sectionit->second.end(); ++pairit) {
-                DeleteString(pairit->first.item);
-                DeleteString(pairit->second);
+            Thaw();
+        }
+        std::function<int(size_t)> merge = [&](size_t i) -> int {
+            size_t directive = 0;
+            for (const Parsed &parsed : nodes[i].parser->m_parsed) {
+                int rc = INI_OK;
+                if (!parsed.section) {
+                    for (size_t child : nodes[i].includes[directive++]) {
+                        rc = merge(child);
+                        if (rc < 0) return rc;
+                    }
+                } else if (flat) {
+                    rc = AddRecord(parsed.section, parsed.key, parsed.value, parsed.comment);
+                } else {
+                    rc = AddEntry(parsed.section, parsed.key, parsed.value, parsed.comment, false, false);
+                }
+                if (rc < 0) return rc;
             }
+            nodes[i].parser->m_parsed = std::vector<Parsed>();
+            return INI_OK;
+        };
+        int rc = merge(0);
+        if (!m_filecomment) {
+            m_filecomment = nodes[0].parser->m_filecomment;
+        }
+        if (nodes[0].parser->m_is_utf8) {
+            m_is_utf8 = true;
         }
+        for (Node &node : nodes) {
+            m_included.push_back(std::move(node.parser)); // entries point into their text
+        }
+        return rc;
+    }
 
-        // delete the section itself
-        DeleteString(sectionit->first.item);
-        m_data.erase(sectionit);
+    /**
+     * Map the file privately, writable so that it can be parsed in place, with a zero page behind in case the file
+     * ends on a page boundary: the text is always NUL-terminated.
+     */
+    int MapFile(const char *file)
+    {
+        // non blocking, so that a FIFO is rejected below instead of waiting for a writer
+        int fd = open(file, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return INI_FILE;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return INI_FILE;
+        }
+        if (st.st_size == 0) {
+            close(fd);
+            return INI_OK;
+        }
+        size_t size = static_cast<size_t>(st.st_size), pagesize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t length = (size + 1 + pagesize - 1) / pagesize * pagesize;
+        void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return INI_NOMEM;
+        }
+        if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, fd, 0) == MAP_FAILED) {
+            munmap(base, length);
+            close(fd);
+            return INI_FILE;
+        }
+        close(fd);
 
-        return true;
+        // consume the UTF-8 BOM like LoadText()
+        char *pdata = static_cast<char *>(base);
+        bool signature = size >= 3 && memcmp(pdata, INI_UTF8_SIGNATURE, 3) == 0;
+        if (signature) {
+            SetUnicode();
+        }
+        m_text = pdata;
+        m_textlen = size + 1;
+        m_mapped = length;
+        return signature ? Parse(pdata + 3, size - 3, false) : Parse(pdata, size, false);
     }
 
-  private:
-    // copying is not permitted
-    SimpleINIParser(const SimpleINIParser &);            // disabled
-    SimpleINIParser &operator=(const SimpleINIParser &); // disabled
-
     int FindFileComment(char *&text, bool clone)
     {
         // there can only be a single file comment
@@ -744,7 +1571,7 @@ class SimpleINIParser {
         return INI_OK;
     }
 
-    bool FindEntry(char *&text, const char *&section, const char *&key, const char *&value, const char *&comment) const
+    bool FindEntry(char *&text, const char *&section, const char *&key, const char *&value, const char *&comment)
     {
         comment = NULL;
 
@@ -765,6 +1592,27 @@ class SimpleINIParser {
                 continue;
             }
 
+            // record include directives of the files loaded by LoadIncluding()
+            if (m_capturing && strncmp(text, "@include", 8) == 0 && (text[8] == ' ' || text[8] == '\t')) {
+                char *pattern = text + 9;
+                while (*pattern == ' ' || *pattern == '\t') {
+                    ++pattern;
+                }
+                text = Seek(pattern, [this](char ch) { return IsNewLineChar(ch); });
+                pTrail = text - 1;
+                if (*text) {
+                    SkipNewLine(text);
+                }
+                while (pTrail >= pattern && IsSpace(*pTrail)) {
+                    --pTrail;
+                }
+                *++pTrail = 0;
+                if (*pattern) {
+                    m_parsed.push_back(Parsed{NULL, NULL, pattern, NULL});
+                }
+                continue;
+            }
+
             // process section names
             if (*text == '[') {
                 // skip leading spaces
@@ -776,9 +1624,7 @@ class SimpleINIParser {
                 // find the end of the section name (it may contain spaces)
                 // and convert it to lowercase as necessary
                 section = text;
-                while (*text && *text != ']' && !IsNewLineChar(*text)) {
-                    ++text;
-                }
+                text = Seek(text, [this](char ch) { return ch == ']' || IsNewLineChar(ch); });
 
                 // if it's an invalid line, just skip it
                 if (*text != ']') {
@@ -795,9 +1641,7 @@ class SimpleINIParser {
 
                 // skip to the end of the line
                 ++text; // safe as checked that it == ']' above
-                while (*text && !IsNewLineChar(*text)) {
-                    ++text;
-                }
+                text = Seek(text, [this](char ch) { return IsNewLineChar(ch); });
 
                 key = NULL;
                 value = NULL;
@@ -807,9 +1651,7 @@ class SimpleINIParser {
             // find the end of the key name (it may contain spaces)
             // and convert it to lowercase as necessary
             key = text;
-            while (*text && *text != '=' && !IsNewLineChar(*text)) {
-                ++text;
-            }
+            text = Seek(text, [this](char ch) { return ch == '=' || IsNewLineChar(ch); });
 
             // if it's an invalid line, just skip it
             if (*text != '=') {
@@ -818,9 +1660,7 @@ class SimpleINIParser {
 
             // empty keys are invalid
             if (key == text) {
-                while (*text && !IsNewLineChar(*text)) {
-                    ++text;
-                }
+                text = Seek(text, [this](char ch) { return IsNewLineChar(ch); });
                 continue;
             }
 
@@ -840,9 +1680,7 @@ class SimpleINIParser {
 
             // find the end of the value which is the end of this line
             value = text;
-            while (*text && !IsNewLineChar(*text)) {
-                ++text;
-            }
+            text = Seek(text, [this](char ch) { return IsNewLineChar(ch); });
 
             // remove trailing spaces from the value
             pTrail = text - 1;
@@ -905,6 +1743,7 @@ class SimpleINIParser {
             iSection = i.first;
             inserted = true;
         }
+        Touch(iSection->first.item);
         if (!key || !value) {
             // section only entries are specified with item and pvalue as NULL
             return inserted ? INI_INSERTED : INI_UPDATED;
@@ -966,6 +1805,19 @@ class SimpleINIParser {
         return inserted ? INI_INSERTED : INI_UPDATED;
     }
 
+    /** First character at or after `text` for which `stop` is true or NUL, through the structural index if any */
+    template <typename Stop>
+    inline char *Seek(char *text, Stop stop) const
+    {
+        if (m_structurals) {
+            return m_structurals->Seek(text, stop);
+        }
+        while (*text && !stop(*text)) {
+            ++text;
+        }
+        return text;
+    }
+
     /** Is the supplied character a whitespace character? */
     inline bool IsSpace(char ch) const
     {
@@ -1122,7 +1974,7 @@ class SimpleINIParser {
 
             // find the end of this line
             pCurrLine = text;
-            while (*text && !IsNewLineChar(*text)) ++text;
+            text = Seek(text, [this](char ch) { return IsNewLineChar(ch); });
 
             // move this line down to the location that it should be if necessary
             if (pDataLine < pCurrLine) {
@@ -1204,10 +2056,8 @@ class SimpleINIParser {
                 ++endofline;
             }
             endoflinechar = *endofline;
-            *const_cast<char *>(endofline) = 0;
-            dumpped += text;
+            dumpped.append(text, endofline - text);
             dumpped += INI_NEWLINE;
-            *const_cast<char *>(endofline) = endoflinechar;
             text += (endofline - text) + 1;
         }
         return true;
@@ -1255,6 +2105,57 @@ class SimpleINIParser {
         same order that they are loaded/added.
      */
     int m_order;
+
+    /** Was flat mode asked for, and are the records and index below in use? */
+    bool m_flat, m_indexed;
+
+    /** Length of the mapping of m_text if it is a mapped file, 0 if allocated. */
+    size_t m_mapped;
+
+    /** Entries of flat mode in load order, and the open addressing index over them. */
+    std::vector<Record> m_records;
+    std::vector<Slot> m_index;
+    size_t m_used = 0;
+
+    /** Have m_data been built from the records of flat mode? */
+    mutable std::atomic<bool> m_materialized;
+    mutable std::mutex m_materializing;
+
+    /** Renderings of the sections not modified since, by section name, see DumpFile(). */
+    mutable std::unordered_map<const char *, std::string> m_rendered;
+    mutable std::mutex m_rendering;
+
+    /** Modified since the file described by m_written was written? */
+    mutable bool m_dirty = true;
+    struct Written {
+        std::string path;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+        bool signature;
+    };
+    mutable Written m_written{};
+
+    /** Nesting of BeginBatch(), and the files to write by EndBatch(), with their add_signature. */
+    int m_batching = 0;
+    mutable std::map<std::string, bool> m_pending;
+
+    /** Are "@include" lines honoured, and how are the included files parsed, inline if not set? */
+    bool m_includes = false;
+    multiprocessing::executor m_executor;
+
+    /** Is this parser loading an included file, keeping its entries and directives (NULL section) in order? */
+    struct Parsed {
+        const char *section, *key, *value, *comment;
+    };
+    bool m_capturing = false;
+    std::vector<Parsed> m_parsed;
+
+    /** Parsers of the included files, the entries point into their text. */
+    std::vector<std::unique_ptr<SimpleINIParser>> m_included;
+
+    /** Index of the text being parsed, NULL outside of Parse() or if disabled. */
+    details::StructuralIndex *m_structurals = NULL;
 };
 
 /**
@@ -1301,7 +2202,8 @@ class Reloading {
   public:
     template <typename... Args>
     Reloading(time_t interval, Args... args)
-        : ping(args...), pong(args...), m_isping(true), m_reloading(false), m_interval(interval), m_reloaded_time(0)
+        : ping(args...), pong(args...), m_isping(true), m_reloading(false), m_changed(false), m_watch(0),
+          m_interval(interval), m_reloaded_time(0)
     {
         ping.Reload();
         m_reloaded_time = time(nullptr);
@@ -1313,15 +2215,40 @@ class Reloading {
         m_interval = seconds;
     }
 
+    /**
+     * Reload when `path` changes, as told by watching::Watcher, instead of every interval.
+     */
+    int Watch(const std::string &path)
+    {
+        int id = watching::Watch(path, [this](const std::string &) {
+            m_changed.store(true, std::memory_order_relaxed);
+        });
+        if (int previous = id > 0 ? m_watch.exchange(id) : 0; previous > 0) {
+            watching::Unwatch(previous);
+        }
+        return id < 0 ? id : 0;
+    }
+
+    ~Reloading()
+    {
+        if (int id = m_watch.exchange(0); id > 0) {
+            watching::Unwatch(id);
+        }
+    }
+
     T &GetActivated()
     {
         // start thread to switch config only if no worker running in background
-        if (!m_reloading && m_reloaded_time + m_interval <= time(nullptr)) {
+        if (!m_reloading
+            && (m_watch > 0 ? m_changed.load(std::memory_order_relaxed)
+                            : m_reloaded_time + m_interval <= time(nullptr))) {
             bool expected = false;
             if (m_reloading.compare_exchange_strong(expected, true, std::memory_order_release,
                                                     std::memory_order_relaxed)) {
+                m_changed.store(false, std::memory_order_relaxed);
                 std::thread([this]() {
-                    auto elasped = [starttime = std::chrono::steady_clock::now()]() {
+                    PARSERS_SPAN("lemon::Reloading::Reload");
+                    [[maybe_unused]] auto elasped = [starttime = std::chrono::steady_clock::now()]() {
                         auto duration = std::chrono::steady_clock::now() - starttime;
                         return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
                     };
@@ -1363,6 +2290,8 @@ class Reloading {
     T ping, pong;                       // double buffering for reloading
     std::atomic_bool m_isping;          // true if ping selected
     std::atomic_bool m_reloading;       // true if reloading in background
+    std::atomic_bool m_changed;         // true if the watched file changed since the last reload
+    std::atomic<int> m_watch;           // watching::Watcher id, 0 if polling
     time_t m_interval, m_reloaded_time; // reloading interval and last reloaded time
 };
 
@@ -1372,7 +2301,8 @@ using INICaseParser = typename lemon::SimpleINIParser<INI_GenericCase>;
 template <typename Compare>
 class INIFile {
   public:
-    INIFile(std::string file) : m_file(std::move(file)), m_isping(true)
+    INIFile(std::string file)
+        : m_file(std::move(file)), m_isping(true), m_reloading(false), m_changed(false), m_watch(0), m_interval(1)
     {
         m_ping.LoadFile(m_file.c_str());
         m_reloaded_time = m_modified_time = time(nullptr);
@@ -1384,16 +2314,40 @@ class INIFile {
         m_interval = seconds;
     }
 
+    /**
+     * Reload as soon as the file changes, as told by watching::Watcher, instead of stat() every interval.
+     */
+    int Watch()
+    {
+        int id = watching::Watch(m_file, [this](const std::string &) {
+            m_changed.store(true, std::memory_order_relaxed);
+        });
+        if (int previous = id > 0 ? m_watch.exchange(id) : 0; previous > 0) {
+            watching::Unwatch(previous);
+        }
+        return id < 0 ? id : 0;
+    }
+
+    ~INIFile()
+    {
+        if (int id = m_watch.exchange(0); id > 0) {
+            watching::Unwatch(id);
+        }
+    }
+
     SimpleINIParser<Compare> &GetActivated()
     {
         // start thread to switch config only if no worker running in background
-        if (!m_reloading && m_reloaded_time + m_interval <= time(nullptr)) {
+        if (!m_reloading
+            && (m_watch > 0 ? m_changed.load(std::memory_order_relaxed)
+                            : m_reloaded_time + m_interval <= time(nullptr))) {
             bool expected = false;
             if (m_reloading.compare_exchange_strong(expected, true, std::memory_order_release,
                                                     std::memory_order_relaxed)) {
-                if (IsModified()) {
+                if (m_watch > 0 ? m_changed.exchange(false, std::memory_order_relaxed) : IsModified()) {
                     std::thread([this]() {
-                        auto elasped = [starttime = std::chrono::steady_clock::now()]() {
+                        PARSERS_SPAN("lemon::INIFile::Reload");
+                        [[maybe_unused]] auto elasped = [starttime = std::chrono::steady_clock::now()]() {
                             auto duration = std::chrono::steady_clock::now() - starttime;
                             return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
                         };
@@ -1453,7 +2407,372 @@ class INIFile {
 
     std::atomic_bool m_isping;                           // true if ping selected
     std::atomic_bool m_reloading;                        // true if reloading in background
+    std::atomic_bool m_changed;                          // true if the watched file changed since the last reload
+    std::atomic<int> m_watch;                            // watching::Watcher id, 0 if polling
     SimpleINIParser<Compare> m_ping, m_pong;             // double buffering for reloading
     time_t m_interval, m_reloaded_time, m_modified_time; // reloading interval and last reloaded time
 };
+
+/**
+ * Typed view of a config: keys, types and defaults are declared once and bound to the fields of `T`, which Load()
+ * fills in a single pass, reporting every missing or invalid value at once instead of at first access.
+ *
+ *     struct Settings {
+ *         std::string host;
+ *         int port;
+ *         bool verbose;
+ *     };
+ *
+ *     lemon::INISchema<Settings> schema;
+ *     schema.Add("server", "host", &Settings::host)          // required
+ *         .Add("server", "port", &Settings::port, 8080, [](int port) { return port > 0 && port < 65536; })
+ *         .Add("log", "verbose", &Settings::verbose, false);
+ *
+ *     Settings settings;
+ *     std::string error;
+ *     if (schema.Load(ini, settings, &error) != lemon::INI_OK) { ... }
+ *
+ * Integers take the forms of GetLongValue() and must fit the field, booleans the ones of GetBoolValue(); but unlike
+ * those, a value which does not parse is an error rather than silently the default. See INITypedFile for snapshots
+ * of `T` kept up to date with a file.
+ */
+template <typename T>
+class INISchema {
+    template <typename V>
+    struct Identity {
+        using type = V;
+    };
+
+  public:
+    /** Bind an optional key, `default_value` is used if it is missing or empty, `check` validates parsed values */
+    template <typename V>
+    INISchema &Add(const char *section, const char *key, V T::*field, const typename Identity<V>::type &default_value,
+                   std::function<bool(const typename Identity<V>::type &)> check = nullptr)
+    {
+        return Bind<V>(section, key, field, std::optional<V>(default_value), std::move(check));
+    }
+
+    /** Bind a required key */
+    template <typename V>
+    INISchema &Add(const char *section, const char *key, V T::*field)
+    {
+        return Bind<V>(section, key, field, std::optional<V>(), nullptr);
+    }
+
+    /**
+     * Fill `out` from `ini`, returns INI_OK, or INI_FAIL with one line per bad key in `error`. Fields of bad keys are
+     * left as they were.
+     */
+    template <typename Compare>
+    int Load(const SimpleINIParser<Compare> &ini, T &out, std::string *error = nullptr) const
+    {
+        std::string errors;
+        for (const Field &field : m_fields) {
+            const char *value = ini.GetValue(field.section.c_str(), field.key.c_str());
+            if (const char *reason = field.assign(value && *value ? value : NULL, out)) {
+                errors += "[" + field.section + "] " + field.key + ": " + reason;
+                if (value) {
+                    errors += std::string(" '") + value + "'";
+                }
+                errors += "\n";
+            }
+        }
+        if (error) {
+            *error = std::move(errors);
+            return error->empty() ? INI_OK : INI_FAIL;
+        }
+        return errors.empty() ? INI_OK : INI_FAIL;
+    }
+
+    size_t Size() const
+    {
+        return m_fields.size();
+    }
+
+  private:
+    struct Field {
+        std::string section, key;
+        std::function<const char *(const char *value, T &out)> assign; //!> the reason of a failure, NULL if none
+    };
+
+    template <typename V>
+    INISchema &Bind(const char *section, const char *key, V T::*field, std::optional<V> default_value,
+                    std::function<bool(const V &)> check)
+    {
+        auto assign = [field, default_value, check](const char *text, T &out) -> const char * {
+            V value{};
+            if (!text) {
+                if (!default_value) {
+                    return "missing";
+                }
+                value = *default_value;
+            } else if (!Parse(text, value)) {
+                return "invalid";
+            } else if (check && !check(value)) {
+                return "rejected";
+            }
+            out.*field = std::move(value);
+            return NULL;
+        };
+        m_fields.push_back(Field{section, key, std::move(assign)});
+        return *this;
+    }
+
+    static bool Parse(const char *text, std::string &value)
+    {
+        value = text;
+        return true;
+    }
+
+    static bool Parse(const char *text, bool &value)
+    {
+        static const char *const yes[] = {"true", "yes", "on", "1"}, *const no[] = {"false", "no", "off", "0"};
+        for (const char *word : yes) {
+            if (strcasecmp(text, word) == 0) {
+                return value = true;
+            }
+        }
+        for (const char *word : no) {
+            if (strcasecmp(text, word) == 0) {
+                return !(value = false);
+            }
+        }
+        return false;
+    }
+
+    template <typename V>
+    static typename std::enable_if<std::is_integral<V>::value, bool>::type Parse(const char *text, V &value)
+    {
+        bool hex = text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+        const char *digits = hex ? text + 2 : text;
+        if (!*digits || isspace(static_cast<unsigned char>(*digits))) {
+            return false;
+        }
+        char *end = NULL;
+        errno = 0;
+        if (std::is_signed<V>::value) {
+            long long parsed = strtoll(digits, &end, hex ? 16 : 10);
+            if (errno || *end || parsed < std::numeric_limits<V>::min() || parsed > std::numeric_limits<V>::max()) {
+                return false;
+            }
+            value = static_cast<V>(parsed);
+        } else {
+            unsigned long long parsed = strtoull(digits, &end, hex ? 16 : 10);
+            if (errno || *end || *digits == '-' || parsed > std::numeric_limits<V>::max()) {
+                return false;
+            }
+            value = static_cast<V>(parsed);
+        }
+        return true;
+    }
+
+    template <typename V>
+    static typename std::enable_if<std::is_floating_point<V>::value, bool>::type Parse(const char *text, V &value)
+    {
+        char *end = NULL;
+        errno = 0;
+        double parsed = strtod(text, &end);
+        if (errno || *end || end == text) {
+            return false;
+        }
+        value = static_cast<V>(parsed);
+        return true;
+    }
+
+    std::vector<Field> m_fields;
+};
+
+namespace details
+{
+/**
+ * Publication of immutable snapshots of whatever `Value` loads from a file, `Value` being constructible from the
+ * extra arguments of the constructor and providing `int Load(const std::string &file, std::string &error)` which
+ * returns INI_OK or fills `error`. The snapshots are those of caches::SnapshotReloading, which only reloads the file
+ * once it looks modified, or on Reload(). See INISnapshotFile and INITypedFile.
+ */
+template <typename Value>
+class SnapshotFile {
+    /* what the buffers of a SnapshotFile share */
+    struct File {
+        std::string path;
+        struct stat modified = {};
+        std::atomic<bool> forced{true}; // the first load, or Reload()
+        std::mutex mutex;
+        std::string error; // of the last load
+
+        explicit File(std::string path) : path(std::move(path)) {}
+
+        bool IsModified()
+        {
+            // nanoseconds, size and inode, to not miss writes within a second or files replaced by rename
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0) {
+                bool changed = st.st_mtim.tv_sec != modified.st_mtim.tv_sec
+                               || st.st_mtim.tv_nsec != modified.st_mtim.tv_nsec || st.st_size != modified.st_size
+                               || st.st_ino != modified.st_ino;
+                modified = st;
+                return changed;
+            }
+            return false;
+        }
+    };
+
+    /* a buffer of caches::SnapshotReloading, Reload() returns non-zero if the file is unmodified or fails to load */
+    struct Loaded : public Value {
+        template <typename... Args>
+        Loaded(std::shared_ptr<File> file, Args... args) : Value(args...), file(std::move(file))
+        {
+        }
+
+        int Reload()
+        {
+            bool modified = file->IsModified();
+            if (!file->forced.exchange(false) && !modified) {
+                return -1;
+            }
+            PARSERS_SPAN("lemon::SnapshotFile::Reload");
+            std::string error;
+            int rc = this->Load(file->path, error);
+            if (rc != INI_OK) {
+                PARSERS_TRACE("loading %s failed: %s", file->path.c_str(), error.c_str());
+            }
+            std::lock_guard<std::mutex> lock(file->mutex);
+            file->error = std::move(error);
+            return rc == INI_OK ? 0 : rc;
+        }
+
+        std::shared_ptr<File> file;
+    };
+
+  public:
+    using Snapshot = typename caches::SnapshotReloading<Loaded>::Snapshot;
+
+    template <typename... Args>
+    SnapshotFile(std::string file, time_t interval, Args... args)
+        : m_file(std::make_shared<File>(std::move(file))), m_snapshots(interval, m_file, args...)
+    {
+    }
+
+    /**
+     * Zero disables periodic checks, leaving only the reloads requested by Reload().
+     */
+    void SetInterval(time_t seconds)
+    {
+        m_snapshots.SetInterval(seconds);
+    }
+
+    /**
+     * Ask the worker to reload now even if the file looks unmodified, without waiting for it.
+     */
+    void Reload()
+    {
+        m_file->forced = true;
+        m_snapshots.Reload();
+    }
+
+    /**
+     * Reload as soon as the file changes, as told by watching::Watcher, use SetInterval(0) to stop polling.
+     */
+    int Watch()
+    {
+        return m_snapshots.Watch(m_file->path);
+    }
+
+    Snapshot GetSnapshot() const
+    {
+        return m_snapshots.GetSnapshot();
+    }
+
+    /**
+     * Why the last load failed, empty if it succeeded. A failed reload leaves the previous snapshot published.
+     */
+    std::string GetError() const
+    {
+        std::lock_guard<std::mutex> lock(m_file->mutex);
+        return m_file->error;
+    }
+
+  private:
+    std::shared_ptr<File> m_file;
+    caches::SnapshotReloading<Loaded> m_snapshots;
+};
+
+template <typename Compare>
+struct SnapshotParser : public SimpleINIParser<Compare> {
+    int Load(const std::string &file, std::string &error)
+    {
+        this->Reset();
+        int rc = this->LoadFile(file.c_str());
+        if (rc != INI_OK) {
+            error = "LoadFile() = " + std::to_string(rc) + ", errno = " + std::to_string(errno);
+        }
+        return rc;
+    }
+};
+} // namespace details
+
+/**
+ * Like INIFile, but readers pin an immutable snapshot of the parser instead of borrowing a buffer that a later
+ * reload may overwrite under them. A single worker checks the file every `interval` seconds (or on Reload()),
+ * parses it into the parser readers left, publishes it and retires the previous one, which is reused once the grace
+ * period of lockfree::atomic_epoch has elapsed.
+ *
+ *     static lemon::INISnapshotFile<lemon::INI_GenericNoCase> config("demo.ini");
+ *     auto snapshot = config.GetSnapshot(); // wait-free
+ *     snapshot->GetValue("section", "key"); // unchanged until snapshot is destroyed
+ *
+ * Snapshots are meant to be short lived: holding one delays every reload.
+ */
+template <typename Compare>
+class INISnapshotFile : public details::SnapshotFile<details::SnapshotParser<Compare>> {
+  public:
+    INISnapshotFile(std::string file, time_t interval = 1)
+        : details::SnapshotFile<details::SnapshotParser<Compare>>(std::move(file), interval)
+    {
+    }
+};
+
+namespace details
+{
+template <typename T, typename Compare>
+struct TypedSnapshot : public T {
+    explicit TypedSnapshot(std::shared_ptr<const INISchema<T>> schema) : T(), schema(std::move(schema)) {}
+
+    int Load(const std::string &file, std::string &error)
+    {
+        SimpleINIParser<Compare> ini;
+        ini.SetFlat();
+        int rc = ini.LoadFile(file.c_str());
+        if (rc != INI_OK) {
+            error = "LoadFile() = " + std::to_string(rc) + ", errno = " + std::to_string(errno);
+            return rc;
+        }
+        T loaded = T();
+        if ((rc = schema->Load(ini, loaded, &error)) == INI_OK) {
+            static_cast<T &>(*this) = std::move(loaded);
+        }
+        return rc;
+    }
+
+    std::shared_ptr<const INISchema<T>> schema;
+};
+} // namespace details
+
+/**
+ * Snapshots of `T` filled by an INISchema, published like INISnapshotFile: the file is parsed and validated once per
+ * (re)load, and reads are plain loads of fields. A file that fails validation is not published, GetError() tells
+ * why; if that is the first load, the snapshot holds a default constructed `T`.
+ *
+ *     static lemon::INITypedFile<Settings> settings("app.ini", schema);
+ *     int port = settings.GetSnapshot()->port;
+ */
+template <typename T, typename Compare = INI_GenericNoCase>
+class INITypedFile : public details::SnapshotFile<details::TypedSnapshot<T, Compare>> {
+  public:
+    INITypedFile(std::string file, const INISchema<T> &schema, time_t interval = 1)
+        : details::SnapshotFile<details::TypedSnapshot<T, Compare>>(std::move(file), interval,
+                                                                      std::make_shared<const INISchema<T>>(schema))
+    {
+    }
+};
 } // namespace lemon
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace lockfree
+{
+/**
+ * Epoch based reclamation for objects published through an atomic pointer.
+ *
+ * Readers bracket their accesses with enter()/leave(), which is wait-free once the thread has a record. A writer
+ * swaps the pointer, calls advance() and may destroy or reuse the old object once quiescent() holds for the epoch
+ * advance() returned, i.e. once every reader that could have loaded the old pointer has left.
+ *
+ *     // reader                                  // writer
+ *     epochs.enter();                            T *old = current.exchange(next);
+ *     use(current.load());                       uint64_t epoch = epochs.advance();
+ *     epochs.leave();                            while (!epochs.quiescent(epoch)) wait();
+ *                                                delete old;
+ *
+ * Every operation on the epoch and the records is sequentially consistent, so that a reader either announced its
+ * epoch before the writer scanned the records or loads the new pointer. Records belong to threads, are reused once
+ * their thread exits, and are never freed.
+ */
+class atomic_epoch {
+  public:
+    static atomic_epoch &instance()
+    {
+        static atomic_epoch domain;
+        return domain;
+    }
+
+    /**
+     * Nested calls on a thread are fine, only the outermost pair announces the thread.
+     */
+    void enter()
+    {
+        record *r = local();
+        if (r->nesting++ == 0) {
+            r->epoch.store(global.load());
+        }
+    }
+
+    void leave()
+    {
+        record *r = local();
+        if (--r->nesting == 0) {
+            r->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Start a new epoch, the returned value is the one to wait for objects unpublished before the call.
+     */
+    uint64_t advance()
+    {
+        return global.fetch_add(1) + 1;
+    }
+
+    /**
+     * True if no reader has been inside since before `epoch` started.
+     */
+    bool quiescent(uint64_t epoch) const
+    {
+        for (record *r = records.load(); r != nullptr; r = r->next) {
+            uint64_t announced = r->epoch.load();
+            if (announced != 0 && announced < epoch) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    struct alignas(64) record {
+        std::atomic<uint64_t> epoch{0}; //!> 0 if the owner is outside
+        std::atomic<bool> used{true};
+        record *next{nullptr};
+        size_t nesting{0}; //!> touched by the owner only
+    };
+
+    atomic_epoch() : global(1), records(nullptr) {}
+
+    record *local()
+    {
+        struct holder {
+            record *r = nullptr;
+            ~holder()
+            {
+                if (r != nullptr) {
+                    r->epoch.store(0, std::memory_order_release);
+                    r->nesting = 0;
+                    r->used.store(false, std::memory_order_release);
+                }
+            }
+        };
+        static thread_local record *cached = nullptr;
+        if (cached == nullptr) {
+            static thread_local holder owner;
+            owner.r = acquire();
+            cached = owner.r;
+        }
+        return cached;
+    }
+
+    record *acquire()
+    {
+        for (record *r = records.load(); r != nullptr; r = r->next) {
+            bool used = false;
+            if (!r->used.load(std::memory_order_relaxed)
+                && r->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                return r;
+            }
+        }
+        record *r = new record;
+        r->next = records.load(std::memory_order_relaxed);
+        while (!records.compare_exchange_weak(r->next, r)) {
+        }
+        return r;
+    }
+
+    std::atomic<uint64_t> global;
+    std::atomic<record *> records;
+};
+} // namespace lockfree
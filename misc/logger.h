@@ -0,0 +1,567 @@
+/**
+ * Copyright 2022 Kiran Nowak(kiran.nowak@gmail.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+
+/**
+ * Asynchronous logger: the calling thread only copies the format string pointer and raw arguments into a ring of its
+ * own, a background thread merges the rings by time, formats, timestamps and writes them in batches.
+ *
+ *     LOGGER_INFO("worker %zu picked task %u", id, task);
+ *
+ * Formats are printf's, and checked by the compiler. Strings are copied at the call, every other argument is kept as
+ * its raw bytes until formatting. Levels below LOGGER_LEVEL are compiled out. A thread whose ring is full drops the
+ * record instead of waiting, and the number of drops is logged once there is room again, unless SetBlocking(true).
+ */
+
+#define LOGGER_LEVEL_TRACE 0
+#define LOGGER_LEVEL_DEBUG 1
+#define LOGGER_LEVEL_INFO  2
+#define LOGGER_LEVEL_WARN  3
+#define LOGGER_LEVEL_ERROR 4
+
+#ifndef LOGGER_LEVEL
+#define LOGGER_LEVEL LOGGER_LEVEL_TRACE
+#endif
+
+#ifndef LOCATION
+#define TOSTRING(line) #line
+#define LOCATION(file, line) \
+    &file ":" TOSTRING(line)[(__builtin_strrchr(file, '/') ? (__builtin_strrchr(file, '/') - file + 1) : 0)]
+#endif
+
+#define LOGGER_LOG(level, fmt, ...)                                                 \
+    do {                                                                            \
+        if constexpr ((level) >= LOGGER_LEVEL) {                                    \
+            if (false) {                                                            \
+                printf(fmt, ##__VA_ARGS__);                                         \
+            }                                                                       \
+            logging::Log((level), fmt, LOCATION(__FILE__, __LINE__), ##__VA_ARGS__); \
+        }                                                                           \
+    } while (0)
+
+#define LOGGER_TRACE(fmt, ...) LOGGER_LOG(LOGGER_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+#define LOGGER_DEBUG(fmt, ...) LOGGER_LOG(LOGGER_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOGGER_INFO(fmt, ...)  LOGGER_LOG(LOGGER_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOGGER_WARN(fmt, ...)  LOGGER_LOG(LOGGER_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOGGER_ERROR(fmt, ...) LOGGER_LOG(LOGGER_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+namespace logging
+{
+class Logger;
+
+namespace details
+{
+template <typename T>
+using Stored = std::decay_t<T>;
+
+template <typename T>
+constexpr bool is_string_v = std::is_same_v<Stored<T>, char *> || std::is_same_v<Stored<T>, const char *>;
+
+/**
+ * Bytes needed to keep an argument, strings are copied with their terminating null.
+ */
+template <typename T>
+inline size_t Size(const T &value)
+{
+    if constexpr (is_string_v<T>) {
+        const char *s = value;
+        return (s ? strlen(s) : 6) + 1;
+    } else {
+        static_assert(std::is_trivially_copyable_v<Stored<T>>, "arguments must be printf-able");
+        return sizeof(Stored<T>);
+    }
+}
+
+template <typename T>
+inline char *Store(char *p, const T &value)
+{
+    if constexpr (is_string_v<T>) {
+        const char *s = value;
+        s = s ? s : "(null)";
+        size_t size = strlen(s) + 1;
+        memcpy(p, s, size);
+        return p + size;
+    } else {
+        Stored<T> copy = value;
+        memcpy(p, &copy, sizeof(copy));
+        return p + sizeof(copy);
+    }
+}
+
+template <typename T>
+inline auto Load(const char *&p)
+{
+    if constexpr (is_string_v<T>) {
+        const char *s = p;
+        p += strlen(s) + 1;
+        return s;
+    } else {
+        Stored<T> value;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+}
+
+/**
+ * Format a record kept by Store(), instantiated per argument list at the call site.
+ */
+template <typename... Args>
+int Format(char *out, size_t size, const char *fmt, const char *data)
+{
+    const char *p = data;
+    std::tuple<decltype(Load<Args>(p))...> values{Load<Args>(p)...};
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+    return std::apply(
+        [&](auto... args) {
+            return snprintf(out, size, fmt, args...);
+        },
+        values);
+#pragma GCC diagnostic pop
+}
+
+struct Record {
+    uint32_t size;    //!> bytes of the record including arguments, a multiple of 8
+    uint32_t padding; //!> non-zero if the record only skips the end of the ring
+    int level;
+    uint64_t timestamp; //!> CLOCK_REALTIME in nanoseconds
+    const char *fmt;
+    const char *location;
+    int (*format)(char *, size_t, const char *, const char *);
+};
+
+/**
+ * Single-producer/single-consumer byte ring holding records of one thread.
+ */
+class Ring {
+  public:
+    explicit Ring(size_t capacity)
+        : dropped(0), buffer(capacity), mask(capacity - 1), head(0), reserved(0), tail(0), cached_tail(0),
+          retired(false)
+    {
+    }
+
+    /**
+     * Reserve `size` (a multiple of 8) contiguous bytes, or nullptr if the ring is full.
+     */
+    char *Reserve(size_t size)
+    {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        size_t offset = position & mask, to_end = buffer.size() - offset;
+        size_t needed = size > to_end ? to_end + size : size;
+        if (position + needed - cached_tail > buffer.size()) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (position + needed - cached_tail > buffer.size()) {
+                return nullptr;
+            }
+        }
+        if (size > to_end) {
+            Record *skip = reinterpret_cast<Record *>(&buffer[offset]);
+            skip->size = static_cast<uint32_t>(to_end);
+            skip->padding = 1;
+            position += to_end;
+        }
+        reserved = position + size;
+        return &buffer[position & mask];
+    }
+
+    void Commit()
+    {
+        head.store(reserved, std::memory_order_release);
+    }
+
+    size_t Capacity() const
+    {
+        return buffer.size();
+    }
+
+    size_t Used() const
+    {
+        return head.load(std::memory_order_relaxed) - cached_tail;
+    }
+
+    std::atomic<uint64_t> dropped; //!> records given up since the consumer last looked
+
+  private:
+    friend class logging::Logger;
+
+    std::vector<char> buffer;
+    const size_t mask;
+    alignas(64) std::atomic<uint64_t> head;
+    uint64_t reserved;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t cached_tail;
+    std::atomic<bool> retired;
+};
+} // namespace details
+
+/**
+ * The background consumer, see LOGGER_LOG for usage.
+ */
+class Logger {
+  public:
+    static Logger &Instance()
+    {
+        static Logger instance;
+        return instance;
+    }
+
+    /**
+     * Send output to `fd` instead of stdout, the caller keeps the ownership.
+     */
+    void SetOutput(int fd)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        output = fd;
+    }
+
+    /**
+     * Ring size of threads logging for the first time after this call, rounded up to a power of 2.
+     */
+    void SetRingSize(size_t size)
+    {
+        size_t capacity = 1024;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        ring_size.store(capacity, std::memory_order_relaxed);
+    }
+
+    /**
+     * Let threads whose ring is full wait for room rather than drop records.
+     */
+    void SetBlocking(bool blocking)
+    {
+        this->blocking.store(blocking, std::memory_order_relaxed);
+    }
+
+    bool Blocking() const
+    {
+        return blocking.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Block until everything logged before the call has been written.
+     */
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!consumer.joinable()) {
+            return;
+        }
+        uint64_t target = requested + 1;
+        requested = target;
+        wakeup.notify_one();
+        while (completed < target) {
+            flushed.wait_for(lock, IDLE_INTERVAL);
+        }
+    }
+
+    details::Ring *Local()
+    {
+        struct Holder {
+            std::shared_ptr<details::Ring> ring;
+            ~Holder()
+            {
+                if (ring) {
+                    ring->retired.store(true, std::memory_order_release);
+                }
+            }
+        };
+        static thread_local Holder holder;
+        if (!holder.ring) {
+            holder.ring = std::make_shared<details::Ring>(ring_size.load(std::memory_order_relaxed));
+            std::lock_guard<std::mutex> lock(mutex);
+            rings.push_back(holder.ring);
+            if (!consumer.joinable()) {
+                consumer = std::thread(&Logger::run, this);
+            }
+        }
+        return holder.ring.get();
+    }
+
+    /**
+     * Called by producers whose ring is filling up, to not wait for the consumer to wake up by itself.
+     */
+    void Wakeup()
+    {
+        if (idle.load(std::memory_order_relaxed)) {
+            wakeup.notify_one();
+        }
+    }
+
+    ~Logger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+            wakeup.notify_one();
+        }
+        if (consumer.joinable()) {
+            consumer.join();
+        }
+    }
+
+  private:
+    static constexpr size_t BATCH_SIZE = 64 * 1024;
+    static constexpr auto IDLE_INTERVAL = std::chrono::milliseconds(1);
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable flushed;
+    std::thread consumer;
+    std::vector<std::shared_ptr<details::Ring>> rings;
+    std::atomic<size_t> ring_size;
+    std::atomic<bool> idle;
+    std::atomic<bool> blocking;
+    int output;
+    bool stopped;
+    uint64_t requested;
+    uint64_t completed;
+
+    // consumer only
+    std::string batch;
+    time_t cached_second;
+    char cached_time[32];
+
+    Logger() : ring_size(256 * 1024), idle(false), blocking(false), output(STDOUT_FILENO), stopped(false), requested(0), completed(0), cached_second(-1)
+    {
+        batch.reserve(BATCH_SIZE);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            uint64_t request = requested;
+            bool stopping = stopped;
+            auto snapshot = rings;
+            int fd = output;
+            lock.unlock();
+
+            size_t drained = drain(snapshot, fd);
+
+            lock.lock();
+            rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                       [](const std::shared_ptr<details::Ring> &ring) {
+                                           return ring->retired.load(std::memory_order_acquire) &&
+                                                  ring->tail.load(std::memory_order_relaxed) ==
+                                                      ring->head.load(std::memory_order_acquire);
+                                       }),
+                        rings.end());
+            if (request > completed) {
+                completed = request;
+                flushed.notify_all();
+            }
+            if (stopping) {
+                return;
+            }
+            if (drained == 0 && requested == completed && !stopped) {
+                idle.store(true, std::memory_order_relaxed);
+                wakeup.wait_for(lock, IDLE_INTERVAL);
+                idle.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Format all records committed so far in time order, returns the number of records.
+     */
+    size_t drain(const std::vector<std::shared_ptr<details::Ring>> &snapshot, int fd)
+    {
+        struct Pending {
+            const details::Record *record;
+            size_t sequence;
+        };
+        std::vector<Pending> pending;
+        std::vector<uint64_t> heads(snapshot.size());
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            details::Ring &ring = *snapshot[i];
+            uint64_t position = ring.tail.load(std::memory_order_relaxed);
+            heads[i] = ring.head.load(std::memory_order_acquire);
+            while (position < heads[i]) {
+                auto record = reinterpret_cast<const details::Record *>(&ring.buffer[position & ring.mask]);
+                if (!record->padding) {
+                    pending.push_back({record, pending.size()});
+                }
+                position += record->size;
+            }
+        }
+        std::sort(pending.begin(), pending.end(), [](const Pending &a, const Pending &b) {
+            return a.record->timestamp != b.record->timestamp ? a.record->timestamp < b.record->timestamp
+                                                              : a.sequence < b.sequence;
+        });
+
+        for (auto const &item : pending) {
+            append(*item.record, fd);
+        }
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            snapshot[i]->tail.store(heads[i], std::memory_order_release);
+            if (uint64_t dropped = snapshot[i]->dropped.exchange(0, std::memory_order_relaxed); dropped != 0) {
+                char message[128];
+                int len = snprintf(message, sizeof(message),
+                                   "<logger> %llu records dropped, ring of %zu bytes full or records over half of it\n",
+                                   static_cast<unsigned long long>(dropped), snapshot[i]->Capacity());
+                batch.append(message, static_cast<size_t>(len));
+            }
+        }
+        flush(fd);
+
+        return pending.size();
+    }
+
+    void append(const details::Record &record, int fd)
+    {
+        static const char *levels[] = {"TRACE", "DEBUG", "INFO ", "WARN ", "ERROR"};
+        time_t second = static_cast<time_t>(record.timestamp / 1'000'000'000);
+        if (second != cached_second) {
+            struct tm tm;
+            localtime_r(&second, &tm);
+            strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &tm);
+            cached_second = second;
+        }
+        char prefix[128];
+        int len = snprintf(prefix, sizeof(prefix), "\033[2;3m%s.%03u\033[0m %s <%s> ", cached_time,
+                           static_cast<unsigned>(record.timestamp / 1'000'000 % 1000),
+                           levels[std::min(std::max(record.level, 0), 4)], record.location);
+        if (batch.size() + static_cast<size_t>(len) + 256 > BATCH_SIZE) {
+            flush(fd);
+        }
+        batch.append(prefix, std::min(static_cast<size_t>(len), sizeof(prefix) - 1));
+
+        const char *data = reinterpret_cast<const char *>(&record + 1);
+        size_t offset = batch.size(), room = BATCH_SIZE - offset;
+        batch.resize(BATCH_SIZE);
+        int written = record.format(&batch[offset], room, record.fmt, data);
+        if (written >= 0 && static_cast<size_t>(written) >= room) {
+            // too long for what's left of the batch, flush what precedes it and format again
+            std::string line(static_cast<size_t>(written) + 1, '\0');
+            record.format(&line[0], line.size(), record.fmt, data);
+            batch.resize(offset);
+            flush(fd);
+            line.back() = '\n';
+            write(fd, line);
+            return;
+        }
+        batch.resize(offset + static_cast<size_t>(std::max(written, 0)));
+        batch.push_back('\n');
+    }
+
+    void flush(int fd)
+    {
+        write(fd, batch);
+        batch.clear();
+    }
+
+    static void write(int fd, const std::string &data)
+    {
+        for (size_t done = 0; done < data.size();) {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+};
+
+/**
+ * Keep a record on the ring of the calling thread, called through LOGGER_LOG.
+ */
+template <typename... Args>
+inline void Log(int level, const char *fmt, const char *location, const Args &...args)
+{
+    details::Ring *ring = Logger::Instance().Local();
+    size_t size = sizeof(details::Record) + (details::Size(args) + ... + 0);
+    size = (size + 7) & ~size_t(7);
+    if (size > ring->Capacity() / 2) { // would starve the ring, dropped even when blocking
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        Logger::Instance().Wakeup();
+        return;
+    }
+    char *p;
+    while ((p = ring->Reserve(size)) == nullptr) {
+        if (!Logger::Instance().Blocking()) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Logger::Instance().Wakeup();
+        std::this_thread::yield();
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    auto record = reinterpret_cast<details::Record *>(p);
+    record->size = static_cast<uint32_t>(size);
+    record->padding = 0;
+    record->level = level;
+    record->timestamp = static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+    record->fmt = fmt;
+    record->location = location;
+    record->format = &details::Format<Args...>;
+    p += sizeof(details::Record);
+    ((p = details::Store(p, args)), ...);
+    ring->Commit();
+    if (ring->Used() > ring->Capacity() / 2) {
+        Logger::Instance().Wakeup();
+    }
+}
+
+inline void SetOutput(int fd)
+{
+    Logger::Instance().SetOutput(fd);
+}
+
+inline void SetRingSize(size_t size)
+{
+    Logger::Instance().SetRingSize(size);
+}
+
+inline void SetBlocking(bool blocking)
+{
+    Logger::Instance().SetBlocking(blocking);
+}
+
+inline void Flush()
+{
+    Logger::Instance().Flush();
+}
+} // namespace logging
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2022 Kiran Nowak(kiran.nowak@gmail.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <exception>
+#include <functional>
+
+namespace multiprocessing
+{
+/**
+ * Where tasks are pushed to, e.g. a multiprocessing::threadpool, type-erased so that a class can take any pool. Empty
+ * when there is none.
+ */
+using executor = std::function<void(std::function<void()>)>;
+
+/**
+ * The executor of `pool`, anything with push(std::function<void()>), empty for NULL. The pool must outlive it.
+ */
+template <typename Pool>
+inline executor executor_of(Pool *pool)
+{
+    if (pool == nullptr) {
+        return nullptr;
+    }
+    return [pool](std::function<void()> task) {
+        pool->push(std::move(task));
+    };
+}
+
+/**
+ * Call `fn(b)` for every block b in [0, blocks), on `executor` and on the calling thread, then rethrow the first
+ * exception thrown if any.
+ *
+ * Blocks are claimed by whoever comes first, the caller included, which only waits for blocks run by workers, never
+ * for queued ones: called from a worker of the pool while the others are busy, it runs all of them itself. Tasks run
+ * once every block is claimed return without touching `fn`.
+ */
+template <typename Fn>
+inline void parallel_for(const executor &executor, size_t blocks, Fn &&fn)
+{
+    struct Claims {
+        std::atomic<size_t> next{0}, done{0};
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+    auto claims = std::make_shared<Claims>();
+    auto run = [&fn, &claims](size_t b) {
+        try {
+            fn(b);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(claims->mutex);
+            claims->error = claims->error ? claims->error : std::current_exception();
+        }
+        claims->done.fetch_add(1, std::memory_order_release);
+    };
+    for (size_t b = 1; executor && b < blocks; b++) {
+        executor([claims, blocks, run = &run]() {
+            for (size_t b; (b = claims->next.fetch_add(1)) < blocks;) {
+                (*run)(b);
+            }
+        });
+    }
+    for (size_t b; (b = claims->next.fetch_add(1)) < blocks;) {
+        run(b);
+    }
+    while (claims->done.load(std::memory_order_acquire) < blocks) {
+        std::this_thread::yield(); // blocks claimed by workers, being run
+    }
+    if (claims->error) {
+        std::rethrow_exception(claims->error);
+    }
+}
+} // namespace multiprocessing
@@ -14,17 +14,36 @@
  * limitations under the License.
  */
 
+#pragma once
+
 #include <time.h>
 #include <math.h>
+#include <errno.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
+#include <atomic>
 #include <string>
 #include <regex>
 #include <thread>
 #include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <iostream>
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 #include <type_traits>
 #include <unordered_map>
@@ -52,7 +71,7 @@ namespace profiler
             __t += static_cast<long double>(durations[__i]);                                                  \
         }                                                                                                     \
         prefix##avg = static_cast<double>(__t / N);                                                           \
-                                                                                                              \
+        __t = 0;                                                                                              \
         for (unsigned __i = 0; __i < N; __i++) {                                                              \
             double diff = durations[__i] - prefix##avg;                                                       \
             __t += static_cast<long double>(diff * diff);                                                     \
@@ -89,7 +108,7 @@ namespace profiler
             __t += static_cast<long double>(durations[__i]);                                                       \
         }                                                                                                          \
         prefix##avg = static_cast<double>(__t / N);                                                                \
-                                                                                                                   \
+        __t = 0;                                                                                                   \
         for (unsigned __i = 0; __i < N; __i++) {                                                                   \
             double diff = durations[__i] - prefix##avg;                                                            \
             __t += static_cast<long double>(diff * diff);                                                          \
@@ -98,12 +117,1050 @@ namespace profiler
         prefix##stddev = static_cast<double>(sqrt(__t));                                                           \
     } while (0)
 
+/**
+ * Time source used by the benchmark engine. On x86 the time-stamp counter is read with lfence/rdtscp fencing so that
+ * the measured region can neither start early nor finish late, on aarch64 the virtual counter is used, everything else
+ * falls back to CLOCK_MONOTONIC. Use ToNanoseconds() to convert a difference of two readings.
+ */
+inline uint64_t Cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(value) : : "memory");
+    return value;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+inline uint64_t CyclesEnd()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    uint64_t value = __rdtscp(&aux);
+    _mm_lfence();
+    return value;
+#else
+    return Cycles();
+#endif
+}
+
+inline uint64_t Nanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * Counter ticks per nanosecond, calibrated once against CLOCK_MONOTONIC (busy waiting for about 20ms).
+ */
+inline double CyclesPerNanosecond()
+{
+    static const double ratio = []() {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+        uint64_t ns0 = Nanoseconds(), c0 = Cycles();
+        while (Nanoseconds() - ns0 < 20'000'000) {
+        }
+        uint64_t ns1 = Nanoseconds(), c1 = CyclesEnd();
+        return static_cast<double>(c1 - c0) / static_cast<double>(ns1 - ns0);
+#else
+        return 1.0;
+#endif
+    }();
+    return ratio;
+}
+
+inline double ToNanoseconds(uint64_t cycles)
+{
+    return static_cast<double>(cycles) / CyclesPerNanosecond();
+}
+
+/**
+ * Cost of an empty Cycles()/CyclesEnd() pair in counter ticks, it's subtracted from every timed sample.
+ */
+inline uint64_t CyclesOverhead()
+{
+    static const uint64_t overhead = []() {
+        std::vector<uint64_t> deltas(1001);
+        for (auto &delta : deltas) {
+            uint64_t start = Cycles();
+            delta = CyclesEnd() - start;
+        }
+        std::nth_element(deltas.begin(), deltas.begin() + deltas.size() / 2, deltas.end());
+        return deltas[deltas.size() / 2];
+    }();
+    return overhead;
+}
+
+/**
+ * Knobs of the benchmark engine.
+ *
+ * Each benchmark runs in three phases: validation (a single call that must return true), warmup (calls are repeated
+ * for warmup_ns to settle caches, branch predictors and frequency scaling, and to estimate the cost of one call), and
+ * measurement (samples of `iterations` calls are timed until budget_ns is spent, bounded by min_samples and
+ * max_samples). Iterations per sample are chosen so that a sample lasts about sample_ns, long enough to dwarf the
+ * timer overhead, short enough that an interrupt only spoils a few samples which are then rejected as outliers.
+ */
+struct Options {
+    uint64_t warmup_ns = 50'000'000;  //!> warmup duration
+    uint64_t budget_ns = 500'000'000; //!> time budget of the measurement phase
+    uint64_t sample_ns = 20'000;      //!> target duration of one sample
+    size_t min_samples = 10;          //!> lower bound of samples, even if the budget is exhausted
+    size_t max_samples = 20'000;      //!> upper bound of samples, even if the budget isn't exhausted
+    double outlier_fence = 1.5;       //!> Tukey's fences, samples out of [Q1 - k*IQR, Q3 + k*IQR] are outliers
+    double confidence = 0.95;         //!> confidence level of the interval of mean
+    bool counters = false;            //!> collect hardware counters of the measurement phase, see PerfCounters
+};
+
+inline Options &DefaultOptions()
+{
+    static Options options;
+    return options;
+}
+
+namespace details
+{
+inline double Percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return NAN;
+    }
+    double rank = p * static_cast<double>(sorted.size() - 1);
+    size_t lower = static_cast<size_t>(rank);
+    if (lower + 1 >= sorted.size()) {
+        return sorted.back();
+    }
+    double fraction = rank - static_cast<double>(lower);
+    return sorted[lower] + (sorted[lower + 1] - sorted[lower]) * fraction;
+}
+
+/**
+ * Quantile function of standard normal distribution, rational approximation by Peter J. Acklam, relative error is
+ * below 1.15e-9 which is far more than enough here.
+ */
+inline double NormalQuantile(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02,  -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00,  2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    if (p <= 0 || p >= 1) {
+        return NAN;
+    }
+    if (p < 0.02425) {
+        double q = sqrt(-2 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+               / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    if (p > 1 - 0.02425) {
+        return -NormalQuantile(1 - p);
+    }
+    double q = p - 0.5, r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q
+           / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+/**
+ * Quantile function of Student's t-distribution with `df` degrees of freedom, Cornish-Fisher expansion around the
+ * normal quantile. Good to the third digit for df >= 3, which is what a confidence interval needs.
+ */
+inline double StudentQuantile(double p, size_t df)
+{
+    double z = NormalQuantile(p);
+    if (df == 0) {
+        return NAN;
+    }
+    double v = static_cast<double>(df), z2 = z * z;
+    double g1 = (z2 + 1) * z / 4;
+    double g2 = ((5 * z2 + 16) * z2 + 3) * z / 96;
+    double g3 = (((3 * z2 + 19) * z2 + 17) * z2 - 15) * z / 384;
+    return z + g1 / v + g2 / (v * v) + g3 / (v * v * v);
+}
+} // namespace details
+
+/**
+ * Hardware/software counters of one benchmark, normalized per call. NAN if the event isn't available.
+ */
+struct Counters {
+    bool available = false;
+    double cycles = NAN;
+    double instructions = NAN;
+    double cache_misses = NAN;
+    double branch_misses = NAN;
+    double task_clock = NAN; //!> nanoseconds on cpu
+
+    double ipc() const
+    {
+        return instructions / cycles;
+    }
+};
+
+/**
+ * Grouped perf_event_open counters of the calling thread: cycles, instructions, cache-misses, branch-misses and
+ * task-clock, scheduled onto the PMU together so that ratios between them are meaningful.
+ *
+ * Events which can't be opened (no PMU in virtual machines, perf_event_paranoid, seccomp, non-Linux) are skipped; if
+ * none of them can be opened Available() returns false and Stop() reports nothing.
+ */
+class PerfCounters {
+  public:
+    enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, TASK_CLOCK, MAX_EVENTS };
+
+    PerfCounters() : leader(-1)
+    {
+        for (auto &fd : fds) {
+            fd = -1;
+        }
+#if defined(__linux__)
+        struct {
+            uint32_t type;
+            uint64_t config;
+        } events[MAX_EVENTS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        };
+        for (int i = 0; i < MAX_EVENTS; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = leader < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED
+                               | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+            if (fd < 0) {
+                continue;
+            }
+            if (ioctl(fd, PERF_EVENT_IOC_ID, &ids[i]) != 0) {
+                close(fd);
+                continue;
+            }
+            fds[i] = fd;
+            if (leader < 0) {
+                leader = fd;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+        for (auto fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool Available() const
+    {
+        return leader >= 0;
+    }
+
+    void Start()
+    {
+#if defined(__linux__)
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    /**
+     * Stop counting and normalize the counted values by `calls`, returns false if nothing was counted.
+     */
+    bool Stop(Counters &counters, size_t calls)
+    {
+        counters = Counters();
+#if defined(__linux__)
+        if (leader < 0 || calls == 0) {
+            return false;
+        }
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        struct {
+            uint64_t nr;
+            uint64_t time_enabled;
+            uint64_t time_running;
+            struct {
+                uint64_t value;
+                uint64_t id;
+            } values[MAX_EVENTS];
+        } data;
+        if (read(leader, &data, sizeof(data)) <= 0 || data.time_running == 0) {
+            return false;
+        }
+
+        // scale up if the group was multiplexed with other users of the PMU
+        double scale = static_cast<double>(data.time_enabled) / static_cast<double>(data.time_running);
+        double *fields[MAX_EVENTS] = {&counters.cycles, &counters.instructions, &counters.cache_misses,
+                                      &counters.branch_misses, &counters.task_clock};
+        for (uint64_t n = 0; n < data.nr && n < MAX_EVENTS; n++) {
+            for (int i = 0; i < MAX_EVENTS; i++) {
+                if (fds[i] >= 0 && ids[i] == data.values[n].id) {
+                    *fields[i] = static_cast<double>(data.values[n].value) * scale / static_cast<double>(calls);
+                }
+            }
+        }
+        counters.available = true;
+#endif
+        return counters.available;
+    }
+
+  private:
+    int leader;
+    int fds[MAX_EVENTS];
+    uint64_t ids[MAX_EVENTS];
+};
+
+/**
+ * Summary of one benchmark, all durations are in nanoseconds per call.
+ *
+ * min/max/median/percentiles are taken from all samples, mean/stddev/confidence interval only from samples that
+ * survived outlier rejection.
+ */
+struct Statistics {
+    size_t samples = 0;    //!> number of samples measured
+    size_t outliers = 0;   //!> number of samples rejected by Tukey's fences
+    size_t iterations = 0; //!> calls per sample
+    double mean = NAN;
+    double stddev = NAN;
+    double min = NAN;
+    double max = NAN;
+    double median = NAN;
+    double p90 = NAN;
+    double p99 = NAN;
+    double p999 = NAN;
+    double ci_lower = NAN; //!> lower bound of the confidence interval of mean
+    double ci_upper = NAN; //!> upper bound of the confidence interval of mean
+    Counters counters;     //!> filled only if Options::counters is set and perf events are available
+
+    Statistics() = default;
+    Statistics(double avg, double stddev) : mean(avg), stddev(stddev) {}
+
+    static Statistics From(std::vector<double> durations, size_t iterations, const Options &options = DefaultOptions())
+    {
+        Statistics stats;
+        stats.samples = durations.size();
+        stats.iterations = iterations;
+        if (durations.empty()) {
+            return stats;
+        }
+
+        std::sort(durations.begin(), durations.end());
+        stats.min = durations.front();
+        stats.max = durations.back();
+        stats.median = details::Percentile(durations, 0.50);
+        stats.p90 = details::Percentile(durations, 0.90);
+        stats.p99 = details::Percentile(durations, 0.99);
+        stats.p999 = details::Percentile(durations, 0.999);
+
+        double q1 = details::Percentile(durations, 0.25), q3 = details::Percentile(durations, 0.75);
+        double lower = q1 - options.outlier_fence * (q3 - q1), upper = q3 + options.outlier_fence * (q3 - q1);
+        long double sum = 0;
+        size_t n = 0;
+        for (auto duration : durations) {
+            if (duration >= lower && duration <= upper) {
+                sum += duration, n++;
+            }
+        }
+        stats.outliers = durations.size() - n;
+        stats.mean = static_cast<double>(sum / n);
+
+        long double squares = 0;
+        for (auto duration : durations) {
+            if (duration >= lower && duration <= upper) {
+                squares += (duration - stats.mean) * (duration - stats.mean);
+            }
+        }
+        stats.stddev = n > 1 ? static_cast<double>(sqrtl(squares / (n - 1))) : 0;
+
+        double margin = 0;
+        if (n > 1) {
+            double t = details::StudentQuantile((1 + options.confidence) / 2, n - 1);
+            margin = t * stats.stddev / sqrt(static_cast<double>(n));
+        }
+        stats.ci_lower = stats.mean - margin;
+        stats.ci_upper = stats.mean + margin;
+
+        return stats;
+    }
+};
+
+/**
+ * Run a benchmark with the engine described in Options.
+ *
+ * @param task the function to be measured, it's called once for validation and must return true.
+ * @param sampler measures one sample of given iterations and returns the elapsed nanoseconds of the whole sample.
+ * @param stats summary of measurement.
+ * @param repeat iterations per sample, 0 to choose automatically.
+ * @param N number of samples, 0 to measure until the time budget is spent.
+ */
+inline int Measure(const std::function<bool(void)> &task, const std::function<double(size_t)> &sampler,
+                   Statistics &stats, size_t repeat = 0, size_t N = 0, const Options &options = DefaultOptions())
+{
+    if (!task()) {
+        return -EINVAL;
+    }
+
+    // warmup, and estimate cost of one call meanwhile
+    size_t calls = 0;
+    double elapsed = 0, batch = 1;
+    do {
+        elapsed += sampler(static_cast<size_t>(batch));
+        calls += static_cast<size_t>(batch);
+        batch = std::min(batch * 2, 1e6);
+    } while (elapsed < static_cast<double>(options.warmup_ns));
+    double percall = std::max(elapsed / static_cast<double>(calls), 1e-3);
+
+    size_t iterations = repeat;
+    if (iterations == 0) {
+        iterations = static_cast<size_t>(static_cast<double>(options.sample_ns) / percall);
+        iterations = std::max<size_t>(iterations, 1);
+    }
+
+    std::unique_ptr<PerfCounters> perf;
+    if (options.counters) {
+        perf.reset(new PerfCounters());
+        perf->Start();
+    }
+
+    std::vector<double> durations;
+    if (N != 0) {
+        durations.reserve(N);
+        for (size_t i = 0; i < N; i++) {
+            durations.push_back(sampler(iterations) / static_cast<double>(iterations));
+        }
+    } else {
+        uint64_t start = Nanoseconds();
+        while (durations.size() < options.max_samples
+               && (durations.size() < options.min_samples || Nanoseconds() - start < options.budget_ns)) {
+            durations.push_back(sampler(iterations) / static_cast<double>(iterations));
+        }
+    }
+
+    Counters counters;
+    if (perf) {
+        perf->Stop(counters, durations.size() * iterations);
+    }
+
+    stats = Statistics::From(std::move(durations), iterations, options);
+    stats.counters = counters;
+
+    return 0;
+}
+
+/**
+ * HDR (high dynamic range) histogram of non-negative integers, e.g. per-operation latencies in counter ticks.
+ *
+ * Values are grouped into power-of-two buckets, each split linearly into 2^(SUB_BITS - 1) sub-buckets, so every value
+ * up to 2^64 is recorded in constant time with a relative error below 2^-(SUB_BITS - 1) (0.8%), in a fixed 58KB of
+ * counts. Histograms of different threads are recorded without sharing and merged afterwards.
+ */
+class Histogram {
+  public:
+    static constexpr unsigned SUB_BITS = 8;
+    static constexpr size_t SUB_COUNT = size_t(1) << SUB_BITS;
+    static constexpr size_t HALF_COUNT = SUB_COUNT / 2;
+    static constexpr size_t MAX_INDEX = (64 - SUB_BITS + 1) * HALF_COUNT + SUB_COUNT;
+
+    Histogram() : counts(MAX_INDEX, 0), total(0), minimum(UINT64_MAX), maximum(0), sum(0), squares(0) {}
+
+    void Record(uint64_t value, uint64_t count = 1)
+    {
+        counts[index(value)] += count;
+        total += count;
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        sum += static_cast<double>(value) * static_cast<double>(count);
+        squares += static_cast<double>(value) * static_cast<double>(value) * static_cast<double>(count);
+    }
+
+    void Merge(const Histogram &other)
+    {
+        for (size_t i = 0; i < MAX_INDEX; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+        sum += other.sum;
+        squares += other.squares;
+    }
+
+    void Reset()
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0, minimum = UINT64_MAX, maximum = 0, sum = 0, squares = 0;
+    }
+
+    uint64_t Count() const
+    {
+        return total;
+    }
+
+    uint64_t Min() const
+    {
+        return total ? minimum : 0;
+    }
+
+    uint64_t Max() const
+    {
+        return maximum;
+    }
+
+    double Mean() const
+    {
+        return total ? sum / static_cast<double>(total) : NAN;
+    }
+
+    double Stddev() const
+    {
+        if (total < 2) {
+            return total ? 0 : NAN;
+        }
+        double mean = Mean();
+        double variance = (squares - mean * sum) / static_cast<double>(total - 1);
+        return variance > 0 ? sqrt(variance) : 0;
+    }
+
+    /**
+     * Value at percentile p (in [0, 1]), as the midpoint of the bucket holding it, clamped into [Min(), Max()].
+     */
+    double Percentile(double p) const
+    {
+        if (total == 0) {
+            return NAN;
+        }
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(ceil(p * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < MAX_INDEX; i++) {
+            seen += counts[i];
+            if (seen >= target) {
+                double lo = static_cast<double>(lowest(i)), hi = static_cast<double>(highest(i));
+                double mid = lo + (hi - lo) / 2;
+                return std::min(std::max(mid, static_cast<double>(Min())), static_cast<double>(Max()));
+            }
+        }
+        return static_cast<double>(Max());
+    }
+
+  private:
+    std::vector<uint64_t> counts;
+    uint64_t total, minimum, maximum;
+    double sum, squares;
+
+    static size_t index(uint64_t value)
+    {
+        if (value < SUB_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        unsigned bucket = 63 - static_cast<unsigned>(__builtin_clzll(value)) - (SUB_BITS - 1);
+        return bucket * HALF_COUNT + static_cast<size_t>(value >> bucket);
+    }
+
+    static uint64_t lowest(size_t index)
+    {
+        if (index < SUB_COUNT) {
+            return index;
+        }
+        size_t bucket = index / HALF_COUNT - 1;
+        return static_cast<uint64_t>(index - bucket * HALF_COUNT) << bucket;
+    }
+
+    static uint64_t highest(size_t index)
+    {
+        if (index < SUB_COUNT) {
+            return index;
+        }
+        size_t bucket = index / HALF_COUNT - 1;
+        return lowest(index) + ((uint64_t(1) << bucket) - 1);
+    }
+};
+
+/**
+ * A group of long-lived worker threads, optionally pinned one per cpu, which run a job simultaneously on request.
+ *
+ * Workers spin on a generation counter between runs, so bumping it releases all of them at once like a barrier, and
+ * none of thread creation, scheduling of new threads or joining falls into the measured interval.
+ */
+class ThreadGroup {
+  public:
+    ThreadGroup(size_t concurrency = std::thread::hardware_concurrency(), bool pin = true)
+        : generation(0), remaining(0), stopped(false), job(nullptr)
+    {
+        concurrency = std::max<size_t>(concurrency, 1);
+        std::vector<int> cpus;
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        for (size_t i = 0; i < concurrency; i++) {
+            workers.emplace_back(&ThreadGroup::worker, this, i);
+#if defined(__linux__)
+            if (!cpus.empty()) {
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(cpus[i % cpus.size()], &cpuset);
+                pthread_setaffinity_np(workers.back().native_handle(), sizeof(cpuset), &cpuset);
+            }
+#endif
+        }
+    }
+
+    ~ThreadGroup()
+    {
+        stopped.store(true, std::memory_order_release);
+        generation.fetch_add(1, std::memory_order_release);
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadGroup(const ThreadGroup &) = delete;
+    ThreadGroup &operator=(const ThreadGroup &) = delete;
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    /**
+     * Run job(thread index) on all threads at once, returns nanoseconds from release until the last one finished.
+     */
+    double Run(const std::function<void(size_t)> &job)
+    {
+        this->job = &job;
+        remaining.store(workers.size(), std::memory_order_relaxed);
+        uint64_t start = Cycles();
+        generation.fetch_add(1, std::memory_order_release);
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+        uint64_t stop = CyclesEnd();
+        this->job = nullptr;
+
+        return ToNanoseconds(stop - start);
+    }
+
+  private:
+    std::atomic<uint64_t> generation;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> stopped;
+    const std::function<void(size_t)> *job;
+    std::vector<std::thread> workers;
+
+    void worker(size_t id)
+    {
+        uint64_t seen = 0;
+        while (true) {
+            for (size_t spins = 0; generation.load(std::memory_order_acquire) == seen; spins++) {
+                if (spins > 1024) {
+                    std::this_thread::yield();
+                }
+            }
+            seen = generation.load(std::memory_order_acquire);
+            if (stopped.load(std::memory_order_acquire)) {
+                return;
+            }
+            (*job)(id);
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+};
+
+namespace details
+{
+/**
+ * Latency statistics of a histogram recorded in counter ticks, converted to nanoseconds.
+ */
+inline Statistics Summarize(const Histogram &histogram, const Options &options = DefaultOptions())
+{
+    Statistics stats;
+    double scale = 1 / CyclesPerNanosecond();
+    stats.samples = histogram.Count();
+    stats.iterations = 1;
+    if (stats.samples == 0) {
+        return stats;
+    }
+    stats.mean = histogram.Mean() * scale;
+    stats.stddev = histogram.Stddev() * scale;
+    stats.min = static_cast<double>(histogram.Min()) * scale;
+    stats.max = static_cast<double>(histogram.Max()) * scale;
+    stats.median = histogram.Percentile(0.50) * scale;
+    stats.p90 = histogram.Percentile(0.90) * scale;
+    stats.p99 = histogram.Percentile(0.99) * scale;
+    stats.p999 = histogram.Percentile(0.999) * scale;
+    double margin = 0;
+    if (stats.samples > 1) {
+        double t = StudentQuantile((1 + options.confidence) / 2, stats.samples - 1);
+        margin = t * stats.stddev / sqrt(static_cast<double>(stats.samples));
+    }
+    stats.ci_lower = stats.mean - margin;
+    stats.ci_upper = stats.mean + margin;
+
+    return stats;
+}
+} // namespace details
+
+/**
+ * Throughput and latency of a benchmark running on a number of threads, see AddScaling().
+ */
+struct ScalingPoint {
+    size_t threads;
+    double elapsed;    //!> nanoseconds of the measured run
+    double throughput; //!> operations per second, all threads together
+    Statistics latency;
+    std::vector<uint64_t> operations; //!> successful calls made by each thread
+};
+
+/**
+ * Thresholds of baseline comparison, a benchmark regresses if its mean is more than `regression` slower than the
+ * baseline, and the difference is significant under Welch's t-test at level `significance`.
+ */
+struct Thresholds {
+    double regression = 0.05;   //!> relative slowdown tolerated, 0.05 means 5%
+    double improvement = 0.05;  //!> relative speedup reported as improvement
+    double significance = 0.05; //!> two-sided significance level of Welch's t-test
+};
+
+namespace details
+{
+/**
+ * Flat view of Statistics used by JSON/CSV export and baseline loading, in output order.
+ */
+inline std::vector<std::pair<const char *, double>> Fields(const Statistics &stats)
+{
+    return {
+        {"mean", stats.mean},
+        {"stddev", stats.stddev},
+        {"min", stats.min},
+        {"max", stats.max},
+        {"median", stats.median},
+        {"p90", stats.p90},
+        {"p99", stats.p99},
+        {"p999", stats.p999},
+        {"ci_lower", stats.ci_lower},
+        {"ci_upper", stats.ci_upper},
+        {"samples", static_cast<double>(stats.samples)},
+        {"outliers", static_cast<double>(stats.outliers)},
+        {"iterations", static_cast<double>(stats.iterations)},
+        {"cycles", stats.counters.cycles},
+        {"instructions", stats.counters.instructions},
+        {"cache_misses", stats.counters.cache_misses},
+        {"branch_misses", stats.counters.branch_misses},
+        {"task_clock", stats.counters.task_clock},
+    };
+}
+
+inline void Assign(Statistics &stats, const std::string &key, double value)
+{
+    double *fields[] = {&stats.mean,
+                        &stats.stddev,
+                        &stats.min,
+                        &stats.max,
+                        &stats.median,
+                        &stats.p90,
+                        &stats.p99,
+                        &stats.p999,
+                        &stats.ci_lower,
+                        &stats.ci_upper,
+                        nullptr, // samples
+                        nullptr, // outliers
+                        nullptr, // iterations
+                        &stats.counters.cycles,
+                        &stats.counters.instructions,
+                        &stats.counters.cache_misses,
+                        &stats.counters.branch_misses,
+                        &stats.counters.task_clock};
+    auto names = Fields(stats);
+    for (size_t i = 0; i < names.size(); i++) {
+        if (key != names[i].first) {
+            continue;
+        }
+        if (fields[i] != nullptr) {
+            *fields[i] = value;
+            if (i >= 13 && !isnan(value)) {
+                stats.counters.available = true;
+            }
+        } else {
+            size_t count = isnan(value) || value < 0 ? 0 : static_cast<size_t>(value);
+            (key == "samples" ? stats.samples : key == "outliers" ? stats.outliers : stats.iterations) = count;
+        }
+        break;
+    }
+}
+
+inline std::string Number(double value)
+{
+    if (isnan(value) || isinf(value)) {
+        return "null";
+    }
+    char buff[32];
+    snprintf(buff, sizeof(buff), "%.9g", value);
+    return buff;
+}
+
+inline std::string Quote(const std::string &s)
+{
+    std::string quoted = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            quoted += '\\';
+            quoted += ch;
+        } else if (ch == '\n') {
+            quoted += "\\n";
+        } else if (ch == '\t') {
+            quoted += "\\t";
+        } else {
+            quoted += ch;
+        }
+    }
+    return quoted + "\"";
+}
+
+inline std::string CsvField(const std::string &s)
+{
+    if (s.find_first_of(",\"\r\n") == std::string::npos) {
+        return s;
+    }
+    std::string quoted = "\"";
+    for (char ch : s) {
+        quoted += ch == '"' ? std::string("\"\"") : std::string(1, ch);
+    }
+    return quoted + "\"";
+}
+
+using Record = std::pair<std::string, Statistics>;
+
+/**
+ * Minimal JSON reader for files written by ProfilerSet::json(), every object with a "name" member is a benchmark.
+ */
+class JsonReader {
+  public:
+    JsonReader(const std::string &text, std::vector<Record> &records)
+        : p(text.c_str()), end(text.c_str() + text.size()), records(records)
+    {
+    }
+
+    bool Parse()
+    {
+        return Value(nullptr, "") && (Skip(), p == end);
+    }
+
+  private:
+    const char *p, *end;
+    std::vector<Record> &records;
+
+    void Skip()
+    {
+        while (p < end && isspace(static_cast<unsigned char>(*p))) {
+            p++;
+        }
+    }
+
+    bool String(std::string &s)
+    {
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        for (p++; p < end && *p != '"'; p++) {
+            if (*p == '\\' && p + 1 < end) {
+                switch (*++p) {
+                    case 'n':
+                        s += '\n';
+                        break;
+                    case 't':
+                        s += '\t';
+                        break;
+                    case 'u':
+                        s += '?', p += std::min<ptrdiff_t>(4, end - p - 1);
+                        break;
+                    default:
+                        s += *p;
+                        break;
+                }
+            } else {
+                s += *p;
+            }
+        }
+        return p < end && *p++ == '"';
+    }
+
+    bool Value(Record *owner, const std::string &key)
+    {
+        Skip();
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '{') {
+            Record record;
+            for (p++, Skip(); p < end && *p != '}';) {
+                std::string member;
+                if (!String(member) || (Skip(), p >= end || *p++ != ':') || !Value(&record, member)) {
+                    return false;
+                }
+                Skip();
+                if (p < end && *p == ',') {
+                    p++, Skip();
+                }
+            }
+            if (p >= end) {
+                return false;
+            }
+            p++;
+            if (!record.first.empty()) {
+                records.push_back(std::move(record));
+            }
+            return true;
+        } else if (*p == '[') {
+            for (p++, Skip(); p < end && *p != ']';) {
+                if (!Value(nullptr, "")) {
+                    return false;
+                }
+                Skip();
+                if (p < end && *p == ',') {
+                    p++;
+                }
+                Skip();
+            }
+            return p < end && *p++ == ']';
+        } else if (*p == '"') {
+            std::string s;
+            if (!String(s)) {
+                return false;
+            }
+            if (owner && key == "name") {
+                owner->first = s;
+            }
+            return true;
+        } else {
+            double value = NAN;
+            if (strncmp(p, "null", 4) == 0 || strncmp(p, "true", 4) == 0) {
+                p += 4;
+            } else if (strncmp(p, "false", 5) == 0) {
+                p += 5;
+            } else {
+                char *next = nullptr;
+                value = strtod(p, &next);
+                if (next == p) {
+                    return false;
+                }
+                p = next;
+            }
+            if (owner) {
+                Assign(owner->second, key, value);
+            }
+            return true;
+        }
+    }
+};
+
+/**
+ * Reader for files written by ProfilerSet::csv(): a header line, then one benchmark per line, name comes first and
+ * may be quoted.
+ */
+inline bool ReadCsv(const std::string &text, std::vector<Record> &records)
+{
+    std::vector<std::vector<std::string>> lines;
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char ch = text[i];
+        if (quoted) {
+            if (ch == '"' && i + 1 < text.size() && text[i + 1] == '"') {
+                fields.back() += '"', i++;
+            } else if (ch == '"') {
+                quoted = false;
+            } else {
+                fields.back() += ch;
+            }
+        } else if (ch == '"') {
+            quoted = true;
+        } else if (ch == ',') {
+            fields.emplace_back();
+        } else if (ch == '\n' || ch == '\r') {
+            if (fields.size() > 1 || !fields[0].empty()) {
+                lines.push_back(std::move(fields));
+            }
+            fields.assign(1, "");
+        } else {
+            fields.back() += ch;
+        }
+    }
+    if (fields.size() > 1 || !fields[0].empty()) {
+        lines.push_back(std::move(fields));
+    }
+    if (lines.empty() || lines[0].empty() || lines[0][0] != "name") {
+        return false;
+    }
+
+    const auto &header = lines[0];
+    for (size_t n = 1; n < lines.size(); n++) {
+        Record record;
+        record.first = lines[n][0];
+        for (size_t i = 1; i < header.size() && i < lines[n].size(); i++) {
+            char *next = nullptr;
+            double value = strtod(lines[n][i].c_str(), &next);
+            Assign(record.second, header[i], next == lines[n][i].c_str() ? NAN : value);
+        }
+        records.push_back(std::move(record));
+    }
+    return true;
+}
+
+/**
+ * Welch's t-test of two means, true if they differ at the given two-sided significance level.
+ */
+inline bool Significant(const Statistics &a, const Statistics &b, double significance)
+{
+    double na = static_cast<double>(a.samples - a.outliers), nb = static_cast<double>(b.samples - b.outliers);
+    if (na < 2 || nb < 2) {
+        return true; // nothing to test against, trust the threshold alone
+    }
+    double va = a.stddev * a.stddev / na, vb = b.stddev * b.stddev / nb;
+    if (va + vb == 0) {
+        return a.mean != b.mean;
+    }
+    double t = fabs(a.mean - b.mean) / sqrt(va + vb);
+    double df = (va + vb) * (va + vb) / (va * va / (na - 1) + vb * vb / (nb - 1));
+    return t > StudentQuantile(1 - significance / 2, static_cast<size_t>(std::max(df, 1.0)));
+}
+} // namespace details
+
 enum {
     FORMAT_RAW = 0x01,
     FORMAT_REMARK = 0x02,
     FORMAT_TABLE_XTERM = 0x10,
     FORMAT_TABLE_MARKDOWN = 0x20,
     FORMAT_TABLE_LATEX = 0x40,
+    FORMAT_JSON = 0x80,
+    FORMAT_CSV = 0x100,
 };
 
 class ProfilerSet {
@@ -116,9 +1173,43 @@ class ProfilerSet {
 
     void Insert(const std::string &name, double avg, double stddev)
     {
-        collections.emplace_back(name, avg, stddev);
+        Insert(name, Statistics(avg, stddev));
+    }
+
+    void Insert(const std::string &name, const Statistics &stats)
+    {
+        collections.emplace_back(name, stats);
         if (formats & FORMAT_RAW) {
-            std::cout << name << ": avg = " << avg << ", stddev = " << stddev << std::endl;
+            std::cout << name << ": avg = " << stats.mean << ", stddev = " << stats.stddev;
+            if (stats.samples > 0) {
+                std::cout << ", median = " << stats.median << ", p90 = " << stats.p90 << ", p99 = " << stats.p99
+                          << ", p999 = " << stats.p999 << ", ci = [" << stats.ci_lower << ", " << stats.ci_upper << "], samples = " << stats.samples
+                          << "x" << stats.iterations << ", outliers = " << stats.outliers;
+            }
+            if (stats.counters.available) {
+                std::cout << ", cycles/op = " << stats.counters.cycles
+                          << ", instructions/op = " << stats.counters.instructions << ", ipc = " << stats.counters.ipc()
+                          << ", cache-misses/op = " << stats.counters.cache_misses
+                          << ", branch-misses/op = " << stats.counters.branch_misses
+                          << ", task-clock/op = " << stats.counters.task_clock;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    /**
+     * Record a thread scaling curve, printed as its own table after the summary, see AddScaling().
+     */
+    void InsertScaling(const std::string &name, const std::vector<ScalingPoint> &points)
+    {
+        scalings.emplace_back(name, points);
+        if (formats & FORMAT_RAW) {
+            for (auto const &point : points) {
+                std::cout << name << ": threads = " << point.threads << ", throughput = " << point.throughput
+                          << " ops/s, speedup = " << point.throughput / points.front().throughput
+                          << ", p50 = " << point.latency.median << ", p99 = " << point.latency.p99
+                          << ", p999 = " << point.latency.p999 << std::endl;
+            }
         }
     }
 
@@ -128,7 +1219,7 @@ class ProfilerSet {
             return s == another.name;
         });
         if (it != collections.end()) {
-            references.emplace_back(it->name, it->avg, it->stddev);
+            references.emplace_back(it->name, it->stats);
             collections.erase(it);
         } else {
             std::cerr << "Not Found: " << s << std::endl;
@@ -145,15 +1236,147 @@ class ProfilerSet {
         this->formats = formats;
     }
 
+    /**
+     * Load results of a previous run saved by Save(), JSON or CSV, benchmarks of this run are compared against it by
+     * name in the summary table and by Finish().
+     */
+    int LoadBaseline(const std::string &file, const Thresholds &thresholds = Thresholds())
+    {
+        std::ifstream rf(file, std::ios::in | std::ios::binary);
+        if (!rf.good()) {
+            return -errno;
+        }
+        std::stringstream ss;
+        ss << rf.rdbuf();
+        std::string text = ss.str();
+
+        std::vector<details::Record> records;
+        auto first = text.find_first_not_of(" \t\r\n");
+        bool parsed = first != std::string::npos && (text[first] == '{' || text[first] == '[')
+                          ? details::JsonReader(text, records).Parse()
+                          : details::ReadCsv(text, records);
+        if (!parsed) {
+            std::cerr << "Malformed baseline: " << file << std::endl;
+            return -EINVAL;
+        }
+        baseline = std::move(records);
+        this->thresholds = thresholds;
+
+        return 0;
+    }
+
+    /**
+     * Save results to `file`, as CSV if it ends with ".csv" and as JSON otherwise.
+     */
+    int Save(const std::string &file) const
+    {
+        bool csv_format = file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0;
+        std::ofstream wf(file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!wf.good()) {
+            return -errno;
+        }
+        wf << (csv_format ? csv() : json());
+        wf.close();
+
+        return wf.good() ? 0 : -EIO;
+    }
+
+    std::string json() const
+    {
+        std::string exported = "{\n  \"title\": " + details::Quote(title) + ",\n  \"benchmarks\": [";
+        bool first = true;
+        for (auto const *data : {&references, &collections}) {
+            for (auto const &v : *data) {
+                exported += first ? "\n    {" : ",\n    {";
+                exported += "\"name\": " + details::Quote(v.name);
+                for (auto const &field : details::Fields(v.stats)) {
+                    exported += ", \"" + std::string(field.first) + "\": " + details::Number(field.second);
+                }
+                exported += "}";
+                first = false;
+            }
+        }
+        exported += "\n  ]\n}\n";
+
+        return exported;
+    }
+
+    std::string csv() const
+    {
+        std::string exported = "name";
+        for (auto const &field : details::Fields(Statistics())) {
+            exported += ",";
+            exported += field.first;
+        }
+        exported += "\n";
+        for (auto const *data : {&references, &collections}) {
+            for (auto const &v : *data) {
+                exported += details::CsvField(v.name);
+                for (auto const &field : details::Fields(v.stats)) {
+                    std::string number = details::Number(field.second);
+                    exported += "," + (number == "null" ? "" : number);
+                }
+                exported += "\n";
+            }
+        }
+
+        return exported;
+    }
+
+    /**
+     * Number of benchmarks that regressed against the baseline, see Thresholds.
+     */
+    size_t Regressions() const
+    {
+        size_t regressions = 0;
+        for (auto const *data : {&references, &collections}) {
+            for (auto const &v : *data) {
+                double change;
+                if (compare(v, change) == 1) {
+                    regressions++;
+                }
+            }
+        }
+        return regressions;
+    }
+
+    /**
+     * Print the summary in configured formats, and return non-zero if any benchmark regressed against the baseline,
+     * so that it can be returned from main() to fail a build. The summary is printed once, either here or on exit.
+     */
+    int Finish()
+    {
+        if (!finished) {
+            finished = true;
+            report();
+        }
+
+        int exitcode = 0;
+        for (auto const *data : {&references, &collections}) {
+            for (auto const &v : *data) {
+                double change;
+                if (compare(v, change) == 1) {
+                    std::cerr << "Regression: " << v.name << " is " << tabulate::to_string(change * 100)
+                              << "% slower than baseline" << std::endl;
+                    exitcode = 1;
+                }
+            }
+        }
+
+        return exitcode;
+    }
+
   private:
     struct ProfileData {
         double avg;
         double stddev;
+        Statistics stats;
         std::string name;
         std::string package;
         std::string interface;
         std::vector<std::string> keys;
-        ProfileData(const std::string &name, double avg, double stddev) : avg(avg), stddev(stddev), name(name)
+        ProfileData(const std::string &name, const Statistics &stats)
+            : avg(stats.mean), stddev(stats.stddev), stats(stats), name(name)
         {
             std::regex pattern("([\\w\\-:]+)");
             auto key_end = std::sregex_iterator();
@@ -174,16 +1397,106 @@ class ProfilerSet {
     };
     std::string title;
     unsigned int formats;
+    bool finished;
+    Thresholds thresholds;
+    std::vector<details::Record> baseline;
     std::vector<ProfileData> references;
     std::vector<ProfileData> collections;
+    std::vector<std::pair<std::string, std::vector<ScalingPoint>>> scalings;
+
+    /**
+     * Compare with baseline: 1 if regressed, -1 if improved, 0 if unchanged, and 2 if not found in baseline.
+     */
+    int compare(const ProfileData &v, double &change) const
+    {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const details::Record &record) {
+            return record.first == v.name;
+        });
+        if (it == baseline.end() || isnan(it->second.mean) || isnan(v.stats.mean) || it->second.mean <= 0) {
+            return 2;
+        }
+        change = v.stats.mean / it->second.mean - 1;
+        if (!details::Significant(v.stats, it->second, thresholds.significance)) {
+            return 0;
+        }
+        if (change > thresholds.regression) {
+            return 1;
+        }
+        if (change < -thresholds.improvement) {
+            return -1;
+        }
+        return 0;
+    }
 
     void make_summary_table(tabulate::Table &table)
     {
-        if (references.size() == 0) {
-            table.add("brief", "average time\n(nanoseconds)", "instability\n(coefficient of variation)");
-        } else {
-            table.add("brief", "average time\n(nanoseconds)", "instability\n(coefficient of variation)", "rating");
+        bool counters = std::any_of(collections.begin(), collections.end(), [](const ProfileData &v) {
+            return v.stats.counters.available;
+        });
+        std::vector<std::string> header = {"brief", "average time\n(nanoseconds)", "median / p99\n(nanoseconds)",
+                                           tabulate::to_string(DefaultOptions().confidence * 100) + "% CI",
+                                           "instability\n(coefficient of variation)"};
+        if (counters) {
+            header.insert(header.end(), {"IPC", "cache-misses\n(per op)", "branch-misses\n(per op)"});
+        }
+        const size_t versus = header.size();
+        if (baseline.size() != 0) {
+            header.push_back("vs baseline");
         }
+        const size_t rating = header.size();
+        if (references.size() != 0) {
+            header.push_back("rating");
+        }
+        table.add_multiple(header);
+
+        // columns following the average time
+        auto details = [counters](const ProfileData &v) {
+            auto number = [](double value) -> std::string {
+                return isnan(value) ? "N/A" : tabulate::to_string(value);
+            };
+            std::vector<std::string> columns;
+            if (v.stats.samples == 0) {
+                columns.insert(columns.end(), {"N/A", "N/A"});
+            } else {
+                columns.push_back(number(v.stats.median) + " / " + number(v.stats.p99));
+                columns.push_back("[" + number(v.stats.ci_lower) + ", " + number(v.stats.ci_upper) + "]");
+            }
+            columns.push_back(number(v.stddev / v.avg));
+            if (counters) {
+                columns.push_back(number(v.stats.counters.ipc()));
+                columns.push_back(number(v.stats.counters.cache_misses));
+                columns.push_back(number(v.stats.counters.branch_misses));
+            }
+            return columns;
+        };
+        auto make_row = [&](const std::string &name, const std::string &avg, const ProfileData &v) {
+            std::vector<std::string> columns = {name, avg};
+            auto rest = details(v);
+            columns.insert(columns.end(), rest.begin(), rest.end());
+            if (baseline.size() != 0) {
+                double change = 0;
+                int verdict = compare(v, change);
+                std::string delta = (change >= 0 ? "+" : "") + tabulate::to_string(change * 100) + "%";
+                columns.push_back(verdict == 2 ? "N/A"
+                                  : verdict == 1 ? delta + "\n(regressed)"
+                                  : verdict == -1 ? delta + "\n(improved)"
+                                                  : delta);
+            }
+            return columns;
+        };
+        auto decorate = [&](tabulate::Row &row, const ProfileData &v) {
+            double change;
+            if (baseline.size() != 0) {
+                int verdict = compare(v, change);
+                if (verdict == 1) {
+                    row[versus].format().color(tabulate::Color::red).styles(tabulate::Style::bold);
+                } else if (verdict == -1) {
+                    row[versus].format().color(tabulate::Color::green);
+                } else if (verdict == 2) {
+                    row[versus].format().styles(tabulate::Style::italic);
+                }
+            }
+        };
 
         int i = 1;
         for (auto const &v : collections) {
@@ -246,32 +1559,36 @@ class ProfilerSet {
 
                         return diff >= 1.0 ? tabulate::to_string(diff) : ("1/" + tabulate::to_string(1.0 / diff));
                     };
-                    table.add(name, tabulate::to_string(v.avg) + "\n" + tabulate::to_string(ref->avg) + "*",
-                              v.stddev / v.avg, diff_decorator(diff));
+                    auto columns = make_row(name, tabulate::to_string(v.avg) + "\n" + tabulate::to_string(ref->avg) + "*", v);
+                    columns.push_back(diff_decorator(diff));
+                    decorate(table.add_multiple(columns), v);
 
                     if (diff >= 1.2) {
-                        table[i][3].format().color(tabulate::Color::green);
+                        table[i][rating].format().color(tabulate::Color::green);
                         if (diff >= 2.0) {
-                            table[i][3].format().styles(tabulate::Style::bold);
+                            table[i][rating].format().styles(tabulate::Style::bold);
                             if (diff >= 5.0) {
-                                table[i][3].format().styles(tabulate::Style::blink);
+                                table[i][rating].format().styles(tabulate::Style::blink);
                             }
                         }
                     } else if (diff <= 0.8) {
-                        table[i][3].format().color(tabulate::Color::red);
+                        table[i][rating].format().color(tabulate::Color::red);
                         if (diff <= 0.5) {
-                            table[i][3].format().styles(tabulate::Style::bold);
+                            table[i][rating].format().styles(tabulate::Style::bold);
                             if (diff <= 0.2) {
-                                table[i][3].format().styles(tabulate::Style::blink);
+                                table[i][rating].format().styles(tabulate::Style::blink);
                             }
                         }
                     }
                 } else {
-                    auto &row = table.add(v.name, v.avg, v.stddev / v.avg, "N/A");
-                    row[3].format().styles(tabulate::Style::italic);
+                    auto columns = make_row(v.name, tabulate::to_string(v.avg), v);
+                    columns.push_back("N/A");
+                    auto &row = table.add_multiple(columns);
+                    row[rating].format().styles(tabulate::Style::italic);
+                    decorate(row, v);
                 }
             } else {
-                table.add(v.name, v.avg, v.stddev / v.avg);
+                decorate(table.add_multiple(make_row(v.name, tabulate::to_string(v.avg), v)), v);
             }
             i++;
         }
@@ -282,6 +1599,35 @@ class ProfilerSet {
         table.column(0).format().align(tabulate::Align::left);
     }
 
+    static void make_scaling_table(tabulate::Table &table, const std::string &name,
+                                   const std::vector<ScalingPoint> &points)
+    {
+        auto number = [](double value) -> std::string {
+            return isnan(value) ? "N/A" : tabulate::to_string(value);
+        };
+        table.set_title(name + " scaling");
+        table.add_multiple(std::vector<std::string>{"threads", "throughput\n(ops/s)", "speedup", "efficiency",
+                                                    "p50\n(nanoseconds)", "p99\n(nanoseconds)",
+                                                    "p999\n(nanoseconds)"});
+        double base = points.front().throughput;
+        for (auto const &point : points) {
+            double speedup = point.throughput / base;
+            std::vector<std::string> columns = {std::to_string(point.threads),
+                                                number(point.throughput),
+                                                number(speedup),
+                                                number(speedup / static_cast<double>(point.threads)),
+                                                number(point.latency.median),
+                                                number(point.latency.p99),
+                                                number(point.latency.p999)};
+            auto &row = table.add_multiple(columns);
+            if (speedup / static_cast<double>(point.threads) < 0.5) {
+                row[3].format().color(tabulate::Color::red);
+            }
+        }
+        table.format().multi_bytes_character(true);
+        table.format().align(tabulate::Align::center);
+    }
+
     template <typename T, std::enable_if_t<std::is_integral_v<T>> * = nullptr>
     static unsigned count_set_bits(T n)
     {
@@ -293,102 +1639,220 @@ class ProfilerSet {
         return count;
     }
 
-    ProfilerSet() : formats(FORMAT_RAW | FORMAT_TABLE_XTERM | FORMAT_REMARK) {}
+    ProfilerSet() : formats(FORMAT_RAW | FORMAT_TABLE_XTERM | FORMAT_REMARK), finished(false) {}
     ~ProfilerSet()
     {
-        if (collections.size() > 0) {
-            tabulate::Table table;
-            table.set_title(title);
-            make_summary_table(table);
-
-            /**
-             * output all supported format, and you can catch one or more via
-             *
-             * awk '/BEGIN/{ f = 1; next } /END/{ f = 0 } f' all-formats.txt
-             *
-             */
-            bool tag = count_set_bits(formats & ~(FORMAT_RAW | FORMAT_REMARK)) > 1;
-            if (formats & FORMAT_TABLE_XTERM) {
-                if (tag) {
-                    std::cout << "-----BEGIN XTERM TABLE-----" << std::endl;
-                }
-                std::cout << table.xterm() << std::endl;
-                if (tag) {
-                    std::cout << "-----END XTERM TABLE-----" << std::endl;
-                }
-            }
+        if (!finished) {
+            report();
+        }
+    }
 
-            if (formats & FORMAT_TABLE_MARKDOWN) {
-                if (tag) {
-                    std::cout << "-----BEGIN MARKDOWN TABLE-----" << std::endl;
-                }
-                std::cout << table.markdown() << std::endl;
-                if (tag) {
-                    std::cout << "-----END MARKDOWN TABLE-----" << std::endl;
-                }
-            }
+    void report()
+    {
+        if (collections.size() == 0) {
+            return;
+        }
 
-            if (formats & FORMAT_TABLE_LATEX) {
+        /**
+         * output all supported format, and you can catch one or more via
+         *
+         * awk '/BEGIN/{ f = 1; next } /END/{ f = 0 } f' all-formats.txt
+         *
+         */
+        bool tag = count_set_bits(formats & ~(FORMAT_RAW | FORMAT_REMARK)) > 1;
+        auto print = [&](unsigned int format, const char *kind, const std::function<std::string(void)> &text) {
+            if (formats & format) {
                 if (tag) {
-                    std::cout << "-----BEGIN LATEX TABLE-----" << std::endl;
+                    std::cout << "-----BEGIN " << kind << "-----" << std::endl;
                 }
-                std::cout << table.latex() << std::endl;
+                std::cout << text();
                 if (tag) {
-                    std::cout << "-----END LATEX TABLE-----" << std::endl;
+                    std::cout << "-----END " << kind << "-----" << std::endl;
                 }
             }
+        };
+        auto print_table = [&](tabulate::Table &table) {
+            print(FORMAT_TABLE_XTERM, "XTERM TABLE", [&]() {
+                return table.xterm() + "\n";
+            });
+            print(FORMAT_TABLE_MARKDOWN, "MARKDOWN TABLE", [&]() {
+                return table.markdown() + "\n";
+            });
+            print(FORMAT_TABLE_LATEX, "LATEX TABLE", [&]() {
+                return table.latex() + "\n";
+            });
+        };
+
+        tabulate::Table table;
+        table.set_title(title);
+        make_summary_table(table);
+        print_table(table);
+        for (auto const &scaling : scalings) {
+            tabulate::Table curve;
+            make_scaling_table(curve, scaling.first, scaling.second);
+            print_table(curve);
         }
+
+        print(FORMAT_JSON, "JSON", [&]() {
+            return json();
+        });
+        print(FORMAT_CSV, "CSV", [&]() {
+            return csv();
+        });
     }
 };
 
-int CheckAndTune(std::function<bool(void)> task, size_t &repeat)
+/**
+ * Pick iterations per sample so that a sample lasts about Options::sample_ns, used when caller gives no repeat.
+ */
+inline int CheckAndTune(std::function<bool(void)> task, size_t &repeat, const Options &options = DefaultOptions())
 {
     if (repeat == 0) { // auto checking
-        struct timespec ts, te;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t start = Cycles();
         if (!task()) {
             return -EINVAL;
         }
-        clock_gettime(CLOCK_MONOTONIC, &te);
-
-        time_t delta = (te.tv_sec - ts.tv_sec) * 1'000'000'000 + (te.tv_nsec - ts.tv_nsec);
-        if (delta <= 1000) {
-            repeat = 1000;
-        } else {
-            // Aim for about 100ms between time checks.
-            repeat = 100'000'000 / delta;
-            if (repeat > 1000) {
-                repeat = 1000;
-            } else if (repeat < 1) {
-                repeat = 1;
-            }
-        }
+        double delta = ToNanoseconds(CyclesEnd() - start);
+        repeat = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(options.sample_ns) / std::max(delta, 1.0)));
     }
 
     return 0;
 }
 
-inline void Add(const std::string &name, std::function<bool(void)> task, size_t repeat = 0, const size_t N = 5)
+/**
+ * Measure `task` with the benchmark engine, see Options for details.
+ *
+ * @param repeat calls per sample, 0 to choose automatically.
+ * @param N number of samples, 0 to sample until the time budget of DefaultOptions() is spent.
+ */
+inline void Add(const std::string &name, std::function<bool(void)> task, size_t repeat = 0, const size_t N = 0)
 {
-    if (profiler::CheckAndTune(task, repeat) != 0) {
+    Statistics stats;
+    auto sampler = [&task](size_t iterations) {
+        uint64_t start = Cycles();
+        for (size_t i = 0; i < iterations; i++) {
+            task();
+        }
+        uint64_t elapsed = CyclesEnd() - start;
+        return ToNanoseconds(elapsed > CyclesOverhead() ? elapsed - CyclesOverhead() : 0);
+    };
+    if (Measure(task, sampler, stats, repeat, N) != 0) {
         std::cerr << name << ": failed" << std::endl;
         return;
     }
 
-    BENCHER(_, task(), N, repeat);
-    ProfilerSet::Instance().Insert(name, _avg, _stddev);
+    ProfilerSet::Instance().Insert(name, stats);
 }
 
+/**
+ * Measure `task` running on `concurrency` threads simultaneously, durations are wall time divided by the total calls
+ * made by all threads. Threads are spawned and pinned once, and released together for every sample.
+ */
 inline void AddMultiThread(const std::string &name, std::function<bool(void)> task, size_t repeat = 0,
-                           const size_t N = 5, size_t concurrency = std::thread::hardware_concurrency())
+                           const size_t N = 0, size_t concurrency = std::thread::hardware_concurrency())
 {
-    if (profiler::CheckAndTune(task, repeat) != 0) {
+    Statistics stats;
+    ThreadGroup group(concurrency);
+    auto sampler = [&task, &group](size_t iterations) {
+        double elapsed = group.Run([&](size_t) {
+            for (size_t i = 0; i < iterations; i++) {
+                task();
+            }
+        });
+        return elapsed / static_cast<double>(group.size());
+    };
+    // releasing and collecting the group costs a few microseconds, keep it out of the noise
+    Options options = DefaultOptions();
+    options.sample_ns = std::max<uint64_t>(options.sample_ns, 100'000);
+    options.counters = false; // counters follow the calling thread only, which just waits for the group
+    if (Measure(task, sampler, stats, repeat, N, options) != 0) {
         std::cerr << name << ": failed" << std::endl;
         return;
     }
 
-    BENCHER_MULTITHREAD(_, task(), N, repeat, concurrency);
-    ProfilerSet::Instance().Insert(name, _avg, _stddev);
+    ProfilerSet::Instance().Insert(name, stats);
+}
+
+/**
+ * Run `task` on `threads` pinned threads for Options::budget_ns after Options::warmup_ns, and measure throughput with
+ * the latency of single calls.
+ *
+ * `task` gets the index of its thread, and calls returning false (e.g. a pop from an empty queue) are neither counted
+ * nor timed.
+ */
+inline ScalingPoint Concurrent(size_t threads, const std::function<bool(size_t)> &task, bool pin = true)
+{
+    const Options &options = DefaultOptions();
+    const uint64_t overhead = CyclesOverhead();
+    threads = std::max<size_t>(threads, 1);
+    ThreadGroup group(threads, pin);
+    std::vector<Histogram> histograms(threads);
+    std::vector<uint64_t> operations(threads, 0);
+    auto run = [&](uint64_t duration_ns, bool record) {
+        uint64_t deadline = Cycles() + static_cast<uint64_t>(static_cast<double>(duration_ns) * CyclesPerNanosecond());
+        return group.Run([&](size_t id) {
+            Histogram &histogram = histograms[id];
+            uint64_t count = 0;
+            for (uint64_t stop = 0; stop < deadline;) {
+                uint64_t start = Cycles();
+                bool done = task(id);
+                stop = CyclesEnd();
+                if (done) {
+                    count++;
+                    if (record) {
+                        histogram.Record(stop - start > overhead ? stop - start - overhead : 0);
+                    }
+                }
+            }
+            operations[id] = count;
+        });
+    };
+    run(options.warmup_ns, false);
+
+    ScalingPoint point;
+    point.threads = threads;
+    point.elapsed = run(options.budget_ns, true);
+    uint64_t total = 0;
+    for (size_t i = 0; i < threads; i++) {
+        total += operations[i];
+        if (i > 0) {
+            histograms[0].Merge(histograms[i]);
+        }
+    }
+    point.throughput = point.elapsed > 0 ? static_cast<double>(total) * 1e9 / point.elapsed : NAN;
+    point.latency = details::Summarize(histograms[0], options);
+    point.operations = std::move(operations);
+
+    return point;
+}
+
+/**
+ * Sweep `task` over 1, 2, 4, ... up to `max_threads` threads with Concurrent(), and report throughput with the
+ * p50/p99/p999 latency of single calls. Every point is also inserted into the summary as "name(threads=n)".
+ */
+inline std::vector<ScalingPoint> AddScaling(const std::string &name, std::function<bool(size_t)> task,
+                                            size_t max_threads = std::thread::hardware_concurrency(), bool pin = true)
+{
+    max_threads = std::max<size_t>(max_threads, 1);
+    std::vector<size_t> sweep;
+    for (size_t threads = 1; threads < max_threads; threads *= 2) {
+        sweep.push_back(threads);
+    }
+    sweep.push_back(max_threads);
+
+    std::vector<ScalingPoint> points;
+    for (size_t threads : sweep) {
+        points.push_back(Concurrent(threads, task, pin));
+        ProfilerSet::Instance().Insert(name + "(threads=" + std::to_string(threads) + ")", points.back().latency);
+    }
+    ProfilerSet::Instance().InsertScaling(name, points);
+
+    return points;
+}
+
+inline void SetOptions(const Options &options)
+{
+    DefaultOptions() = options;
 }
 
 inline void SetTitle(const std::string &title)
@@ -406,6 +1870,21 @@ inline void AsReference(const std::string &name)
     ProfilerSet::Instance().MarkAsReference(name);
 }
 
+inline int LoadBaseline(const std::string &file, const Thresholds &thresholds = Thresholds())
+{
+    return ProfilerSet::Instance().LoadBaseline(file, thresholds);
+}
+
+inline int Save(const std::string &file)
+{
+    return ProfilerSet::Instance().Save(file);
+}
+
+inline int Finish()
+{
+    return ProfilerSet::Instance().Finish();
+}
+
 template <typename T>
 inline void DoNotOptimize(T const &value)
 {
@@ -28,6 +28,11 @@
 #include <type_traits>        // std::decay_t, std::enable_if_t, std::is_void_v, std::invoke_result_t
 #include <condition_variable> // std::condition_variable
 
+#if !defined(THREADPOOL_TRACE) && defined(LEMON_ASYNC_TRACE)
+#include "logger.h"
+#define THREADPOOL_TRACE(fmt, ...) LOGGER_TRACE(fmt, ##__VA_ARGS__)
+#endif
+
 #ifndef THREADPOOL_TRACE
 #include <math.h>
 #include <time.h>
@@ -49,6 +54,15 @@
     } while (0)
 #endif
 
+#if !defined(THREADPOOL_SPAN) && defined(LEMON_TRACING)
+#include "tracing.h"
+#define THREADPOOL_SPAN(name) TRACING_SPAN(name)
+#endif
+
+#ifndef THREADPOOL_SPAN
+#define THREADPOOL_SPAN(name)
+#endif
+
 #define THREADPOOL_VERSION "v1.2.0 (2022-08-31)"
 
 namespace multiprocessing
@@ -255,10 +269,14 @@ class threadpool {
     {
         while (true) {
             THREADPOOL_TRACE("WORKER[%02zu]: WAIT TASK", id);
-            std::unique_lock<std::mutex> latch(m_queue_lock);
-            m_cond_queued.wait(latch, [this] {
-                return m_stopped || (!m_paused && !m_queued_tasks.empty());
-            });
+            std::unique_lock<std::mutex> latch(m_queue_lock, std::defer_lock);
+            {
+                THREADPOOL_SPAN("threadpool::wait");
+                latch.lock();
+                m_cond_queued.wait(latch, [this] {
+                    return m_stopped || (!m_paused && !m_queued_tasks.empty());
+                });
+            }
             if (!m_queued_tasks.empty()) {
                 auto task = m_queued_tasks.front();
                 m_queued_tasks.pop();
@@ -266,7 +284,10 @@ class threadpool {
 
                 [[maybe_unused]] auto taskid = m_processed.load();
                 THREADPOOL_TRACE("WORKER[%02zu]: TASK[%u] POPPED", id, taskid);
-                m_running++, task(), m_running--, m_unfinished--, m_processed++;
+                {
+                    THREADPOOL_SPAN("threadpool::run");
+                    m_running++, task(), m_running--, m_unfinished--, m_processed++;
+                }
                 THREADPOOL_TRACE("WORKER[%02zu]: TASK[%u] FINISHED", id, taskid);
 
                 latch.lock();
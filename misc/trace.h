@@ -8,6 +8,10 @@
 #define LOCATION(file, line) \
     &file ":" TOSTRING(line)[(__builtin_strrchr(file, '/') ? (__builtin_strrchr(file, '/') - file + 1) : 0)]
 
+#if defined(LEMON_ASYNC_TRACE)
+#include "logger.h"
+#define LEMON_TRACE(fmt, ...) LOGGER_TRACE(fmt, ##__VA_ARGS__)
+#else
 #define LEMON_TRACE(fmt, ...)                                                                           \
     do {                                                                                                \
         char buff[32];                                                                                  \
@@ -16,9 +20,7 @@
         gettimeofday(&tv, NULL);                                                                        \
         localtime_r(&tv.tv_sec, &tm);                                                                   \
         size_t len = strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &tm);                            \
-        snprintf(&buff[len], sizeof(buff) - len, ".%03d", ((tv.tv_usec + 500) / 1000) % 1000);          \
+        snprintf(&buff[len], sizeof(buff) - len, ".%03d", (int)(((tv.tv_usec + 500) / 1000) % 1000));   \
         printf("\033[2;3m%s\033[0m <%s> " fmt "\n", buff, LOCATION(__FILE__, __LINE__), ##__VA_ARGS__); \
     } while (0);
-
-#undef LOCATION
-#undef TOSTRING
+#endif
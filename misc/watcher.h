@@ -0,0 +1,394 @@
+/**
+ * Copyright 2022 Kiran Nowak(kiran.nowak@gmail.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <string_view>
+#include <condition_variable>
+
+#ifndef WATCHER_TRACE
+#define WATCHER_TRACE(fmt, ...)
+#endif
+
+/**
+ * Event driven change detection of files, one inotify instance and one thread for any number of them.
+ *
+ *     int id = watching::Watch("conf/app.ini", [](const std::string &path) { config.Reload(); });
+ *     ...
+ *     watching::Unwatch(id);
+ *
+ * Directories are watched rather than files, so that files replaced by rename, as editors and deployment tools do,
+ * keep being watched. Events of a file are debounced, then its content is hashed and the callback only runs if the
+ * content differs from the last time, which skips touches, rewrites of the same content and partial writes followed
+ * by the final one. Callbacks run on the watcher thread and should hand heavy work off.
+ *
+ * Should a watched directory go away, its files are watched again once it is back, checked twice a second, and
+ * called back if their content differs.
+ */
+namespace watching
+{
+using Callback = std::function<void(const std::string &path)>;
+
+class Watcher {
+  public:
+    static Watcher &Instance()
+    {
+        static Watcher *instance = new Watcher; // never destroyed, static watchers may unwatch at exit
+        return *instance;
+    }
+
+    explicit Watcher(std::chrono::milliseconds debounce = std::chrono::milliseconds(50))
+        : m_debounce(debounce), m_retry(500), m_stopped(false), m_lost(false), m_dispatching(0), m_next_id(1)
+    {
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (m_inotify < 0 || m_wakeup < 0 || m_epoll < 0) {
+            WATCHER_TRACE("watcher disabled, errno = %d", errno);
+            return;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = m_inotify;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_inotify, &ev);
+        ev.data.fd = m_wakeup;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+        m_worker = std::thread(&Watcher::run, this);
+    }
+
+    ~Watcher()
+    {
+        m_stopped = true;
+        notify();
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+        for (int fd : {m_inotify, m_wakeup, m_epoll}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * Quiet time after the last event of a file before it is hashed.
+     */
+    void SetDebounce(std::chrono::milliseconds debounce)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_debounce = debounce;
+    }
+
+    /**
+     * Call `callback` with `path` each time the content of the file changes, returns an id for Unwatch() or -errno.
+     */
+    int Watch(const std::string &path, Callback callback)
+    {
+        if (!m_worker.joinable()) {
+            return -ENOSYS;
+        }
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        bool exists;
+        size_t hash = Hash(path, exists); // before the lock, files may be large
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int wd = inotify_add_watch(m_inotify, directory.c_str(),
+                                   IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                       | IN_ONLYDIR);
+        if (wd < 0) {
+            return -errno;
+        }
+        m_directories[wd]++;
+
+        int id = m_next_id++;
+        Entry &entry = m_entries[id];
+        entry.wd = wd;
+        entry.directory = std::move(directory);
+        entry.name = std::move(name);
+        entry.path = path;
+        entry.callback = std::move(callback);
+        entry.hash = hash;
+        entry.exists = exists;
+        WATCHER_TRACE("watching %s, id = %d, wd = %d", path.c_str(), id, wd);
+        return id;
+    }
+
+    /**
+     * The callback will not be running nor called anymore once this returns, unless called from the callback.
+     */
+    void Unwatch(int id)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(id);
+        if (it == m_entries.end()) {
+            return;
+        }
+        int wd = it->second.wd;
+        m_entries.erase(it);
+        if (auto dir = m_directories.find(wd); wd >= 0 && dir != m_directories.end() && --dir->second == 0) {
+            inotify_rm_watch(m_inotify, wd);
+            m_directories.erase(dir);
+        }
+        while (m_dispatching == id && std::this_thread::get_id() != m_worker.get_id()) {
+            m_dispatched.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+
+  private:
+    struct Entry {
+        int wd; // -1 if the watch of the directory was lost
+        std::string directory, name, path;
+        Callback callback;
+        size_t hash;
+        bool exists;
+        bool pending = false;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    /**
+     * Hash of the content of a regular file, read and hashed block by block. Anything else is taken as missing, and
+     * opened without blocking, e.g. on a FIFO without writer.
+     */
+    static size_t Hash(const std::string &path, bool &exists)
+    {
+        size_t hash = 0;
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        struct stat st;
+        exists = fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (exists) {
+            char buff[16 * 1024];
+            for (bool eof = false; !eof;) {
+                size_t filled = 0; // full blocks but the last, whatever read() returns, for stable hashes
+                while (filled < sizeof(buff)) {
+                    ssize_t n = read(fd, buff + filled, sizeof(buff) - filled);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        eof = true;
+                        break;
+                    }
+                    filled += n;
+                }
+                hash = hash * 1099511628211ULL ^ std::hash<std::string_view>()(std::string_view(buff, filled));
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        return hash;
+    }
+
+    void notify()
+    {
+        if (m_wakeup >= 0) {
+            uint64_t one = 1;
+            [[maybe_unused]] auto n = write(m_wakeup, &one, sizeof(one));
+        }
+    }
+
+    void drain()
+    {
+        alignas(struct inotify_event) char buff[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+        ssize_t len;
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while ((len = read(m_inotify, buff, sizeof(buff))) > 0) {
+            for (char *p = buff; p < buff + len;) {
+                auto *event = reinterpret_cast<struct inotify_event *>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_IGNORED) {
+                    // the directory was removed, or unmounted, its files are watched again once it is back
+                    m_directories.erase(event->wd);
+                    for (auto &[id, entry] : m_entries) {
+                        if (entry.wd == event->wd) {
+                            WATCHER_TRACE("lost the watch of %s, id = %d", entry.path.c_str(), id);
+                            entry.wd = -1;
+                            m_lost = true;
+                        }
+                    }
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue;
+                }
+                for (auto &[id, entry] : m_entries) {
+                    if (entry.wd == event->wd && entry.name == event->name) {
+                        entry.pending = true;
+                        entry.deadline = now + m_debounce;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Watch again the files whose directory watch was lost, those back are hashed once their debounce expires,
+     * returns that deadline.
+     */
+    std::chrono::steady_clock::time_point rewatch()
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lost = false;
+        for (auto &[id, entry] : m_entries) {
+            if (entry.wd >= 0) {
+                continue;
+            }
+            int wd = inotify_add_watch(m_inotify, entry.directory.c_str(),
+                                       IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE
+                                           | IN_MOVED_FROM | IN_ONLYDIR);
+            if (wd < 0) {
+                m_lost = true;
+                continue;
+            }
+            WATCHER_TRACE("watching %s again, id = %d, wd = %d", entry.path.c_str(), id, wd);
+            m_directories[wd]++;
+            entry.wd = wd;
+            entry.pending = true;
+            entry.deadline = now + m_debounce;
+        }
+        return now + m_debounce;
+    }
+
+    /**
+     * Hash the files whose debounce expired and call back those that changed, returns the next deadline. Files are
+     * hashed without the lock, so that Watch() and Unwatch() never wait for a large or slow file.
+     */
+    std::chrono::steady_clock::time_point dispatch()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        std::vector<std::pair<int, std::string>> due;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &[id, entry] : m_entries) {
+                if (!entry.pending) {
+                    continue;
+                }
+                if (entry.deadline > now) {
+                    next = std::min(next, entry.deadline);
+                    continue;
+                }
+                entry.pending = false;
+                due.emplace_back(id, entry.path);
+            }
+        }
+
+        for (auto &[id, path] : due) {
+            bool exists;
+            size_t hash = Hash(path, exists);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(id);
+            if (it == m_entries.end()) {
+                continue; // unwatched meanwhile
+            }
+            Entry &entry = it->second;
+            if (!exists || (entry.exists && hash == entry.hash)) {
+                WATCHER_TRACE("%s %s", path.c_str(), exists ? "unchanged" : "removed");
+                entry.exists = exists;
+                continue;
+            }
+            entry.hash = hash, entry.exists = true;
+
+            Callback callback = entry.callback;
+            m_dispatching = id;
+            lock.unlock();
+            WATCHER_TRACE("%s changed, id = %d", path.c_str(), id);
+            callback(path);
+            lock.lock();
+            m_dispatching = 0;
+            m_dispatched.notify_all();
+        }
+        return next;
+    }
+
+    void run()
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        auto retry = std::chrono::steady_clock::time_point::max();
+        while (!m_stopped) {
+            auto now = std::chrono::steady_clock::now();
+            if (retry <= now) {
+                retry = std::chrono::steady_clock::time_point::max();
+                deadline = std::min(deadline, rewatch());
+            }
+            if (m_lost && retry == std::chrono::steady_clock::time_point::max()) {
+                retry = now + m_retry;
+            }
+            deadline = std::min(deadline, retry);
+            int timeout = -1;
+            if (deadline != std::chrono::steady_clock::time_point::max()) {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::max<long long>(wait.count(), 0));
+            }
+            struct epoll_event events[2];
+            int n = epoll_wait(m_epoll, events, 2, timeout);
+            for (int i = 0; i < n; i++) {
+                if (events[i].data.fd == m_inotify) {
+                    drain();
+                } else {
+                    uint64_t count;
+                    [[maybe_unused]] auto r = read(m_wakeup, &count, sizeof(count));
+                }
+            }
+            deadline = dispatch();
+        }
+    }
+
+    int m_inotify, m_wakeup, m_epoll;
+    std::chrono::milliseconds m_debounce, m_retry;
+    std::atomic<bool> m_stopped;
+    std::atomic<bool> m_lost; // directory watches to add again
+
+    std::mutex m_mutex;
+    std::condition_variable m_dispatched;
+    int m_dispatching; // id of the callback running, 0 if none
+    int m_next_id;
+    std::map<int, Entry> m_entries;
+    std::map<int, size_t> m_directories; // watch descriptor to entries in the directory
+    std::thread m_worker;
+};
+
+inline int Watch(const std::string &path, Callback callback)
+{
+    return Watcher::Instance().Watch(path, std::move(callback));
+}
+
+inline void Unwatch(int id)
+{
+    Watcher::Instance().Unwatch(id);
+}
+} // namespace watching
@@ -0,0 +1,675 @@
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "cxxopt.h"
+#include "profiler.h"
+
+#include <atomic_queue/atomic_queue.h>
+#undef ATOMIC_QUEUE_LIKELY
+#undef ATOMIC_QUEUE_UNLIKELY
+#include "atomic-queue.h"
+#include "caches/LockFreeQueue/LockFreeQueueCpp11.h"
+#include "caches/LockFreeQueue/mpmc_bounded_queue.h"
+#if __has_include(<nstd/Atomic.h>)
+#define HAS_NSTD
+#include "caches/LockFreeQueue/SpinLockQueue.h"
+#include "caches/LockFreeQueue/MutexLockQueue.h"
+#endif
+#include "caches/Ring-Buffer/ringbuffer.hpp"
+#include <spsc/CircularFIFO.h>
+#include <mpsc/CircularFIFO.h>
+#include <spmc/CircularFIFO.h>
+#include <xenium/michael_scott_queue.hpp>
+#include <xenium/ramalhete_queue.hpp>
+#include <xenium/vyukov_bounded_queue.hpp>
+#include <xenium/nikolaev_bounded_queue.hpp>
+#include <xenium/reclamation/generic_epoch_based.hpp>
+
+#ifdef HAS_LIBCDS
+#include <cds/init.h>
+#include <cds/gc/hp.h>
+#include <cds/container/msqueue.h>
+#include <cds/container/vyukov_mpmc_cycle_queue.h>
+#endif
+
+/**
+ * Every queue holds at most CAPACITY elements, the unbounded ones are capped at it as well so that producers can't
+ * run away from consumers, and all of them are driven by the same workloads.
+ */
+static constexpr unsigned CAPACITY_BITS = 16;
+static constexpr size_t CAPACITY = size_t(1) << CAPACITY_BITS;
+
+enum : unsigned {
+    SPSC = 1u << 0,
+    MPSC = 1u << 1,
+    SPMC = 1u << 2,
+    MPMC = 1u << 3,
+    ALL = SPSC | MPSC | SPMC | MPMC,
+};
+
+template <size_t SIZE>
+struct Payload {
+    static_assert(SIZE % sizeof(uint64_t) == 0, "payload must be a multiple of 8 bytes");
+    uint64_t words[SIZE / sizeof(uint64_t)];
+};
+
+/**
+ * Caps an unbounded queue at CAPACITY elements, at the price of a shared counter touched on every operation. A slot is
+ * reserved before the push, and given back if there was none, so that concurrent producers can't overshoot.
+ */
+template <class Queue, class T>
+class Capped {
+  public:
+    bool push(const T &value)
+    {
+        if (count.fetch_add(1, std::memory_order_relaxed) >= static_cast<int64_t>(CAPACITY)) {
+            count.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        queue.push(value);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        if (!queue.try_pop(value)) {
+            return false;
+        }
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+  private:
+    Queue queue;
+    alignas(64) std::atomic<int64_t> count{0};
+};
+
+/**
+ * For queues that only carry scalars (DKit keeps volatile elements, ramalhete_queue pointer sized ones): pass the key
+ * of the payload, its first word, as a pointer, and let the consumer copy the payload out of a pool that is never
+ * written while running. Keys are shifted past the alignment bits and offset by one, so that the pointers are never
+ * null nor marked.
+ */
+template <class Queue, class T>
+class Indirect {
+  public:
+    bool push(const T &value)
+    {
+        return queue.push(reinterpret_cast<T *>((value.words[0] + 1) << 3));
+    }
+
+    bool pop(T &value)
+    {
+        T *pointer;
+        if (!queue.pop(pointer)) {
+            return false;
+        }
+        uint64_t key = (reinterpret_cast<uintptr_t>(pointer) >> 3) - 1;
+        value = pool[key & (CAPACITY - 1)];
+        value.words[0] = key;
+        return true;
+    }
+
+  private:
+    std::vector<T> pool = std::vector<T>(CAPACITY);
+    Queue queue;
+};
+
+template <class T>
+struct LocklessAtomicQueue {
+    static constexpr unsigned kinds = ALL;
+    lockfree::AtomicQueueB2<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.try_push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.try_pop(value);
+    }
+};
+
+template <class T>
+struct UpstreamAtomicQueue {
+    static constexpr unsigned kinds = ALL;
+    atomic_queue::AtomicQueueB2<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.try_push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.try_pop(value);
+    }
+};
+
+template <class T>
+struct UpstreamAtomicQueueSPSC {
+    static constexpr unsigned kinds = SPSC;
+    atomic_queue::AtomicQueueB2<T, std::allocator<T>, true, false, true> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.try_push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.try_pop(value);
+    }
+};
+
+template <class T>
+struct VyukovBoundedQueue {
+    static constexpr unsigned kinds = ALL;
+    mpmc_bounded_queue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct LockFreeQueueCpp11Adapter {
+    static constexpr unsigned kinds = ALL;
+    LockFreeQueueCpp11<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+#ifdef HAS_NSTD
+template <class T>
+struct SpinLockQueueAdapter {
+    static constexpr unsigned kinds = ALL;
+    SpinLockQueue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct MutexLockQueueAdapter {
+    static constexpr unsigned kinds = ALL;
+    MutexLockQueue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+#endif
+
+template <class T>
+struct DKitSPSC {
+    static constexpr unsigned kinds = SPSC;
+    Indirect<dkit::spsc::CircularFIFO<T *, CAPACITY_BITS>, T> queue;
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct DKitMPSC {
+    static constexpr unsigned kinds = SPSC | MPSC;
+    Indirect<dkit::mpsc::CircularFIFO<T *, CAPACITY_BITS>, T> queue;
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct DKitSPMC {
+    static constexpr unsigned kinds = SPSC | SPMC;
+    Indirect<dkit::spmc::CircularFIFO<T *, CAPACITY_BITS>, T> queue;
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct RingBufferSPSCAdapter {
+    static constexpr unsigned kinds = SPSC;
+    caches::RingBufferSPSC<T, CAPACITY, false, 64> queue;
+    bool push(const T &value)
+    {
+        return queue.insert(&value);
+    }
+    bool pop(T &value)
+    {
+        return queue.remove(&value);
+    }
+};
+
+template <class T>
+struct LockFreeRingBufferAdapter {
+    static constexpr unsigned kinds = ALL;
+    caches::LockFreeRingBuffer<T> queue{CAPACITY - 1};
+    bool push(const T &value)
+    {
+        return queue.enqueue(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.dequeue(value);
+    }
+};
+
+using EpochBased = xenium::policy::reclaimer<xenium::reclamation::epoch_based<>>;
+
+template <class T>
+struct MichaelScottQueue {
+    static constexpr unsigned kinds = ALL;
+    Capped<xenium::michael_scott_queue<T, EpochBased>, T> queue;
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct RamalheteQueue {
+    static constexpr unsigned kinds = ALL;
+    Indirect<Capped<xenium::ramalhete_queue<T *, EpochBased>, T *>, T> queue;
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+
+template <class T>
+struct XeniumVyukovBoundedQueue {
+    static constexpr unsigned kinds = ALL;
+    xenium::vyukov_bounded_queue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.try_push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.try_pop(value);
+    }
+};
+
+template <class T>
+struct NikolaevBoundedQueue {
+    static constexpr unsigned kinds = ALL;
+    xenium::nikolaev_bounded_queue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.try_push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.try_pop(value);
+    }
+};
+
+#ifdef HAS_LIBCDS
+/**
+ * Threads using the hazard pointer GC of libcds have to be attached, workers of profiler::Concurrent() attach on first
+ * use and detach on exit.
+ */
+struct CdsThread {
+    CdsThread()
+    {
+        cds::threading::Manager::attachThread();
+    }
+    ~CdsThread()
+    {
+        cds::threading::Manager::detachThread();
+    }
+};
+
+template <class T>
+struct CdsMSQueue {
+    static constexpr unsigned kinds = ALL;
+    cds::container::MSQueue<cds::gc::HP, T> queue;
+    std::atomic<int64_t> count{0};
+    bool push(const T &value)
+    {
+        static thread_local CdsThread attached;
+        if (count.fetch_add(1, std::memory_order_relaxed) >= static_cast<int64_t>(CAPACITY)) {
+            count.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        static thread_local CdsThread attached;
+        if (!queue.pop(value)) {
+            return false;
+        }
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+template <class T>
+struct CdsVyukovQueue {
+    static constexpr unsigned kinds = ALL;
+    cds::container::VyukovMPMCCycleQueue<T> queue{CAPACITY};
+    bool push(const T &value)
+    {
+        return queue.push(value);
+    }
+    bool pop(T &value)
+    {
+        return queue.pop(value);
+    }
+};
+#endif
+
+/**
+ * The baseline every lock-free queue has to beat.
+ */
+template <class T>
+struct MutexDeque {
+    static constexpr unsigned kinds = ALL;
+    std::mutex mutex;
+    std::deque<T> queue;
+    bool push(const T &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= CAPACITY) {
+            return false;
+        }
+        queue.push_back(value);
+        return true;
+    }
+    bool pop(T &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty()) {
+            return false;
+        }
+        value = queue.front();
+        queue.pop_front();
+        return true;
+    }
+};
+
+struct Workload {
+    std::string name;
+    unsigned kind;
+    size_t producers;
+    size_t consumers;
+};
+
+struct Result {
+    std::string queue;
+    double items; //!> items per second passed from producers to consumers
+    profiler::Statistics latency;
+    bool consistent; //!> every pushed item was popped exactly once
+};
+
+/**
+ * Run `workload` on a fresh queue, threads [0, producers) push and the rest pop, then drain the queue and check that
+ * nothing was lost or duplicated: items are keyed by their producer and sequence number, and the counts, sums and
+ * xors of the keys pushed and popped must match, which a lost item and a duplicated one cannot compensate. Results of
+ * inconsistent runs are not published.
+ */
+template <template <class> class Queue, size_t SIZE>
+void Run(const std::string &name, const Workload &workload, std::vector<Result> &results)
+{
+    using T = Payload<SIZE>;
+    if ((Queue<T>::kinds & workload.kind) == 0) {
+        return;
+    }
+
+    struct alignas(64) Counter {
+        uint64_t value = 0, sum = 0, xored = 0;
+
+        void count(uint64_t key)
+        {
+            value++, sum += key, xored ^= key;
+        }
+    };
+    auto queue = std::make_unique<Queue<T>>();
+    std::vector<Counter> pushed(workload.producers), popped(workload.consumers);
+    auto point = profiler::Concurrent(workload.producers + workload.consumers, [&](size_t id) {
+        T item{};
+        if (id < workload.producers) {
+            item.words[0] = static_cast<uint64_t>(id) << 32 | pushed[id].value;
+            if (!queue->push(item)) {
+                return false;
+            }
+            pushed[id].count(item.words[0]);
+        } else {
+            if (!queue->pop(item)) {
+                return false;
+            }
+            popped[id - workload.producers].count(item.words[0]);
+        }
+        return true;
+    });
+
+    Counter in, out;
+    uint64_t consumed = 0;
+    for (auto const &counter : pushed) {
+        in.value += counter.value, in.sum += counter.sum, in.xored ^= counter.xored;
+    }
+    for (auto const &counter : popped) {
+        out.value += counter.value, out.sum += counter.sum, out.xored ^= counter.xored;
+    }
+    for (T item; queue->pop(item);) {
+        out.count(item.words[0]);
+    }
+    for (size_t i = workload.producers; i < point.operations.size(); i++) {
+        consumed += point.operations[i];
+    }
+
+    Result result;
+    result.queue = name;
+    result.items = point.elapsed > 0 ? static_cast<double>(consumed) * 1e9 / point.elapsed : 0;
+    result.latency = point.latency;
+    result.consistent = in.value == out.value && in.sum == out.sum && in.xored == out.xored;
+    results.push_back(result);
+    if (result.consistent) {
+        profiler::ProfilerSet::Instance().Insert(name + "(" + workload.name + "," + std::to_string(SIZE) + "B)",
+                                                 point.latency);
+    }
+}
+
+template <size_t SIZE>
+std::vector<Result> RunAll(const Workload &workload)
+{
+    std::vector<Result> results;
+    Run<MutexDeque, SIZE>("std::mutex+std::deque", workload, results);
+    Run<LocklessAtomicQueue, SIZE>("lockfree::AtomicQueueB2", workload, results);
+    Run<UpstreamAtomicQueue, SIZE>("atomic_queue::AtomicQueueB2", workload, results);
+    Run<UpstreamAtomicQueueSPSC, SIZE>("atomic_queue::AtomicQueueB2(spsc)", workload, results);
+    Run<VyukovBoundedQueue, SIZE>("mpmc_bounded_queue", workload, results);
+    Run<LockFreeQueueCpp11Adapter, SIZE>("LockFreeQueueCpp11", workload, results);
+#ifdef HAS_NSTD
+    Run<SpinLockQueueAdapter, SIZE>("SpinLockQueue", workload, results);
+    Run<MutexLockQueueAdapter, SIZE>("MutexLockQueue", workload, results);
+#endif
+    Run<DKitSPSC, SIZE>("dkit::spsc::CircularFIFO(pointers)", workload, results);
+    Run<DKitMPSC, SIZE>("dkit::mpsc::CircularFIFO(pointers)", workload, results);
+    Run<DKitSPMC, SIZE>("dkit::spmc::CircularFIFO(pointers)", workload, results);
+    Run<RingBufferSPSCAdapter, SIZE>("caches::RingBufferSPSC", workload, results);
+    Run<LockFreeRingBufferAdapter, SIZE>("caches::LockFreeRingBuffer", workload, results);
+    Run<MichaelScottQueue, SIZE>("xenium::michael_scott_queue", workload, results);
+    Run<RamalheteQueue, SIZE>("xenium::ramalhete_queue(pointers)", workload, results);
+    Run<XeniumVyukovBoundedQueue, SIZE>("xenium::vyukov_bounded_queue", workload, results);
+    // left out: xenium::nikolaev_queue loses an item or two per 100K under MPMC, outside of this harness as well
+    Run<NikolaevBoundedQueue, SIZE>("xenium::nikolaev_bounded_queue", workload, results);
+#ifdef HAS_LIBCDS
+    Run<CdsMSQueue, SIZE>("cds::container::MSQueue<HP>", workload, results);
+    Run<CdsVyukovQueue, SIZE>("cds::container::VyukovMPMCCycleQueue", workload, results);
+#endif
+    std::sort(results.begin(), results.end(), [](const Result &a, const Result &b) {
+        return a.consistent != b.consistent ? a.consistent : a.items > b.items;
+    });
+
+    return results;
+}
+
+void Report(const std::string &title, const std::vector<Result> &results, bool markdown)
+{
+    auto number = [](double value) -> std::string {
+        return isnan(value) ? "N/A" : tabulate::to_string(value);
+    };
+    tabulate::Table table;
+    table.set_title(title);
+    table.add_multiple(std::vector<std::string>{"queue", "throughput\n(Mitems/s)", "relative", "p50\n(nanoseconds)",
+                                                "p99\n(nanoseconds)", "p999\n(nanoseconds)", "consistent"});
+    for (auto const &result : results) {
+        if (!result.consistent) { // numbers of a broken queue mean nothing
+            table.add_multiple(std::vector<std::string>{result.queue, "N/A", "N/A", "N/A", "N/A", "N/A", "NO"});
+            continue;
+        }
+        table.add_multiple(std::vector<std::string>{result.queue, number(result.items / 1e6),
+                                                    number(result.items / results.front().items),
+                                                    number(result.latency.median), number(result.latency.p99),
+                                                    number(result.latency.p999), "yes"});
+    }
+    table.format().multi_bytes_character(true);
+    table.format().align(tabulate::Align::center);
+    table.column(0).format().align(tabulate::Align::left);
+    if (!results.empty()) {
+        table[1][1].format().color(tabulate::Color::green).styles(tabulate::Style::bold);
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i].consistent) {
+            table[i + 1][6].format().color(tabulate::Color::red).styles(tabulate::Style::bold);
+        }
+    }
+    std::cout << (markdown ? table.markdown() : table.xterm()) << std::endl;
+}
+
+int main()
+{
+    size_t half = std::max<size_t>(std::thread::hardware_concurrency() / 2, 2);
+    size_t producers = getarg(half, "--producers"), consumers = getarg(half, "--consumers");
+    bool markdown = getarg(false, "--markdown");
+
+    profiler::Options options;
+    options.warmup_ns = getarg(20, "--warmup") * 1'000'000;
+    options.budget_ns = getarg(200, "--budget") * 1'000'000;
+    profiler::SetOptions(options);
+
+    unsigned int formats = 0;
+    formats |= getarg(false, "--json") ? profiler::FORMAT_JSON : 0;
+    formats |= getarg(false, "--csv") ? profiler::FORMAT_CSV : 0;
+    profiler::SetFormats(formats);
+
+    std::vector<Workload> workloads;
+    if (getarg(false, "--spsc", "--all")) {
+        workloads.push_back({"spsc", SPSC, 1, 1});
+    }
+    if (getarg(false, "--mpsc", "--all")) {
+        workloads.push_back({"mpsc", MPSC, producers, 1});
+    }
+    if (getarg(false, "--spmc", "--all")) {
+        workloads.push_back({"spmc", SPMC, 1, consumers});
+    }
+    if (getarg(false, "--mpmc", "--all")) {
+        workloads.push_back({"mpmc", MPMC, producers, consumers});
+    }
+    if (workloads.empty()) {
+        std::cout << "usage: caches-queue-bench [--spsc] [--mpsc] [--spmc] [--mpmc] [--all] [--producers=N] "
+                     "[--consumers=N] [--payload=8|64|0] [--warmup=ms] [--budget=ms] [--markdown] [--json] [--csv] "
+                     "[--save=file]"
+                  << std::endl;
+        return 0;
+    }
+
+#ifdef HAS_LIBCDS
+    cds::Initialize();
+    cds::gc::HP hazard_pointers;
+#endif
+
+    size_t payload = getarg(0, "--payload");
+    std::vector<std::pair<std::string, std::vector<Result>>> picks;
+    for (auto const &workload : workloads) {
+        std::string title = workload.name + ", " + std::to_string(workload.producers) + " producer(s) x " +
+                            std::to_string(workload.consumers) + " consumer(s)";
+        if (payload == 0 || payload == 8) {
+            picks.emplace_back(title + ", 8-byte payload", RunAll<8>(workload));
+            Report(picks.back().first, picks.back().second, markdown);
+        }
+        if (payload == 0 || payload == 64) {
+            picks.emplace_back(title + ", 64-byte payload", RunAll<64>(workload));
+            Report(picks.back().first, picks.back().second, markdown);
+        }
+    }
+
+    tabulate::Table summary;
+    summary.set_title("Picks");
+    summary.add_multiple(std::vector<std::string>{"use case", "highest throughput", "lowest p99"});
+    for (auto const &pick : picks) {
+        std::vector<const Result *> candidates;
+        for (auto const &result : pick.second) {
+            if (result.consistent) {
+                candidates.push_back(&result);
+            }
+        }
+        if (candidates.empty()) {
+            continue;
+        }
+        auto tail = std::min_element(candidates.begin(), candidates.end(), [](const Result *a, const Result *b) {
+            return a->latency.p99 < b->latency.p99;
+        });
+        summary.add_multiple(std::vector<std::string>{pick.first, candidates.front()->queue, (*tail)->queue});
+    }
+    summary.format().multi_bytes_character(true);
+    std::cout << (markdown ? summary.markdown() : summary.xterm()) << std::endl;
+
+    if (const char *file = getarg("", "--save"); *file) {
+        if (int err = profiler::Save(file); err != 0) {
+            std::cerr << "Failed to save " << file << ": " << strerror(-err) << std::endl;
+        }
+    }
+
+    return profiler::Finish();
+}
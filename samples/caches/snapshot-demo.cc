@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "profiler.h"
+#include "lemon/ini.h"
+#include "caches/reloading.h"
+
+struct Config {
+    Config(const char *file) : file(file) {}
+
+    int Reload()
+    {
+        parser.Reset();
+        return parser.LoadFile(file.c_str());
+    }
+
+    std::string file;
+    lemon::INIParser parser;
+};
+
+/**
+ * Replace the file in one step, `a` and `b` always hold the same value.
+ */
+static void Save(const char *file, size_t version)
+{
+    std::string tmpfile = std::string(file) + ".tmp";
+    std::ofstream(tmpfile) << "[section]\na = " << version << "\nfiller = " << std::string(version % 1000, 'x')
+                           << "\nb = " << version << "\n";
+    rename(tmpfile.c_str(), file);
+}
+
+template <typename Reader>
+static size_t Check(const char *name, size_t readers, size_t seconds, Reader reader, std::function<void()> reload)
+{
+    std::atomic<bool> stopped{false};
+    std::atomic<size_t> reads{0}, torn{0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < readers; i++) {
+        workers.emplace_back([&]() {
+            size_t count = 0;
+            while (!stopped.load(std::memory_order_relaxed)) {
+                if (!reader()) {
+                    torn++;
+                }
+                count++;
+            }
+            reads += count;
+        });
+    }
+
+    size_t version = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+        Save("snapshot-demo.ini", ++version);
+        reload();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stopped = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    std::cout << name << ": " << reads << " reads, " << version << " writes, " << torn << " torn" << std::endl;
+    return torn;
+}
+
+int main()
+{
+    size_t readers = getarg(4, "--readers"), seconds = getarg(2, "--seconds");
+
+    Save("snapshot-demo.ini", 0);
+    size_t torn = 0;
+    {
+        caches::SnapshotReloading<Config> config(0, "snapshot-demo.ini");
+        torn += Check(
+            "caches::SnapshotReloading", readers, seconds,
+            [&config]() {
+                auto snapshot = config.GetSnapshot();
+                const char *a = snapshot->parser.GetValue("section", "a", "");
+                const char *b = snapshot->parser.GetValue("section", "b", "");
+                return strcmp(a, b) == 0;
+            },
+            [&config]() {
+                config.Reload();
+            });
+    }
+    {
+        lemon::INISnapshotFile<lemon::INI_GenericNoCase> config("snapshot-demo.ini", 0);
+        torn += Check(
+            "lemon::INISnapshotFile", readers, seconds,
+            [&config]() {
+                auto snapshot = config.GetSnapshot();
+                const char *a = snapshot->GetValue("section", "a", "");
+                const char *b = snapshot->GetValue("section", "b", "");
+                return strcmp(a, b) == 0;
+            },
+            [&config]() {
+                config.Reload();
+            });
+    }
+    if (torn != 0) {
+        std::cerr << "readers saw torn configs" << std::endl;
+        return 1;
+    }
+
+    if (getarg(false, "--bench")) {
+        caches::Reloading<Config> reloading(3600, "snapshot-demo.ini");
+        caches::SnapshotReloading<Config> snapshots(3600, "snapshot-demo.ini");
+        profiler::SetTitle("cost of a read");
+        profiler::Add("read(Reloading::GetActivated)", [&reloading]() {
+            return reloading.GetActivated().parser.GetValue("section", "a") != nullptr;
+        });
+        profiler::Add("read(SnapshotReloading::GetSnapshot)", [&snapshots]() {
+            return snapshots.GetSnapshot()->parser.GetValue("section", "a") != nullptr;
+        });
+        profiler::AsReference("read(Reloading::GetActivated)");
+    }
+
+    return 0;
+}
@@ -17,6 +17,8 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <set>
 #include <variant>
 #include <atomic>
@@ -35,31 +37,49 @@ namespace conf
 {
 namespace conv
 {
+static inline std::string_view trimmed(std::string_view s)
+{
+    size_t begin = 0, end = s.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(s[begin]))) {
+        begin++;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
+        end--;
+    }
+    return s.substr(begin, end - begin);
+}
+
 static inline std::string trim(const std::string &s)
 {
-    std::string tmp = s;
-    tmp.erase(tmp.begin(), std::find_if(tmp.begin(), tmp.end(), [](unsigned char ch) {
-                  return !std::isspace(ch);
-              }));
-
-    tmp.erase(std::find_if(tmp.rbegin(), tmp.rend(),
-                           [](unsigned char ch) {
-                               return !std::isspace(ch);
-                           })
-                  .base(),
-              tmp.end());
-    return tmp;
+    return std::string(trimmed(s));
 }
 
-int derive(const std::string &from, bool &to)
+/**
+ * Call `consume` with each of the `delimiter` separated pieces of `from`, empty ones included, as std::getline()
+ * would give them, stops at the first error.
+ */
+template <typename Consumer>
+static inline int pieces(std::string_view from, char delimiter, Consumer &&consume)
 {
-    std::string tmp = trim(from);
-    const char *p = tmp.c_str();
+    for (size_t start = 0;;) {
+        size_t end = from.find(delimiter, start);
+        if (int err = consume(from.substr(start, end == std::string_view::npos ? end : end - start)); err != 0) {
+            return err;
+        }
+        if (end == std::string_view::npos) {
+            return 0;
+        }
+        start = end + 1;
+    }
+}
 
-    char l = *p | ' ';
-    if ((l == 't' && strncmp(++p, "rue\0", 4) == 0) || strncmp(p, "1\0", 2) == 0) {
+int derive(std::string_view from, bool &to)
+{
+    std::string_view tmp = trimmed(from);
+    char l = tmp.empty() ? '\0' : tmp[0] | ' ';
+    if ((l == 't' && tmp.substr(1) == "rue") || tmp == "1") {
         to = true;
-    } else if ((l == 'f' && strncmp(++p, "alse\0", 5) == 0) || strncmp(p, "0\0", 2) == 0) {
+    } else if ((l == 'f' && tmp.substr(1) == "alse") || tmp == "0") {
         to = false;
     } else {
         return -EINVAL;
@@ -68,25 +88,37 @@ int derive(const std::string &from, bool &to)
     return 0;
 }
 
-int derive(const std::string &from, std::string &to)
+int derive(std::string_view from, std::string &to)
 {
-    to = from;
+    to.assign(from.data(), from.size());
     return 0;
 }
 
 template <typename T, typename std::enable_if<std::is_integral<T>::value>::type * = nullptr>
-int derive(const std::string &from, T &to)
+int derive(std::string_view from, T &to)
 {
-    std::string tmp = trim(from);
+    std::string_view tmp = trimmed(from);
     if (tmp.empty()) {
         return -EINVAL;
     }
 
-    bool negative = false;
-    if (tmp[0] == '-') {
-        negative = true;
+    bool negative = tmp[0] == '-';
+    if (negative || tmp[0] == '+') {
+        tmp.remove_prefix(1);
+    }
+    // base 0 of strtoull(): hexadecimal after "0x", octal after a leading '0'
+    int base = 10;
+    if (tmp.size() > 1 && tmp[0] == '0') {
+        base = 8;
+        if ((tmp[1] | ' ') == 'x') {
+            base = 16;
+            tmp.remove_prefix(2);
+        }
+    }
+    unsigned long long v = 0;
+    if (auto [end, ec] = std::from_chars(tmp.data(), tmp.data() + tmp.size(), v, base); ec != std::errc()) {
+        return ec == std::errc::result_out_of_range ? -ERANGE : -EINVAL;
     }
-    unsigned long long v = std::stoull(negative ? tmp.substr(1) : tmp, nullptr, 0);
 
     to = static_cast<T>(v) * (negative ? -1 : 1);
 
@@ -110,103 +142,109 @@ struct opStreamExists {
     enum { value = (sizeof(test<T>(0)) == sizeof(yes)) };
 };
 
-template <typename T, typename std::enable_if<(std::is_arithmetic<T>::value && !std::is_integral<T>::value)
-                                              || opStreamExists<T>::value>::type * = nullptr>
-int derive(const std::string &from, T &to)
+template <typename T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
+int derive(std::string_view from, T &to)
+{
+    std::string_view tmp = trimmed(from);
+    if (!tmp.empty() && tmp[0] == '+') {
+        tmp.remove_prefix(1);
+    }
+    if (auto [end, ec] = std::from_chars(tmp.data(), tmp.data() + tmp.size(), to); ec != std::errc()) {
+        TRACE("[from-string] Error(%d): derive failed(from = %.*s)", -EINVAL, (int)from.size(), from.data());
+        return -EINVAL;
+    }
+    return 0;
+}
+
+template <typename T,
+          typename std::enable_if<!std::is_arithmetic<T>::value && opStreamExists<T>::value>::type * = nullptr>
+int derive(std::string_view from, T &to)
 {
-    std::stringstream in(from);
+    std::stringstream in{std::string(from)};
     in >> to;
     if (!in) {
-        TRACE("[from-string] Error(%d): derive failed(from = %s)", -EINVAL, from.c_str());
+        TRACE("[from-string] Error(%d): derive failed(from = %.*s)", -EINVAL, (int)from.size(), from.data());
         return -EINVAL;
     }
     return 0;
 }
 
 template <typename T, typename std::enable_if<std::is_base_of<google::protobuf::Message, T>::value>::type * = nullptr>
-int derive(const std::string &from, T &to)
+int derive(std::string_view from, T &to)
 {
-    return to.ParseFromString(from);
+    return to.ParseFromArray(from.data(), static_cast<int>(from.size())) ? 0 : -EINVAL;
 }
 
 template <typename To>
-int derive(const std::string &from, std::vector<To> &to)
+int derive(std::string_view from, std::vector<To> &to)
 {
-    std::string tmp = trim(from);
+    std::string_view tmp = trimmed(from);
     if (tmp.empty()) {
         to.clear();
         TRACE("[from-string] Warning: Empty");
         return 0;
     }
     if (tmp[0] == '[' || tmp[0] == '{') {
-        tmp = tmp.substr(1);
+        tmp.remove_prefix(1);
     }
-    if (tmp[tmp.size() - 1] == ']' || tmp[tmp.size() - 1] == '}') {
-        tmp = tmp.erase(tmp.size() - 1, 1);
+    if (!tmp.empty() && (tmp.back() == ']' || tmp.back() == '}')) {
+        tmp.remove_suffix(1);
     }
 
-    std::stringstream ss(tmp);
-    while (ss.good()) {
-        std::getline(ss, tmp, ',');
-
+    return pieces(tmp, ',', [&to](std::string_view piece) {
         To item;
-        if (int err = derive(tmp, item); err != 0) {
-            TRACE("[from-string] Error(%d): derive failed(from = %s)", err, tmp.c_str());
+        if (int err = derive(piece, item); err != 0) {
+            TRACE("[from-string] Error(%d): derive failed(from = %.*s)", err, (int)piece.size(), piece.data());
             return err;
         }
-        to.push_back(item);
-    }
-
-    return 0;
+        to.push_back(std::move(item));
+        return 0;
+    });
 }
 
 template <typename Key, typename Value, class Hash = std::hash<Key>>
-int derive(const std::string &from, std::unordered_map<Key, Value, Hash> &to)
+int derive(std::string_view from, std::unordered_map<Key, Value, Hash> &to)
 {
-    std::string tmp = trim(from);
+    std::string_view tmp = trimmed(from);
     if (tmp.empty()) {
         to.clear();
         return 0;
     }
-    std::stringstream ss(tmp);
-    while (ss.good()) {
-        std::string blk;
-        std::getline(ss, blk, ';');
-        {
-            trim(blk);
-            auto it = blk.find(':');
-            if (it == std::string::npos) {
-                return -EINVAL;
-            }
-            Key key;
-            if (int err = derive(blk.substr(0, it), key); err == 0) {
-                Value val;
-                if (int err = derive(blk.substr(it + 1), val); err != 0) {
-                    TRACE("[from-string] Error(%d): derive failed(from = %s)", err, blk.substr(it + 1).c_str());
-                    return err;
-                }
-                to[key] = val;
+    return pieces(tmp, ';', [&to](std::string_view blk) {
+        auto it = blk.find(':');
+        if (it == std::string_view::npos) {
+            return -EINVAL;
+        }
+        Key key;
+        if (int err = derive(blk.substr(0, it), key); err == 0) {
+            Value val;
+            if (int err = derive(blk.substr(it + 1), val); err != 0) {
+                TRACE("[from-string] Error(%d): derive failed(from = %.*s)", err, (int)(blk.size() - it - 1),
+                      blk.data() + it + 1);
+                return err;
             }
+            to[std::move(key)] = std::move(val);
         }
-    }
-
-    return 0;
+        return 0;
+    });
 }
 
 template <typename T>
-int derive(const std::string &from, std::vector<std::vector<T>> &to)
+int derive(std::string_view from, std::vector<std::vector<T>> &to)
 {
-    std::string tmp = trim(from);
+    std::string_view tmp = trimmed(from);
     if (tmp.empty()) {
         to.clear();
         return 0;
     }
-    const char *s = tmp.c_str(), *p = s;
-    const char *e = tmp.c_str() + tmp.length();
+    auto at = [&tmp](size_t i) {
+        return i < tmp.size() ? tmp[i] : '\0';
+    };
+    size_t s = 0, p = 0, e = tmp.size();
 
     int depth = 0;
     while (p <= e) {
-        if (*p == '[' || *p == '{') {
+        if (at(p) == '[' || at(p) == '{') {
             if (depth == 0) {
                 s = ++p;
             } else {
@@ -214,22 +252,22 @@ int derive(const std::string &from, std::vector<std::vector<T>> &to)
             }
             depth++;
             do {
-                if (*p == '[' || *p == '{') {
+                if (at(p) == '[' || at(p) == '{') {
                     depth++;
-                } else if (*p == ']' || *p == '}') {
+                } else if (at(p) == ']' || at(p) == '}') {
                     depth--;
                 }
                 p++;
-            } while (*p != '\0' && depth != 1);
+            } while (at(p) != '\0' && depth != 1);
 
             std::vector<T> vec;
-            if (int err = derive(std::string(s, p++ - s), vec); err != 0) {
-                TRACE("[from-string] Error(%d): derive failed(from = %s)", err, std::string(s, p - s).c_str());
+            if (int err = derive(tmp.substr(s, p++ - s), vec); err != 0) {
+                TRACE("[from-string] Error(%d): derive failed(from = %.*s)", err, (int)(p - s), tmp.data() + s);
                 return err;
             }
-            to.push_back(vec);
+            to.push_back(std::move(vec));
 
-            while (*p == ',' || *p == ' ') {
+            while (at(p) == ',' || at(p) == ' ') {
                 p++;
             }
         } else {
@@ -246,12 +284,19 @@ int derive(const bool &from, std::string &to)
     return 0;
 }
 
+/** As `ostream << from`, without the stream */
 template <typename From, typename std::enable_if<std::is_arithmetic<From>::value>::type * = nullptr>
 int derive(const From &from, std::string &to)
 {
-    std::stringstream ss;
-    ss << from;
-    to = ss.str();
+    char buffer[64];
+    if constexpr (std::is_same<From, char>::value || std::is_same<From, signed char>::value
+                  || std::is_same<From, unsigned char>::value) {
+        to.assign(1, static_cast<char>(from));
+    } else if constexpr (std::is_floating_point<From>::value) {
+        to.assign(buffer, std::to_chars(buffer, buffer + sizeof(buffer), from, std::chars_format::general, 6).ptr);
+    } else {
+        to.assign(buffer, std::to_chars(buffer, buffer + sizeof(buffer), from).ptr);
+    }
 
     return 0;
 }
@@ -266,16 +311,15 @@ template <typename T>
 int derive(const std::vector<T> &from, std::string &to)
 {
     to = "[";
-    const std::string delim = ", ";
+    std::string str;
     for (auto const &e : from) {
-        if (std::string str; derive(e, str) == 0) {
-            to += str + delim;
-        } else {
+        if (derive(e, str) != 0) {
             return -EINVAL;
         }
-    }
-    if (from.size() != 0) {
-        to.erase(to.size() - delim.size(), delim.size());
+        if (&e != &from.front()) {
+            to += ", ";
+        }
+        to += str;
     }
     to += "]";
 
@@ -285,8 +329,8 @@ int derive(const std::vector<T> &from, std::string &to)
 template <typename K, typename V, class Hash = std::hash<K>>
 int derive(const std::unordered_map<K, V, Hash> &from, std::string &to)
 {
+    std::string key, val;
     for (auto const &e : from) {
-        std::string key, val;
         if (int err = derive(e.first, key); err != 0) {
             TRACE("[to-string] Error(%d): derive failed", err);
             return err;
@@ -295,7 +339,10 @@ int derive(const std::unordered_map<K, V, Hash> &from, std::string &to)
             TRACE("[to-string] Error(%d): derive failed", err);
             return err;
         }
-        to += key + ": " + val + "; ";
+        to += key;
+        to += ": ";
+        to += val;
+        to += "; ";
     }
     if (to.size() >= 2) {
         to.erase(to.size() - 2, 2); // pop last delimeters
@@ -305,7 +352,7 @@ int derive(const std::unordered_map<K, V, Hash> &from, std::string &to)
 }
 
 template <typename To>
-int derive(const std::string &from, To &to)
+int derive(std::string_view from, To &to)
 {
     TRACE("[from-string] Error(%d): Not Implemented", -ENOSYS);
     return -ENOSYS;
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "profiler.h"
+
+/**
+ * The conversions as they were, through std::string temporaries and streams, for reference.
+ */
+namespace legacy
+{
+inline void derive(const std::string &self, long &to)
+{
+    std::string formated = cxxopt::details::trim(self);
+    bool negative = !formated.empty() && formated[0] == '-';
+    to = formated.empty() ? 0 : static_cast<long>(std::stoull(negative ? formated.substr(1) : formated, nullptr, 0));
+    to *= negative ? -1 : 1;
+}
+
+inline void derive(const std::string &self, double &to)
+{
+    std::stringstream in(self);
+    in >> to;
+}
+
+template <typename T>
+inline void derive(const std::string &self, std::vector<T> &repeated)
+{
+    std::string token;
+    for (char ch : self.substr(1, self.size() - 2)) {
+        if (ch == ',') {
+            T t;
+            derive(token, t);
+            repeated.emplace_back(t);
+            token.clear();
+        } else {
+            token += ch;
+        }
+    }
+    if (!token.empty()) {
+        T t;
+        derive(token, t);
+        repeated.emplace_back(t);
+    }
+}
+
+inline void derive(const long &from, std::string &to)
+{
+    std::stringstream ss;
+    ss << from;
+    to = ss.str();
+}
+} // namespace legacy
+
+int main()
+{
+    size_t count = getarg(1000, "--count");
+    std::string integers = "[", doubles = "[";
+    for (size_t i = 0; i < count; i++) {
+        integers += (i ? ", " : "") + std::to_string(i * 7919 % 100003 - 50000);
+        doubles += (i ? ", " : "") + std::to_string(i * 0.37);
+    }
+    integers += "]", doubles += "]";
+
+    // same values through both paths
+    std::vector<long> li, ni;
+    std::vector<double> ld, nd;
+    legacy::derive(integers, li), cxxopt::details::derive(integers, ni);
+    legacy::derive(doubles, ld), cxxopt::details::derive(doubles, nd);
+    std::string ls, ns;
+    legacy::derive(li.back(), ls), cxxopt::details::derive(ni.back(), ns);
+    bool same = li == ni && ld == nd && ls == ns && cxxopt::details::as(1.5) == "1.5";
+    for (auto &[text, expected] : std::vector<std::pair<std::string, int>>{{"0x1f", 31}, {" -010 ", -8}, {"+7", 7}}) {
+        same &= cxxopt::details::as<int>(text) == expected;
+    }
+    std::cout << count << " integers and doubles: " << (same ? "same" : "differ") << std::endl;
+    if (!same) {
+        return 1;
+    }
+
+    if (getarg(false, "--bench")) {
+        profiler::SetTitle("derive() of " + std::to_string(count) + " values");
+        profiler::Add("vector<long>(std::string + stoull)", [&integers]() {
+            std::vector<long> v;
+            legacy::derive(integers, v);
+            return !v.empty();
+        });
+        profiler::Add("vector<long>(string_view + from_chars)", [&integers]() {
+            std::vector<long> v;
+            cxxopt::details::derive(integers, v);
+            return !v.empty();
+        });
+        profiler::Add("vector<double>(std::string + stringstream)", [&doubles]() {
+            std::vector<double> v;
+            legacy::derive(doubles, v);
+            return !v.empty();
+        });
+        profiler::Add("vector<double>(string_view + from_chars)", [&doubles]() {
+            std::vector<double> v;
+            cxxopt::details::derive(doubles, v);
+            return !v.empty();
+        });
+        profiler::Add("to string(stringstream)", [&li]() {
+            std::string s;
+            for (long v : li) {
+                legacy::derive(v, s);
+            }
+            return !s.empty();
+        });
+        profiler::Add("to string(to_chars)", [&li]() {
+            std::string s;
+            for (long v : li) {
+                cxxopt::details::derive(v, s);
+            }
+            return !s.empty();
+        });
+        profiler::AsReference("vector<long>(std::string + stoull)");
+    }
+
+    return 0;
+}
@@ -52,5 +52,17 @@ int main(int argc, char **argv)
     }
     std::cout << std::endl;
 
+    // no more registrations from here on, lookups go through a perfect hash table
+    if (!protocol::seal()) {
+        std::cerr << "failed to seal the factory" << std::endl;
+        return 1;
+    }
+    std::cout << "Dispatch By Id:" << std::endl;
+    size_t id = protocol::id("sender2");
+    if (auto v = protocol::fetch(id, argc, argv); v.get() != nullptr) {
+        v->Send();
+    }
+    std::cout << std::endl;
+
     return 0;
 }
@@ -0,0 +1,134 @@
+#include <string.h>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <openssl/rand.h>
+
+#define THREADPOOL_TRACE(fmt, ...)
+
+#include "cxxopt.h"
+#include "threadpool.h"
+#include "aead.h"
+#include "aead.cpp"
+
+static std::string RandomBytes(size_t size)
+{
+    std::string bytes(size, '\0');
+    RAND_bytes((unsigned char *)bytes.data(), size);
+    return bytes;
+}
+
+int main()
+{
+    size_t count = getarg(200000, "--records"), size = getarg(64, "--size");
+    size_t threads = getarg(std::thread::hardware_concurrency(), "--threads");
+    std::string key = RandomBytes(16), iv = RandomBytes(12), aad = "stream 7";
+    uint64_t sequence = 1000;
+
+    size_t sealed_size = size + EVP_GCM_TLS_TAG_LEN;
+    std::string plaintexts = RandomBytes(count * size);
+    std::string sealed(count * sealed_size, '\0'), opened(count * size, '\0');
+    struct iovec aadv = {aad.data(), aad.size()};
+    std::vector<struct iovec> inputs(count);
+    std::vector<AEAD_BATCH::Record> records(count);
+    auto prepare = [&](std::string &from, size_t from_size, std::string &to, size_t to_size) {
+        for (size_t i = 0; i < count; i++) {
+            inputs[i] = {from.data() + i * from_size, from_size};
+            records[i].aad = &aadv, records[i].aadcnt = 1;
+            records[i].input = &inputs[i], records[i].incnt = 1;
+            records[i].output = to.data() + i * to_size;
+        }
+    };
+
+    auto measure = [count](const std::string &brief, auto once) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = once();
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << brief << ": " << static_cast<long>(count / elapsed) << " records/s" << std::endl;
+        return ok;
+    };
+
+    // references, a context initialized for every record or rekeyed for every record
+    std::string expected(count * sealed_size, '\0');
+    bool ok = measure("new context per record", [&]() {
+        std::string nonce;
+        for (size_t i = 0; i < count; i++) {
+            AEAD_BATCH::nonce(iv, sequence + i, nonce);
+            AEAD_WITH_EVP context(AEAD_WITH_EVP::ENCRYPT, key, nonce);
+            std::string_view plaintext(plaintexts.data() + i * size, size);
+            if (context.crypt(aad, plaintext, expected.data() + i * sealed_size) != 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+    ok &= measure("reset() per record", [&]() {
+        std::string nonce;
+        AEAD_WITH_EVP context(AEAD_WITH_EVP::ENCRYPT, key, iv);
+        for (size_t i = 0; i < count; i++) {
+            AEAD_BATCH::nonce(iv, sequence + i, nonce);
+            std::string_view plaintext(plaintexts.data() + i * size, size);
+            if (context.reset(AEAD_WITH_EVP::ENCRYPT, key, nonce) != 0
+                || context.crypt(aad, plaintext, sealed.data() + i * sealed_size) != 0) {
+                return false;
+            }
+        }
+        return sealed == expected;
+    });
+
+    multiprocessing::threadpool pool(threads);
+    for (auto *executor : {(multiprocessing::threadpool *)nullptr, &pool}) {
+        std::string on = executor ? ", " + std::to_string(threads) + " threads" : "";
+        AEAD_BATCH sealer(AEAD_WITH_EVP::ENCRYPT, key, iv), opener(AEAD_WITH_EVP::DECRYPT, key, iv);
+        sealer.set_thread_pool(executor);
+        opener.set_thread_pool(executor);
+
+        sealed.assign(sealed.size(), '\0');
+        prepare(plaintexts, size, sealed, sealed_size);
+        ok &= measure("AEAD_BATCH seal" + on, [&]() {
+            return sealer.crypt(records.data(), count, sequence) == 0 && sealed == expected;
+        });
+
+        opened.assign(opened.size(), '\0');
+        prepare(sealed, sealed_size, opened, size);
+        ok &= measure("AEAD_BATCH open" + on, [&]() {
+            return opener.crypt(records.data(), count, sequence) == 0 && opened == plaintexts;
+        });
+    }
+
+    // from a worker of the pool itself, with no other worker to crypt the blocks queued
+    {
+        multiprocessing::threadpool single(1);
+        AEAD_BATCH sealer(AEAD_WITH_EVP::ENCRYPT, key, iv);
+        sealer.set_thread_pool(&single);
+        sealed.assign(sealed.size(), '\0');
+        prepare(plaintexts, size, sealed, sealed_size);
+        std::packaged_task<int()> nested([&]() { return sealer.crypt(records.data(), count, sequence); });
+        auto future = nested.get_future();
+        single.push([&nested]() { nested(); });
+        bool done = future.wait_for(std::chrono::seconds(30)) == std::future_status::ready && future.get() == 0
+                    && sealed == expected;
+        std::cout << "sealed from a worker of the pool: " << (done ? "yes" : "no") << std::endl;
+        ok &= done;
+    }
+
+    // a record out of sequence fails alone
+    {
+        AEAD_BATCH opener(AEAD_WITH_EVP::DECRYPT, key, iv);
+        prepare(sealed, sealed_size, opened, size);
+        std::swap(inputs[1], inputs[2]);
+        int err = opener.crypt(records.data(), 4, sequence);
+        bool rejected = err != 0 && records[0].status == 0 && records[1].status != 0 && records[2].status != 0
+                        && records[3].status == 0;
+        std::cout << "records out of sequence rejected: " << (rejected ? "yes" : "no") << std::endl;
+        ok &= rejected;
+    }
+
+    if (!ok) {
+        std::cerr << "batches differ from records crypted one by one" << std::endl;
+        return 1;
+    }
+    return 0;
+}
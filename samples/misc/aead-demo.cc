@@ -0,0 +1,102 @@
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <openssl/rand.h>
+
+#include "cxxopt.h"
+#include "aead.h"
+#include "aead.cpp"
+
+static std::string RandomBytes(size_t size)
+{
+    std::string bytes(size, '\0');
+    RAND_bytes((unsigned char *)bytes.data(), size);
+    return bytes;
+}
+
+int main()
+{
+    size_t records = getarg(20000, "--records"), size = getarg(16 * 1024, "--size");
+    std::string key = RandomBytes(16), iv = RandomBytes(12);
+    std::string aad = "record #1", header = RandomBytes(13), payload = RandomBytes(size);
+    AEAD_WITH_EVP encryptor(AEAD_WITH_EVP::ENCRYPT, key, iv), decryptor(AEAD_WITH_EVP::DECRYPT, key, iv);
+
+    std::string expected;
+    if (encryptor.crypt(aad, header + payload, expected) != 0) {
+        std::cerr << "failed to encrypt" << std::endl;
+        return 1;
+    }
+
+    bool failed = false;
+    auto check = [&failed](const char *brief, bool ok) {
+        std::cout << brief << ": " << (ok ? "ok" : "FAILED") << std::endl;
+        failed |= !ok;
+    };
+
+    // the header and the payload of a frame sealed without concatenation, the tag appended
+    {
+        struct iovec aadv[] = {{aad.data(), 7}, {aad.data() + 7, aad.size() - 7}};
+        struct iovec inputv[] = {{header.data(), header.size()}, {payload.data(), payload.size()}};
+        std::string sealed(expected.size(), '\0');
+        int err = encryptor.crypt(aadv, 2, inputv, 2, sealed.data());
+        check("scatter-gather encryption", err == 0 && sealed == expected);
+    }
+
+    // in place, the tag apart
+    std::string buffer = header + payload;
+    unsigned char tag[EVP_GCM_TLS_TAG_LEN];
+    {
+        int err = encryptor.crypt(aad, buffer, buffer.data(), tag);
+        check("in-place encryption, separate tag",
+              err == 0 && expected.compare(0, buffer.size(), buffer) == 0
+                  && memcmp(expected.data() + buffer.size(), tag, sizeof(tag)) == 0);
+    }
+    {
+        int err = decryptor.crypt(aad, buffer, buffer.data(), tag);
+        check("in-place decryption, separate tag", err == 0 && buffer == header + payload);
+    }
+
+    // the appended tag split over the pieces of input
+    {
+        size_t half = expected.size() - EVP_GCM_TLS_TAG_LEN / 2;
+        struct iovec inputv[] = {{expected.data(), half}, {expected.data() + half, expected.size() - half}};
+        struct iovec aadv = {aad.data(), aad.size()};
+        std::string opened(header.size() + payload.size(), '\0');
+        int err = decryptor.crypt(&aadv, 1, inputv, 2, opened.data());
+        check("scatter-gather decryption, appended tag", err == 0 && opened == header + payload);
+    }
+    {
+        std::string tampered = expected, opened(header.size() + payload.size(), '\0');
+        tampered[tampered.size() / 2] ^= 1;
+        check("tampered record rejected", decryptor.crypt(aad, tampered, opened.data()) != 0);
+    }
+
+    // a record encryption path: frames sealed into the same buffer over and over
+    auto measure = [records](const char *brief, auto once) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < records; i++) {
+            if (!once()) {
+                return false;
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << brief << ": " << static_cast<long>(elapsed * 1e9 / records) << " ns/record" << std::endl;
+        return true;
+    };
+    std::string sealed;
+    bool measured = measure("crypt(std::string)", [&]() {
+        sealed.clear(), sealed.shrink_to_fit(); // as with a record handed over to the socket
+        return encryptor.crypt(aad, header + payload, sealed) == 0;
+    });
+    std::vector<char> frame(header.size() + payload.size() + EVP_GCM_TLS_TAG_LEN);
+    measured &= measure("crypt(iovec) in place", [&]() {
+        memcpy(frame.data(), header.data(), header.size());
+        memcpy(frame.data() + header.size(), payload.data(), payload.size());
+        return encryptor.crypt(aad, std::string_view(frame.data(), header.size() + payload.size()), frame.data()) == 0;
+    });
+    check("in-place record equals the copying one", measured && std::string(frame.data(), frame.size()) == expected);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <openssl/rand.h>
+
+#include "cxxopt.h"
+#include "aead.h"
+#include "aead.cpp"
+
+static std::string RandomBytes(size_t size)
+{
+    std::string bytes(size, '\0');
+    RAND_bytes((unsigned char *)bytes.data(), size);
+    return bytes;
+}
+
+static std::string Load(const std::string &path)
+{
+    std::stringstream ss;
+    ss << std::ifstream(path).rdbuf();
+    return ss.str();
+}
+
+static void Save(const std::string &path, const std::string &content)
+{
+    std::ofstream(path, std::ios::trunc) << content;
+}
+
+/* seal `path` to `sealed` with a writer over the mapped file */
+static bool Seal(const AEAD_STREAM &stream, const std::string &path, const std::string &sealed)
+{
+    int in = open(path.c_str(), O_RDONLY), out = open(sealed.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    AEAD_STREAM::Writer writer(stream, out);
+    bool ok = in >= 0 && out >= 0 && writer.write_mapped(in) >= 0 && writer.finish() == 0;
+    close(in), close(out);
+    return ok;
+}
+
+/* open `sealed` streamed through a pipe, read by odd sized pieces, returns the error if any */
+static ssize_t Open(const AEAD_STREAM &stream, const std::string &sealed, std::string &opened)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -errno;
+    }
+    std::thread feeder([&sealed, fd = fds[1]]() {
+        for (size_t done = 0; done < sealed.size();) {
+            ssize_t n = write(fd, sealed.data() + done, std::min<size_t>(sealed.size() - done, 4000));
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        close(fd);
+    });
+    AEAD_STREAM::Reader reader(stream, fds[0]);
+    char buff[1000];
+    ssize_t n;
+    opened.clear();
+    while ((n = reader.read(buff, sizeof(buff))) > 0) {
+        opened.append(buff, n);
+    }
+    close(fds[0]);
+    feeder.join();
+    return n;
+}
+
+int main()
+{
+    size_t size = getarg(8, "--size") * 1024 * 1024 + 123, chunk = getarg(64 * 1024, "--chunk");
+    std::string key = RandomBytes(32), iv = RandomBytes(12), aad = "snapshot v1";
+    AEAD_STREAM sealer(AEAD_WITH_EVP::ENCRYPT, key, iv, chunk, aad);
+    AEAD_STREAM opener(AEAD_WITH_EVP::DECRYPT, key, iv, chunk, aad);
+
+    signal(SIGPIPE, SIG_IGN); // readers of tampered streams stop halfway
+    bool failed = false;
+    auto check = [&failed](const std::string &brief, bool ok) {
+        std::cout << brief << ": " << (ok ? "ok" : "FAILED") << std::endl;
+        failed |= !ok;
+    };
+
+    // round trips, from a file mapped in memory to a pipe
+    for (size_t length : {size, chunk * 3, size_t(1), size_t(0)}) {
+        std::string plaintext = RandomBytes(length), opened;
+        Save("aead-stream-demo.plain", plaintext);
+        auto start = std::chrono::steady_clock::now();
+        bool sealed = Seal(sealer, "aead-stream-demo.plain", "aead-stream-demo.sealed");
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::string content = Load("aead-stream-demo.sealed");
+        ssize_t err = Open(opener, content, opened);
+        std::string rate = length < 1024 * 1024 ? ""
+                                                : ", sealed at " + std::to_string(static_cast<long>(
+                                                      length / 1024 / 1024 / elapsed)) + " MB/s";
+        check("round trip of " + std::to_string(length) + " bytes" + rate,
+              sealed && content.size() == sealer.sealed_size(length) && err == 0 && opened == plaintext);
+    }
+
+    std::string plaintext = RandomBytes(size), opened;
+    Save("aead-stream-demo.plain", plaintext);
+    Seal(sealer, "aead-stream-demo.plain", "aead-stream-demo.sealed");
+    std::string sealed = Load("aead-stream-demo.sealed");
+
+    // random access, in memory and from the file
+    {
+        AEAD_STREAM::Mapped mapped(opener, "aead-stream-demo.sealed");
+        bool ok = mapped.error() == 0 && mapped.size() == size;
+        std::vector<char> buff(3 * chunk);
+        for (size_t offset : {size_t(0), chunk - 7, size / 2, size - 100, size}) {
+            size_t length = std::min(buff.size(), size - offset);
+            ok &= mapped.pread(buff.data(), buff.size(), offset) == static_cast<ssize_t>(length)
+                  && plaintext.compare(offset, length, buff.data(), length) == 0;
+        }
+        check("random access to a mapped stream", ok);
+
+        int fd = open("aead-stream-demo.sealed", O_RDONLY);
+        size_t last = opener.chunks(sealed.size()) - 1;
+        ssize_t got = opener.pread_chunk(fd, last, buff.data());
+        close(fd);
+        check("last chunk opened from the file",
+              got == static_cast<ssize_t>(size - last * chunk)
+                  && plaintext.compare(last * chunk, got, buff.data(), got) == 0);
+    }
+
+    // tampered streams never open, even partially for the chunk tampered
+    {
+        std::string tampered = sealed;
+        tampered[3 * (chunk + AEAD_STREAM::TAGLEN) + 10] ^= 1;
+        ssize_t err = Open(opener, tampered, opened);
+        check("tampered chunk rejected", err == -EBADMSG && opened.size() == 3 * chunk);
+    }
+    {
+        std::string truncated = sealed.substr(0, 4 * (chunk + AEAD_STREAM::TAGLEN));
+        check("truncation at a chunk boundary rejected", Open(opener, truncated, opened) == -EBADMSG);
+    }
+    {
+        std::string swapped = sealed;
+        std::swap_ranges(swapped.begin(), swapped.begin() + chunk + AEAD_STREAM::TAGLEN,
+                         swapped.begin() + chunk + AEAD_STREAM::TAGLEN);
+        check("reordered chunks rejected", Open(opener, swapped, opened) == -EBADMSG && opened.empty());
+    }
+
+    unlink("aead-stream-demo.plain");
+    unlink("aead-stream-demo.sealed");
+    return failed ? 1 : 0;
+}
@@ -188,7 +188,28 @@ static std::string ToHex(const std::string &bytes)
 int main()
 {
     size_t repeat = getarg(0, "--repeats");
-    size_t N = getarg(5, "--loops"), NP = getarg(6, "--threads");
+    size_t N = getarg(0, "--loops"), NP = getarg(6, "--threads");
+
+    profiler::Options options;
+    options.warmup_ns = getarg(options.warmup_ns / 1'000'000, "--warmup") * 1'000'000;
+    options.budget_ns = getarg(options.budget_ns / 1'000'000, "--budget") * 1'000'000;
+    options.counters = getarg(false, "--counters");
+    profiler::SetOptions(options);
+
+    unsigned int formats = profiler::FORMAT_RAW | profiler::FORMAT_TABLE_XTERM | profiler::FORMAT_REMARK;
+    formats |= getarg(false, "--json") ? profiler::FORMAT_JSON : 0;
+    formats |= getarg(false, "--csv") ? profiler::FORMAT_CSV : 0;
+    profiler::SetFormats(formats);
+
+    if (const char *baseline = getarg("", "--baseline"); *baseline) {
+        profiler::Thresholds thresholds;
+        thresholds.regression = getarg(thresholds.regression, "--threshold");
+        thresholds.significance = getarg(thresholds.significance, "--significance");
+        if (int err = profiler::LoadBaseline(baseline, thresholds); err != 0) {
+            std::cerr << "Failed to load baseline " << baseline << ": " << strerror(-err) << std::endl;
+            return 2;
+        }
+    }
 
     if (getarg(false, "--times", "--freq", "--bitset", "--aes", "--all")) {
         profiler::SetTitle("Benchmarks");
@@ -372,7 +393,7 @@ int main()
                 profiler::DoNotOptimize(SAMPLING_HIT_FREQEUENCY(10, 10000, 100));
                 return true;
             },
-            repeat, 5, 6);
+            repeat, N, NP);
 
         profiler::Add(
             "SAMPLING_HIT_FREQEUENCY_BY_KEY",
@@ -390,7 +411,7 @@ int main()
                 profiler::DoNotOptimize(SAMPLING_HIT_FREQEUENCY_BY_KEY(key, 10, 10000, 100));
                 return true;
             },
-            repeat, 5, 6);
+            repeat, N, NP);
     }
 
     if (getarg(false, "--bitset", "--all")) {
@@ -650,7 +671,7 @@ int main()
 
                     return true;
                 },
-                repeat, 5);
+                repeat, N);
 
             profiler::Add(
                 "lockfree::atomic_bitset::test",
@@ -659,7 +680,7 @@ int main()
 
                     return true;
                 },
-                repeat, 5);
+                repeat, N);
 
             // set.reset();
             profiler::AddMultiThread(
@@ -669,7 +690,7 @@ int main()
 
                     return true;
                 },
-                repeat, 5);
+                repeat, N);
 
             profiler::AddMultiThread(
                 "lockfree::atomic_bitset::test(threading)",
@@ -678,10 +699,45 @@ int main()
 
                     return true;
                 },
-                repeat, 5);
+                repeat, N);
         }
     }
 
+    if (getarg(false, "--scaling", "--all")) {
+        size_t max_threads = getarg(std::thread::hardware_concurrency(), "--max-threads");
+        std::atomic<size_t> shared(0);
+        profiler::AddScaling(
+            "std::atomic::fetch_add(shared)",
+            [&](size_t) {
+                shared.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            },
+            max_threads);
+
+        struct alignas(64) padded {
+            std::atomic<size_t> value{0};
+        };
+        std::vector<padded> counters(max_threads);
+        profiler::AddScaling(
+            "std::atomic::fetch_add(per-thread)",
+            [&](size_t id) {
+                counters[id].value.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            },
+            max_threads);
+
+        std::mutex mutex;
+        size_t locked = 0;
+        profiler::AddScaling(
+            "std::mutex::lock",
+            [&](size_t) {
+                std::lock_guard<std::mutex> lock(mutex);
+                profiler::DoNotOptimize(++locked);
+                return true;
+            },
+            max_threads);
+    }
+
     if (getarg(false, "--aes", "--all")) {
         std::string iv = RandomBytes(getarg(16, "--ivlen"));
         std::string key = RandomBytes(getarg(16, "--keylen"));
@@ -783,15 +839,21 @@ int main()
             [&]() {
                 return aead_aes_once(key, iv, plaintext) == 0;
             },
-            repeat, 5);
+            repeat, N);
         profiler::Add(
             "ossl::aes",
             [&]() {
                 return ossl_aes_once(key, iv, plaintext) == 0;
             },
-            repeat, 5);
+            repeat, N);
         profiler::AsReference("ossl::aes");
     }
 
-    return 0;
+    if (const char *file = getarg("", "--save"); *file) {
+        if (int err = profiler::Save(file); err != 0) {
+            std::cerr << "Failed to save " << file << ": " << strerror(-err) << std::endl;
+        }
+    }
+
+    return profiler::Finish();
 }
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "profiler.h"
+#include "lemon/factory.h"
+
+namespace plugin
+{
+class Handler {
+  public:
+    virtual ~Handler() {}
+    virtual int Handle(int message) = 0;
+};
+LEMON_DEFINE_FACTORY(plugin::Handler, int)
+#define HANDLER_REGISTRAR(name, Impl) LEMON_FACTORY_REGISTRAR(name, Impl, plugin::Handler, int)
+} // namespace plugin
+
+template <int N>
+class Handler : public plugin::Handler {
+  public:
+    Handler(int base) : m_base(base) {}
+    virtual int Handle(int message) override
+    {
+        return m_base + message * N;
+    }
+
+  private:
+    int m_base;
+};
+
+// a registry of the size of a plugin system, names sharing long prefixes
+template <size_t... N>
+static bool Register(std::index_sequence<N...>)
+{
+    (lemon::registrar<Handler<N>, plugin::Handler, int>("protocol.handler.message-" + std::to_string(N)), ...);
+    return true;
+}
+static bool registered = Register(std::make_index_sequence<100>());
+HANDLER_REGISTRAR("protocol.handler.default", Handler<1000>)
+
+/**
+ * Handle `message` by every registered handler, the sum tells whether each name reached its own handler.
+ */
+static long Dispatch(const std::vector<std::string> &names, int message)
+{
+    long sum = 0;
+    for (auto &name : names) {
+        auto handler = plugin::fetch(name, 1);
+        sum += handler ? handler->Handle(message) : -1000000;
+    }
+    return sum;
+}
+
+int main()
+{
+    auto names = plugin::query("protocol\\.handler\\..*");
+    std::cout << names.size() << " handlers registered" << std::endl;
+
+    long expected = Dispatch(names, 3);
+    auto &factory = lemon::factory<plugin::Handler, int>::instance();
+    if (!factory.seal()) {
+        std::cerr << "failed to seal the factory" << std::endl;
+        return 1;
+    }
+    long sealed = Dispatch(names, 3);
+    std::cout << "sealed dispatch: " << (sealed == expected ? "same" : "differs") << std::endl;
+
+    bool failed = sealed != expected;
+    failed |= plugin::has("protocol.handler.message-100") || plugin::fetch("unknown", 1) != nullptr;
+    failed |= plugin::id("unknown") != lemon::factory<plugin::Handler, int>::npos;
+    failed |= plugin::query("protocol\\.handler\\..*").size() != names.size();
+    for (int i = 0; i < 20; i++) { // more filters than compiled ones kept
+        failed |= plugin::query("protocol\\.handler\\.message-" + std::to_string(i)).size() != 1;
+    }
+    for (auto &name : names) {
+        size_t id = plugin::id(name);
+        auto handler = plugin::fetch(id, 1);
+        failed |= !handler || handler->Handle(3) != plugin::fetch(name, 1)->Handle(3);
+    }
+    factory.offer("late", [](int) -> plugin::Handler * { return nullptr; });
+    failed |= plugin::has("late");
+    if (failed) {
+        std::cerr << "sealed factory disagrees with the registry" << std::endl;
+        return 1;
+    }
+
+    if (getarg(false, "--bench")) {
+        std::string name = names[names.size() / 2];
+        size_t id = plugin::id(name);
+        auto &unsealed = lemon::factory<plugin::Handler, int>::instance();
+        std::unordered_map<std::string, std::function<plugin::Handler *(int)>> registry;
+        for (auto &n : names) {
+            registry[n] = [](int base) -> plugin::Handler * { return new Handler<0>(base); };
+        }
+        profiler::SetTitle("cost of a factory fetch among " + std::to_string(names.size()) + " handlers");
+        profiler::Add("fetch(unordered_map + std::function)", [&registry, &name]() {
+            auto it = registry.find(name);
+            plugin::Handler *handler = it->second(1);
+            delete handler;
+            return handler != nullptr;
+        });
+        profiler::Add("fetch(sealed, by name)", [&unsealed, &name]() {
+            plugin::Handler *handler = unsealed.fetch(std::string_view(name), 1);
+            delete handler;
+            return handler != nullptr;
+        });
+        profiler::Add("fetch(sealed, by id)", [&unsealed, id]() {
+            plugin::Handler *handler = unsealed.fetch(id, 1);
+            delete handler;
+            return handler != nullptr;
+        });
+        profiler::AsReference("fetch(unordered_map + std::function)");
+
+        profiler::SetTitle("cost of a lookup among " + std::to_string(names.size()) + " handlers");
+        profiler::Add("lookup(unordered_map)", [&registry, &name]() {
+            return registry.find(name) != registry.end();
+        });
+        profiler::Add("lookup(sealed)", [&unsealed, &name]() {
+            return unsealed.id(name) != unsealed.npos;
+        });
+        profiler::AsReference("lookup(unordered_map)");
+
+        profiler::SetTitle("cost of a query");
+        profiler::Add("query(std::regex per call)", [&names]() {
+            std::regex pattern("protocol\\.handler\\.message-1[0-9]");
+            size_t matched = 0;
+            for (auto &n : names) {
+                matched += std::regex_match(n, pattern);
+            }
+            return matched == 10;
+        });
+        profiler::Add("query(cached regex)", []() {
+            return plugin::query("protocol\\.handler\\.message-1[0-9]").size() == 10;
+        });
+        profiler::AsReference("query(std::regex per call)");
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "profiler.h"
+#include "logger.h"
+
+int main()
+{
+    size_t threads = getarg(4, "--threads"), messages = getarg(1000, "--messages");
+    std::string file = getarg("logger-demo.log", "--output");
+
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    logging::SetOutput(fd);
+
+    std::vector<std::thread> workers;
+    for (size_t id = 0; id < threads; id++) {
+        workers.emplace_back([id, messages]() {
+            for (size_t i = 0; i < messages; i++) {
+                LOGGER_INFO("worker %zu: message %zu of %s, %.2f%% done", id, i, "demo",
+                            100.0 * static_cast<double>(i) / static_cast<double>(messages));
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    std::string oversized(256 * 1024, 'x'); // more than half of the default ring, dropped but counted
+    LOGGER_INFO("oversized %s", oversized.c_str());
+    logging::Flush();
+
+    std::ifstream rf(file);
+    size_t lines = 0, dropped = 0;
+    for (std::string line; std::getline(rf, line);) {
+        if (line.find("records dropped") != std::string::npos) {
+            dropped += strtoull(line.c_str() + line.find("<logger> ") + 9, nullptr, 10);
+        } else {
+            lines++;
+        }
+    }
+    std::cout << "logged " << lines << " lines, dropped " << dropped << " of " << threads * messages + 1 << std::endl;
+    if (lines + dropped != threads * messages + 1) {
+        std::cerr << "lost records" << std::endl;
+        return 1;
+    }
+
+    if (getarg(false, "--bench")) {
+        int null = open("/dev/null", O_WRONLY);
+        logging::SetOutput(null);
+        logging::SetBlocking(true); // measure what is sustainable, not how fast records are dropped
+        FILE *sink = fdopen(dup(null), "w");
+        profiler::SetTitle("synchronous printf vs asynchronous logger");
+        profiler::Add("trace(fprintf)", [sink]() {
+            char buff[32];
+            struct tm tm;
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            localtime_r(&tv.tv_sec, &tm);
+            size_t len = strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &tm);
+            snprintf(&buff[len], sizeof(buff) - len, ".%03d", (int)(tv.tv_usec / 1000));
+            fprintf(sink, "%s <%s> value %d of %s\n", buff, LOCATION(__FILE__, __LINE__), 42, "bench");
+            return true;
+        });
+        profiler::Add("trace(logging::Log)", []() {
+            LOGGER_INFO("value %d of %s", 42, "bench");
+            return true;
+        });
+        profiler::AsReference("trace(fprintf)");
+        logging::Flush();
+        fclose(sink);
+        close(null);
+    }
+    close(fd);
+
+    return 0;
+}
@@ -25,6 +25,15 @@
 #ifndef RESUMABLECACHE_TRACE
 #define RESUMABLECACHE_TRACE(fmt, ...) printf("%3d: " fmt "\n", __LINE__, ##__VA_ARGS__)
 #endif
+
+#if !defined(RESUMABLECACHE_SPAN) && defined(LEMON_TRACING)
+#include "tracing.h"
+#define RESUMABLECACHE_SPAN(name) TRACING_SPAN(name)
+#endif
+
+#ifndef RESUMABLECACHE_SPAN
+#define RESUMABLECACHE_SPAN(name)
+#endif
 namespace caching
 {
 enum {
@@ -308,6 +317,7 @@ class ResumableCacheHelperMap_Filesystem {
     enum { TAG_CTIME = 1, TAG_MTIME = 2, TAG_ATIME = 3, TAG_VERSION = 4, TAG_DETAILS = 100 };
     int dump(const Key &key) noexcept
     {
+        RESUMABLECACHE_SPAN("ResumableCache::dump");
         ValueDetails detail;
         {
             std::shared_lock<std::shared_mutex> guard(m_mutex);
@@ -366,6 +376,7 @@ class ResumableCacheHelperMap_Filesystem {
 
     int load(const std::string &path, Key &key, Value &value, ResumableCacheGeneration *generation) noexcept
     {
+        RESUMABLECACHE_SPAN("ResumableCache::load");
         int err = 0;
         std::string label = path.substr(m_dir.length());
         if (path.find(".doing.") != std::string::npos /* reserved for internal using */) {
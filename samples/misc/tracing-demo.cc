@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <iostream>
+
+#define LEMON_TRACING
+#define THREADPOOL_TRACE(fmt, ...)
+
+#include "cxxopt.h"
+#include "profiler.h"
+#include "tracing.h"
+#include "threadpool.h"
+#include "lemon/ini.h"
+#include "caches/reloading.h"
+
+struct Config {
+    Config(const char *file) : file(file) {}
+
+    int Reload()
+    {
+        return ini.LoadFile(file.c_str());
+    }
+
+    std::string file;
+    lemon::INIParser ini;
+};
+
+int main()
+{
+    size_t tasks = getarg(100, "--tasks"), reloads = getarg(5, "--reloads");
+    std::string file = getarg("tracing-demo.json", "--output");
+
+    tracing::Enable(true);
+
+    std::ofstream("tracing-demo.ini") << "[section]\nkey = value\n";
+    caches::Reloading<Config> config(0, "tracing-demo.ini");
+    for (size_t i = 0; i < reloads; i++) {
+        config.GetActivated();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    multiprocessing::threadpool pool(4);
+    for (size_t i = 0; i < tasks; i++) {
+        pool.push([]() {
+            TRACING_SPAN("demo::task");
+            volatile size_t sum = 0;
+            for (size_t k = 0; k < 10000; k++) {
+                sum = sum + k;
+            }
+        });
+    }
+    pool.wait();
+    pool.shutdown(); // spans are closed after tasks are counted as finished
+
+    for (size_t i = 0; i < 10000; i++) {
+        TRACING_SPAN_SAMPLED("demo::sampled", 1, 10, 60000);
+    }
+
+    if (int err = tracing::Export(file); err != 0) {
+        std::cerr << "export failed: " << err << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, size_t> events;
+    std::ifstream rf(file);
+    for (std::string line; std::getline(rf, line);) {
+        if (auto pos = line.find("{\"name\":\""); pos != std::string::npos) {
+            pos += 9;
+            events[line.substr(pos, line.find('"', pos) - pos)]++;
+        }
+    }
+    for (auto &[name, count] : events) {
+        std::cout << name << ": " << count << std::endl;
+    }
+    if (events["demo::task"] != tasks || events["threadpool::run"] != tasks
+        || events["caches::Reloading::Reload"] == 0 || events["demo::sampled"] != 1000) {
+        std::cerr << "missing spans" << std::endl;
+        return 1;
+    }
+    std::cout << "open " << file << " with chrome://tracing or https://ui.perfetto.dev" << std::endl;
+
+    if (getarg(false, "--bench")) {
+        tracing::Clear();
+        profiler::SetTitle("cost of a span");
+        tracing::Enable(false);
+        profiler::Add("span(disabled)", []() {
+            TRACING_SPAN("bench");
+            return true;
+        });
+        tracing::Enable(true);
+        profiler::Add("span(enabled)", []() {
+            TRACING_SPAN("bench");
+            return true;
+        });
+        profiler::Add("span(sampled 1/100)", []() {
+            TRACING_SPAN_SAMPLED("bench", 1, 100, 1000);
+            return true;
+        });
+        profiler::AsReference("span(disabled)");
+    }
+
+    return 0;
+}
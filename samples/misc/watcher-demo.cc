@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "watcher.h"
+#include "lemon/ini.h"
+
+static void Write(const std::string &path, const std::string &content)
+{
+    std::ofstream(path, std::ios::trunc) << content;
+}
+
+static void Replace(const std::string &path, const std::string &content)
+{
+    Write(path + ".tmp", content);
+    rename((path + ".tmp").c_str(), path.c_str());
+}
+
+template <typename Predicate>
+static bool WaitFor(Predicate predicate, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+int main()
+{
+    size_t files = getarg(200, "--files");
+    std::string directory = "watcher-demo.d";
+    mkdir(directory.c_str(), 0755);
+
+    std::atomic<size_t> changes{0};
+    std::vector<int> ids;
+    for (size_t i = 0; i < files; i++) {
+        std::string path = directory + "/" + std::to_string(i) + ".ini";
+        Write(path, "[section]\nkey = 0\n");
+        int id = watching::Watch(path, [&changes](const std::string &) {
+            changes++;
+        });
+        if (id < 0) {
+            std::cerr << "watch " << path << " failed: " << strerror(-id) << std::endl;
+            return 1;
+        }
+        ids.push_back(id);
+    }
+
+    struct {
+        const char *brief;
+        std::function<void(const std::string &)> action;
+        size_t expected;
+    } cases[] = {
+        {"rewrite, new content", [](const std::string &path) { Write(path, "[section]\nkey = 1\n"); }, 1},
+        {"rewrite, same content", [](const std::string &path) { Write(path, "[section]\nkey = 1\n"); }, 0},
+        {"replace by rename", [](const std::string &path) { Replace(path, "[section]\nkey = 2\n"); }, 1},
+        {"burst of 10 writes",
+         [](const std::string &path) {
+             for (int i = 0; i < 10; i++) {
+                 Write(path, "[section]\nkey = 3" + std::to_string(i) + "\n");
+             }
+         },
+         1},
+    };
+    bool failed = false;
+    for (auto &c : cases) {
+        changes = 0;
+        for (size_t i = 0; i < files; i += 10) {
+            c.action(directory + "/" + std::to_string(i) + ".ini");
+        }
+        size_t expected = c.expected * ((files + 9) / 10);
+        WaitFor([&]() { return changes >= expected; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // late, unexpected callbacks
+        std::cout << c.brief << ": " << changes << " callbacks, expected " << expected << std::endl;
+        failed |= changes != expected;
+    }
+    for (int id : ids) {
+        watching::Unwatch(id);
+    }
+
+    // a directory removed then created again, watched again
+    {
+        std::string moved = directory + ".moved", path = moved + "/file.ini";
+        mkdir(moved.c_str(), 0755);
+        Write(path, "[section]\nkey = 0\n");
+        changes = 0;
+        int id = watching::Watch(path, [&changes](const std::string &) { changes++; });
+        unlink(path.c_str());
+        rmdir(moved.c_str());
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        mkdir(moved.c_str(), 0755);
+        Write(path, "[section]\nkey = 1\n");
+        bool rewatched = WaitFor([&changes]() { return changes == 1; });
+        std::cout << "directory created again, watched again: " << (rewatched ? "yes" : "no") << std::endl;
+        failed |= !rewatched;
+        watching::Unwatch(id);
+        unlink(path.c_str());
+        rmdir(moved.c_str());
+    }
+
+    // a FIFO without writer neither blocks Watch() nor calls back
+    {
+        std::string path = directory + "/fifo.ini";
+        unlink(path.c_str());
+        mkfifo(path.c_str(), 0600);
+        changes = 0;
+        int id = watching::Watch(path, [&changes](const std::string &) { changes++; });
+        utimes(path.c_str(), nullptr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::cout << "FIFO watched, callbacks: " << changes << ", expected 0" << std::endl;
+        failed |= id < 0 || changes != 0;
+        watching::Unwatch(id);
+        unlink(path.c_str());
+    }
+
+    {
+        std::string path = directory + "/snapshot.ini";
+        Write(path, "[section]\nkey = before\n");
+        lemon::INISnapshotFile<lemon::INI_GenericNoCase> config(path, 0);
+        config.Watch();
+        Replace(path, "[section]\nkey = after\n");
+        bool reloaded = WaitFor([&config]() {
+            return strcmp(config.GetSnapshot()->GetValue("section", "key", ""), "after") == 0;
+        });
+        std::cout << "INISnapshotFile reloaded on change: " << (reloaded ? "yes" : "no") << std::endl;
+        failed |= !reloaded;
+    }
+
+    if (failed) {
+        std::cerr << "unexpected callbacks" << std::endl;
+        return 1;
+    }
+    return 0;
+}
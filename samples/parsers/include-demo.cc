@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <future>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#define THREADPOOL_TRACE(fmt, ...)
+
+#include "cxxopt.h"
+#include "threadpool.h"
+#include "lemon/ini.h"
+
+template <typename Compare>
+static std::string Dumped(const lemon::SimpleINIParser<Compare> &ini)
+{
+    std::string dumped;
+    ini.Dump(dumped, false);
+    return dumped;
+}
+
+int main()
+{
+    size_t fragments = getarg(400, "--fragments"), keys = getarg(500, "--keys");
+    size_t threads = getarg(std::thread::hardware_concurrency(), "--threads");
+
+    // every fragment overrides the `shared` section, the last one in sorted order must win
+    mkdir("include-demo.d", 0755);
+    std::ofstream("include-demo.d/main.ini", std::ios::trunc) << "[shared]\nowner = main\n@include *.conf\n";
+    for (size_t i = 0; i < fragments; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "include-demo.d/%04zu.conf", i);
+        std::ofstream wf(name, std::ios::trunc);
+        wf << "[shared]\nowner = " << i << "\n[fragment." << i << "]\n";
+        for (size_t k = 0; k < keys; k++) {
+            wf << "key" << k << " = value of key " << k << " in fragment " << i << "\n";
+        }
+    }
+
+    auto load = [](lemon::INIParser &ini, const std::string &brief) {
+        ini.SetIncludes();
+        auto start = std::chrono::steady_clock::now();
+        int rc = ini.LoadFile("include-demo.d/main.ini");
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << brief << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms"
+                  << std::endl;
+        return rc;
+    };
+
+    lemon::INIParser sequential;
+    if (load(sequential, "sequential") != lemon::INI_OK) {
+        std::cerr << "failed to load include-demo.d/main.ini" << std::endl;
+        return 1;
+    }
+
+    multiprocessing::threadpool pool(threads);
+    lemon::INIParser parallel;
+    parallel.SetThreadPool(&pool);
+    if (load(parallel, "parallel, " + std::to_string(threads) + " threads") != lemon::INI_OK) {
+        std::cerr << "failed to load include-demo.d/main.ini" << std::endl;
+        return 1;
+    }
+
+    std::string owner = std::to_string(fragments - 1);
+    if (Dumped(parallel) != Dumped(sequential) || owner != parallel.GetValue("shared", "owner", "")) {
+        std::cerr << "parallel load differs from the sequential one" << std::endl;
+        return 1;
+    }
+
+    // from a worker of the pool itself, with no other worker to parse the files queued
+    multiprocessing::threadpool single(1);
+    lemon::INIParser nested;
+    nested.SetThreadPool(&single);
+    std::packaged_task<int()> task([&]() { return load(nested, "from a worker of the pool"); });
+    auto future = task.get_future();
+    single.push([&task]() { task(); });
+    if (future.wait_for(std::chrono::seconds(60)) != std::future_status::ready || future.get() != lemon::INI_OK
+        || Dumped(nested) != Dumped(sequential)) {
+        std::cerr << "loading from a worker of the pool failed" << std::endl;
+        return 1;
+    }
+    std::cout << fragments << " fragments merged in load order, [shared] owner = " << owner << std::endl;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "profiler.h"
+#include "lemon/ini.h"
+
+using StructuralIndex = lemon::details::StructuralIndex;
+
+static const char *Name(StructuralIndex::Isa isa)
+{
+    static const char *names[] = {"none", "scalar", "sse42", "avx2"};
+    return names[isa];
+}
+
+/**
+ * Repeat tests.ini up to `size` bytes, with sections renamed on every round so that keys are distinct.
+ */
+static size_t Scale(const char *sample, const char *file, size_t size)
+{
+    std::stringstream ss;
+    ss << std::ifstream(sample).rdbuf();
+    std::string text = ss.str();
+    if (text.compare(0, 3, INI_UTF8_SIGNATURE) == 0) {
+        text.erase(0, 3);
+    }
+
+    std::ofstream wf(file, std::ios::trunc);
+    wf << INI_UTF8_SIGNATURE;
+    size_t written = 3;
+    for (size_t round = 0; written < size; round++) {
+        std::string suffix = "." + std::to_string(round) + "]";
+        for (size_t pos = 0, end; pos < text.size(); pos = end + 1) {
+            end = text.find('\n', pos);
+            end = end == std::string::npos ? text.size() : end;
+            std::string line = text.substr(pos, end - pos);
+            if (!line.empty() && line.front() == '[' && line.back() == ']') {
+                line.replace(line.size() - 1, 1, suffix);
+            }
+            wf << line << '\n';
+            written += line.size() + 1;
+        }
+    }
+    return written;
+}
+
+int main()
+{
+    size_t size = getarg(8, "--size") * 1024 * 1024;
+    std::string sample = getarg("tests.ini", "--sample");
+    const char *file = "ini-bench.ini";
+    size = Scale(sample.c_str(), file, size);
+    std::cout << file << ": " << size / 1024 / 1024 << " MB" << std::endl;
+
+    std::vector<StructuralIndex::Isa> isas = {StructuralIndex::NONE, StructuralIndex::SCALAR};
+    if (StructuralIndex::Detect() >= StructuralIndex::SSE42) {
+        isas.push_back(StructuralIndex::SSE42);
+    }
+    if (StructuralIndex::Detect() >= StructuralIndex::AVX2) {
+        isas.push_back(StructuralIndex::AVX2);
+    }
+
+    // every scanner must give the same entries as the byte by byte parser
+    size_t expected = 0, expected_checksum = 0;
+    for (auto isa : isas) {
+        StructuralIndex::Using() = isa;
+        lemon::INIParser ini;
+        ini.SetFlat(true);
+        auto start = std::chrono::steady_clock::now();
+        if (ini.LoadFile(file) != 0) {
+            std::cerr << "failed to load " << file << std::endl;
+            return 1;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        size_t entries = 0, checksum = 0;
+        lemon::INIParser::Entries sections;
+        ini.GetAllSections(sections);
+        for (auto &section : sections) {
+            for (auto &[key, value] : *ini.GetSection(section.item)) {
+                checksum += std::hash<std::string_view>()(key.item) ^ std::hash<std::string_view>()(value);
+                entries++;
+            }
+        }
+        std::cout << "LoadFile(" << Name(isa) << "): " << entries << " entries in " << elapsed.count() << " ms"
+                  << std::endl;
+        if (expected == 0) {
+            expected = entries, expected_checksum = checksum;
+        } else if (entries != expected || checksum != expected_checksum) {
+            std::cerr << "scanner " << Name(isa) << " disagrees with the byte by byte parser" << std::endl;
+            return 1;
+        }
+    }
+
+    if (getarg(false, "--bench")) {
+        std::stringstream ss;
+        ss << std::ifstream(file).rdbuf();
+        std::string text = ss.str();
+
+        profiler::Options options;
+        options.warmup_ns = 0;
+        options.min_samples = 5;
+        profiler::SetOptions(options);
+        profiler::SetTitle("flat load of " + std::to_string(size / 1024 / 1024) + " MB by structural index");
+        for (auto isa : isas) {
+            if (isa == StructuralIndex::NONE) {
+                continue;
+            }
+            profiler::Add(std::string("Classify(") + Name(isa) + ")", [&text, isa]() {
+                uint64_t structurals = 0;
+                for (size_t i = 0; i + 64 <= text.size(); i += 64) {
+                    structurals += __builtin_popcountll(StructuralIndex::Classify(isa, text.data() + i));
+                }
+                profiler::DoNotOptimize(structurals);
+                return true;
+            }, 1);
+        }
+        for (auto isa : isas) {
+            profiler::Add(std::string("LoadFile(") + Name(isa) + ")", [file, isa]() {
+                StructuralIndex::Using() = isa;
+                lemon::INIParser ini;
+                ini.SetFlat(true);
+                return ini.LoadFile(file) == 0;
+            }, 1);
+        }
+        profiler::AsReference("LoadFile(none)");
+
+        struct Settings {
+            long port;
+            bool verbose;
+        };
+        lemon::INISchema<Settings> schema;
+        schema.Add("server", "port", &Settings::port, 80L).Add("server", "verbose", &Settings::verbose, false);
+        std::ofstream("ini-bench-typed.ini", std::ios::trunc) << "[server]\nport = 8080\nverbose = yes\n";
+        lemon::INIParser ini;
+        ini.LoadFile("ini-bench-typed.ini");
+        lemon::INITypedFile<Settings> settings("ini-bench-typed.ini", schema, 0);
+        profiler::SetTitle("cost of a typed read");
+        profiler::Add("read(GetLongValue + GetBoolValue)", [&ini]() {
+            return ini.GetLongValue("server", "port") == 8080 && ini.GetBoolValue("server", "verbose");
+        });
+        profiler::Add("read(INITypedFile::GetSnapshot)", [&settings]() {
+            auto snapshot = settings.GetSnapshot();
+            return snapshot->port == 8080 && snapshot->verbose;
+        });
+        profiler::AsReference("read(GetLongValue + GetBoolValue)");
+    }
+
+    return 0;
+}
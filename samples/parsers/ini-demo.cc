@@ -1,9 +1,13 @@
+#include <sys/stat.h>
 #include <gtest/gtest.h>
+#include <thread>
+#include <fstream>
+#include <sstream>
 #include "lemon/ini.h"
 
 TEST(TestBugFix, TestEmptySection)
 {
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     ini.SetValue("foo", "skey", "sval");
     ini.SetValue("", "rkey", "rval");
     ini.SetValue("bar", "skey", "sval");
@@ -27,7 +31,7 @@ TEST(TestBugFix, TestEmptySection)
 
 TEST(TestBugFix, TestMultiLineIgnoreTrailSpace0)
 {
-    parsers::INIParser ini(true, false, true);
+    lemon::INIParser ini(true, false, true);
 
     std::string input = "; multiline values\n"
                         "key = <<<EOS\n"
@@ -70,10 +74,10 @@ TEST(TestBugFix, TestMultiLineIgnoreTrailSpace1)
                         "[section]\n";
 
     bool multiline = true;
-    parsers::INIParser ini(true, false, multiline);
+    lemon::INIParser ini(true, false, multiline);
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     std::string output;
     ini.Dump(output);
@@ -106,10 +110,10 @@ TEST(TestBugFix, TestMultiLineIgnoreTrailSpace2)
                         "[section]\n";
 
     bool multiline = true;
-    parsers::INIParser ini(true, false, multiline);
+    lemon::INIParser ini(true, false, multiline);
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     std::string output;
     ini.Dump(output);
@@ -137,7 +141,7 @@ class TestRoundTrip : public ::testing::Test {
     void TestBOM(bool useBOM);
 
   protected:
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     std::string input;
     std::string output;
 };
@@ -163,13 +167,13 @@ TEST_F(TestRoundTrip, TestStandard)
             "key3 = 3.1415\n";
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     const char *result = ini.GetValue("section2", "key1");
     ASSERT_STREQ(result, "string");
 
     rc = ini.Dump(output);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     output.erase(std::remove(output.begin(), output.end(), '\r'), output.end());
     ASSERT_STREQ(input.c_str(), output.c_str());
@@ -182,10 +186,10 @@ void TestRoundTrip::TestMulti()
             "key = string2\n";
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     rc = ini.Dump(output);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     output.erase(std::remove(output.begin(), output.end(), '\r'), output.end());
 }
@@ -214,11 +218,11 @@ TEST_F(TestRoundTrip, TestSpacesTrue)
             "key = string1\n";
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     ini.SetSpaces(true);
     rc = ini.Dump(output);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     output.erase(std::remove(output.begin(), output.end(), '\r'), output.end());
 
@@ -231,11 +235,11 @@ TEST_F(TestRoundTrip, TestSpacesFalse)
             "key = string1\n";
 
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     ini.SetSpaces(false);
     rc = ini.Dump(output);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     output.erase(std::remove(output.begin(), output.end(), '\r'), output.end());
 
@@ -259,7 +263,7 @@ void TestRoundTrip::TestBOM(bool useBOM)
     ini.Reset();
     ini.SetUnicode(false);
     auto rc = ini.LoadText(input);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     const char tesuto1[] = u8"テスト1";
     const char tesuto2[] = u8"テスト2";
@@ -269,7 +273,7 @@ void TestRoundTrip::TestBOM(bool useBOM)
     ASSERT_STREQ(result, tesuto3);
 
     rc = ini.Dump(output, useBOM);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     output.erase(std::remove(output.begin(), output.end(), '\r'), output.end());
 }
@@ -296,14 +300,14 @@ class TestUTF8 : public ::testing::Test {
     void SetUp() override;
 
   protected:
-    parsers::INIParser ini;
+    lemon::INIParser ini;
 };
 
 void TestUTF8::SetUp()
 {
     ini.SetUnicode();
     auto err = ini.LoadFile("tests.ini");
-    ASSERT_EQ(err, parsers::INI_OK);
+    ASSERT_EQ(err, lemon::INI_OK);
 }
 
 TEST_F(TestUTF8, TestSectionAKeyAValA)
@@ -367,19 +371,383 @@ TEST_F(TestUTF8, TestSectionUKeyUValU)
 }
 
 
+// ### FLAT MODE
+
+static std::string Dumped(const lemon::INIParser &ini)
+{
+    std::string output;
+    ini.Dump(output);
+    return output;
+}
+
+TEST(TestFlat, TestSameAsMaps)
+{
+    lemon::INIParser mapped, flat;
+    mapped.SetUnicode(), flat.SetUnicode(), flat.SetFlat();
+    ASSERT_EQ(mapped.LoadFile("tests.ini"), lemon::INI_OK);
+    ASSERT_EQ(flat.LoadFile("tests.ini"), lemon::INI_OK);
+
+    const char kensa[] = u8"検査";
+    const char tesuto2[] = u8"テスト2";
+    ASSERT_STREQ(flat.GetValue(kensa, tesuto2), mapped.GetValue(kensa, tesuto2));
+    ASSERT_STREQ(flat.GetValue("section1", "key1"), "value1");
+    ASSERT_EQ(Dumped(flat), Dumped(mapped));
+}
+
+TEST(TestFlat, TestLookups)
+{
+    const std::string example = "top = level\n"
+                                "[Section]\n"
+                                "Key = value\n"
+                                "number = 42\n"
+                                "[empty]\n";
+    lemon::INIParser ini;
+    ini.SetFlat();
+    ASSERT_EQ(ini.LoadText(example), lemon::INI_OK);
+
+    ASSERT_STREQ(ini.GetValue("", "top"), "level");
+    ASSERT_STREQ(ini.GetValue("section", "KEY"), "value");
+    ASSERT_STREQ(ini.GetValue("section", "missing", "default"), "default");
+    ASSERT_STREQ(ini.GetValue("missing", "key", "default"), "default");
+    ASSERT_EQ(ini.GetLongValue("section", "number"), 42);
+    ASSERT_EQ(ini.GetValueView("SECTION", "key"), "value");
+    ASSERT_EQ(ini.GetValueView("section", "missing", "default"), "default");
+    ASSERT_EQ(ini.GetSectionSize("empty"), 0);
+
+    lemon::INICaseParser cased;
+    cased.SetFlat();
+    ASSERT_EQ(cased.LoadText(example), lemon::INI_OK);
+    ASSERT_STREQ(cased.GetValue("Section", "Key"), "value");
+    ASSERT_EQ(cased.GetValue("section", "Key"), nullptr);
+}
+
+TEST(TestFlat, TestMultiKey)
+{
+    const std::string example = "[section]\n"
+                                "key = first\n"
+                                "key = second\n";
+    for (bool multikey : {false, true}) {
+        lemon::INIParser mapped(false, multikey), flat(false, multikey);
+        flat.SetFlat();
+        ASSERT_EQ(mapped.LoadText(example), lemon::INI_OK);
+        ASSERT_EQ(flat.LoadText(example), lemon::INI_OK);
+
+        bool mapped_multiple, flat_multiple;
+        ASSERT_STREQ(flat.GetValue("section", "key", NULL, &flat_multiple),
+                     mapped.GetValue("section", "key", NULL, &mapped_multiple));
+        ASSERT_EQ(flat_multiple, mapped_multiple);
+        ASSERT_EQ(Dumped(flat), Dumped(mapped));
+    }
+}
+
+TEST(TestFlat, TestModified)
+{
+    lemon::INIParser ini;
+    ini.SetFlat();
+    ASSERT_EQ(ini.LoadText("[section]\nkey = value\nother = value\n"), lemon::INI_OK);
+    ASSERT_EQ(ini.SetValue("section", "key", "updated"), lemon::INI_UPDATED);
+    ASSERT_TRUE(ini.Delete("section", "other"));
+    ASSERT_STREQ(ini.GetValue("section", "key"), "updated");
+    ASSERT_EQ(ini.GetValue("section", "other"), nullptr);
+    ASSERT_EQ(ini.LoadText("[more]\nkey = value\n"), lemon::INI_OK);
+    ASSERT_STREQ(ini.GetValue("more", "key"), "value");
+}
+
+TEST(TestFlat, TestPageSized)
+{
+    // no room for a terminating NUL in the last page of the file
+    std::string content = "[section]\nkey = ";
+    content += std::string(sysconf(_SC_PAGESIZE) - content.size(), 'x');
+    std::ofstream("page-sized.ini", std::ios::binary | std::ios::trunc) << content;
+
+    lemon::INIParser ini;
+    ini.SetFlat();
+    ASSERT_EQ(ini.LoadFile("page-sized.ini"), lemon::INI_OK);
+    ASSERT_EQ(ini.GetValueView("section", "key").size(), content.size() - 16);
+    remove("page-sized.ini");
+}
+
+TEST(TestFlat, TestNotRegular)
+{
+    // neither waits for a writer nor maps what is not a regular file
+    remove("fifo.ini");
+    ASSERT_EQ(mkfifo("fifo.ini", 0600), 0);
+    lemon::INIParser fifo, directory;
+    fifo.SetFlat();
+    directory.SetFlat();
+    ASSERT_EQ(fifo.LoadFile("fifo.ini"), lemon::INI_FILE);
+    ASSERT_EQ(directory.LoadFile("."), lemon::INI_FILE);
+    remove("fifo.ini");
+}
+
+TEST(TestStructuralIndex, TestClassify)
+{
+    using StructuralIndex = lemon::details::StructuralIndex;
+    char block[64];
+    srand(0);
+    for (int round = 0; round < 1000; round++) {
+        for (char &ch : block) {
+            ch = round % 2 ? static_cast<char>(rand()) : "\n\r[]=;# ab\xe3\x80"[rand() % 14];
+        }
+        uint64_t expected = StructuralIndex::Classify(StructuralIndex::SCALAR, block);
+        if (StructuralIndex::Detect() >= StructuralIndex::SSE42) {
+            ASSERT_EQ(StructuralIndex::Classify(StructuralIndex::SSE42, block), expected);
+        }
+        if (StructuralIndex::Detect() >= StructuralIndex::AVX2) {
+            ASSERT_EQ(StructuralIndex::Classify(StructuralIndex::AVX2, block), expected);
+        }
+    }
+}
+
+TEST(TestStructuralIndex, TestSameAsBytes)
+{
+    using StructuralIndex = lemon::details::StructuralIndex;
+    std::string example = "; file comment\r\n"
+                          "\r\n"
+                          "; section comment\r\n"
+                          "[ section ]  trailing\r\n"
+                          "key = value  \r\n"
+                          "multi = <<<END\r\n"
+                          "line [1] = x\r\n"
+                          "END\r\n"
+                          "invalid line\n"
+                          " = no key\n"
+                          "[unclosed\n"
+                          "long = "
+                          + std::string(200, 'v') + "\n[last]\nkey=" + std::string(63, 'w');
+
+    auto isa = StructuralIndex::Using();
+    StructuralIndex::Using() = StructuralIndex::NONE;
+    lemon::INIParser expected(false, false, true);
+    ASSERT_EQ(expected.LoadText(example), lemon::INI_OK);
+    for (auto other : {StructuralIndex::SCALAR, StructuralIndex::SSE42, StructuralIndex::AVX2}) {
+        if (other > StructuralIndex::Detect() && other != StructuralIndex::SCALAR) {
+            continue;
+        }
+        StructuralIndex::Using() = other;
+        lemon::INIParser ini(false, false, true);
+        ASSERT_EQ(ini.LoadText(example), lemon::INI_OK);
+        ASSERT_EQ(Dumped(ini), Dumped(expected));
+        ASSERT_STREQ(ini.GetValue("last", "key"), std::string(63, 'w').c_str());
+    }
+    StructuralIndex::Using() = isa;
+}
+
+struct Settings {
+    std::string host;
+    int port;
+    unsigned char level;
+    double ratio;
+    bool verbose;
+};
+
+static lemon::INISchema<Settings> SettingsSchema()
+{
+    lemon::INISchema<Settings> schema;
+    schema.Add("server", "host", &Settings::host)
+        .Add("server", "port", &Settings::port, 8080, [](int port) { return port > 0 && port < 65536; })
+        .Add("log", "level", &Settings::level, 3)
+        .Add("log", "ratio", &Settings::ratio, 0.5)
+        .Add("log", "verbose", &Settings::verbose, false);
+    return schema;
+}
+
+TEST(TestSchema, TestLoad)
+{
+    lemon::INIParser ini;
+    ASSERT_EQ(ini.LoadText("[server]\nhost = example.com\nport = 0x50\n[log]\nverbose = On\nratio = 1e-3\n"),
+              lemon::INI_OK);
+    Settings settings;
+    std::string error;
+    ASSERT_EQ(SettingsSchema().Load(ini, settings, &error), lemon::INI_OK);
+    ASSERT_EQ(error, "");
+    ASSERT_EQ(settings.host, "example.com");
+    ASSERT_EQ(settings.port, 80);
+    ASSERT_EQ(settings.level, 3);
+    ASSERT_DOUBLE_EQ(settings.ratio, 1e-3);
+    ASSERT_TRUE(settings.verbose);
+}
+
+TEST(TestSchema, TestErrors)
+{
+    lemon::INIParser ini;
+    ASSERT_EQ(ini.LoadText("[server]\nport = 70000\n[log]\nlevel = 256\nratio = half\nverbose = maybe\n"), lemon::INI_OK);
+    Settings settings;
+    std::string error;
+    ASSERT_EQ(SettingsSchema().Load(ini, settings, &error), lemon::INI_FAIL);
+    ASSERT_EQ(error, "[server] host: missing\n"
+                     "[server] port: rejected '70000'\n"
+                     "[log] level: invalid '256'\n"
+                     "[log] ratio: invalid 'half'\n"
+                     "[log] verbose: invalid 'maybe'\n");
+}
+
+TEST(TestSchema, TestTypedFile)
+{
+    auto waitfor = [](auto predicate) {
+        for (int i = 0; i < 400 && !predicate(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return predicate();
+    };
+    std::ofstream("typed.ini", std::ios::trunc) << "[server]\nhost = first\n";
+    lemon::INITypedFile<Settings> settings("typed.ini", SettingsSchema(), 0);
+    ASSERT_EQ(settings.GetError(), "");
+    ASSERT_EQ(settings.GetSnapshot()->host, "first");
+    ASSERT_EQ(settings.GetSnapshot()->port, 8080);
+
+    // invalid files are not published
+    std::ofstream("typed.ini", std::ios::trunc) << "[server]\nhost = second\nport = http\n";
+    settings.Reload();
+    ASSERT_TRUE(waitfor([&settings]() { return !settings.GetError().empty(); }));
+    ASSERT_EQ(settings.GetError(), "[server] port: invalid 'http'\n");
+    ASSERT_EQ(settings.GetSnapshot()->host, "first");
+
+    std::ofstream("typed.ini", std::ios::trunc) << "[server]\nhost = third\nport = 443\n";
+    settings.Reload();
+    ASSERT_TRUE(waitfor([&settings]() { return settings.GetSnapshot()->host == "third"; }));
+    ASSERT_EQ(settings.GetSnapshot()->port, 443);
+    ASSERT_EQ(settings.GetError(), "");
+    remove("typed.ini");
+}
+
+TEST(TestInclude, TestLoadOrder)
+{
+    mkdir("include.d", 0755);
+    mkdir("include.d/conf.d", 0755);
+    std::ofstream("include.d/main.ini", std::ios::trunc) << "[server]\n"
+                                                            "host = main\n"
+                                                            "port = 80\n"
+                                                            "@include conf.d/*.ini\n"
+                                                            "[server]\n"
+                                                            "port = 8080\n";
+    std::ofstream("include.d/conf.d/10-first.ini", std::ios::trunc) << "[server]\n"
+                                                                       "host = first\n"
+                                                                       "port = 81\n"
+                                                                       "@include ../shared.ini\n";
+    std::ofstream("include.d/conf.d/20-second.ini", std::ios::trunc) << "[server]\n"
+                                                                        "host = second\n"
+                                                                        "@include ../main.ini\n"; // loaded already
+    std::ofstream("include.d/shared.ini", std::ios::trunc) << "[shared]\n"
+                                                              "key = value\n";
+
+    for (bool flat : {false, true}) {
+        lemon::INIParser ini;
+        ini.SetIncludes();
+        ini.SetFlat(flat);
+        ASSERT_EQ(ini.LoadFile("include.d/main.ini"), lemon::INI_OK);
+        ASSERT_STREQ(ini.GetValue("server", "host"), "second");
+        ASSERT_STREQ(ini.GetValue("server", "port"), "8080");
+        ASSERT_STREQ(ini.GetValue("shared", "key"), "value");
+        ASSERT_EQ(Dumped(ini), "[server]\nhost = second\nport = 8080\n\n\n[shared]\nkey = value\n");
+    }
+
+    // without includes the directives are invalid lines, as they always were
+    lemon::INIParser ini;
+    ASSERT_EQ(ini.LoadFile("include.d/main.ini"), lemon::INI_OK);
+    ASSERT_STREQ(ini.GetValue("server", "host"), "main");
+    ASSERT_EQ(ini.GetValue("shared", "key"), nullptr);
+
+    std::ofstream("include.d/missing.ini", std::ios::trunc) << "@include nowhere.ini\n";
+    lemon::INIParser missing;
+    missing.SetIncludes();
+    ASSERT_EQ(missing.LoadFile("include.d/missing.ini"), lemon::INI_FILE);
+}
+
+// ### WRITING BACK
+
+static std::string Content(const char *file)
+{
+    std::stringstream ss;
+    ss << std::ifstream(file).rdbuf();
+    return ss.str();
+}
+
+TEST(TestWriteBack, TestIncremental)
+{
+    lemon::INIParser ini;
+    ASSERT_EQ(ini.LoadFile("tests.ini"), lemon::INI_OK);
+    ASSERT_EQ(ini.DumpFile("write-back.ini", false), lemon::INI_OK);
+    ASSERT_EQ(Content("write-back.ini"), Dumped(ini));
+
+    // only the touched sections are rendered again, the file must still match a full dump
+    ini.SetValue("section1", "key1", "updated");
+    ini.SetValue("added", "key", "value", "; new section");
+    ini.Delete("section2", "test2");
+    ASSERT_EQ(ini.DumpFile("write-back.ini", false), lemon::INI_OK);
+    ASSERT_EQ(Content("write-back.ini"), Dumped(ini));
+
+    lemon::INIParser loaded;
+    ASSERT_EQ(loaded.LoadFile("write-back.ini"), lemon::INI_OK);
+    ASSERT_EQ(Dumped(loaded), Dumped(ini));
+
+    ini.SetSpaces(false);
+    ASSERT_EQ(ini.DumpFile("write-back.ini", false), lemon::INI_OK);
+    ASSERT_EQ(Content("write-back.ini").find(" = "), std::string::npos);
+    remove("write-back.ini");
+}
+
+TEST(TestWriteBack, TestSkipUnchanged)
+{
+    lemon::INIParser ini;
+    ini.SetValue("section", "key", "value");
+    ASSERT_EQ(ini.DumpFile("write-back.ini"), lemon::INI_OK);
+    struct stat before, after;
+    ASSERT_EQ(stat("write-back.ini", &before), 0);
+    ASSERT_EQ(ini.DumpFile("write-back.ini"), lemon::INI_OK);
+    ASSERT_EQ(stat("write-back.ini", &after), 0);
+    ASSERT_EQ(after.st_ino, before.st_ino);
+
+    // changed behind our back, write it again
+    std::ofstream("write-back.ini", std::ios::trunc) << "[other]\n";
+    ASSERT_EQ(ini.DumpFile("write-back.ini"), lemon::INI_OK);
+    ASSERT_EQ(Content("write-back.ini"), Dumped(ini));
+    remove("write-back.ini");
+}
+
+TEST(TestWriteBack, TestKeepMode)
+{
+    lemon::INIParser ini;
+    ini.SetValue("secrets", "password", "hunter2");
+    std::ofstream("write-back.ini", std::ios::trunc) << "[secrets]\n";
+    ASSERT_EQ(chmod("write-back.ini", 0600), 0);
+    ASSERT_EQ(ini.DumpFile("write-back.ini"), lemon::INI_OK);
+    struct stat st;
+    ASSERT_EQ(stat("write-back.ini", &st), 0);
+    ASSERT_EQ(st.st_mode & 07777, 0600u);
+    ASSERT_EQ(Content("write-back.ini"), Dumped(ini));
+    remove("write-back.ini");
+}
+
+TEST(TestWriteBack, TestBatch)
+{
+    lemon::INIParser ini;
+    ini.BeginBatch();
+    for (int i = 0; i < 10; i++) {
+        ini.SetValue("section", ("key" + std::to_string(i)).c_str(), std::to_string(i).c_str());
+        ASSERT_EQ(ini.DumpFile("write-back.ini"), lemon::INI_OK);
+    }
+    struct stat st;
+    ASSERT_NE(stat("write-back.ini", &st), 0); // nothing written before the end of the batch
+    ASSERT_EQ(ini.EndBatch(), lemon::INI_OK);
+    ASSERT_EQ(Content("write-back.ini"), Dumped(ini));
+    ASSERT_STREQ(ini.GetValue("section", "key9"), "9");
+    remove("write-back.ini");
+}
+
 // ### SIMPLE USAGE
 
 TEST(TestSnippets, TestSimple)
 {
     // simple demonstration
 
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     ini.SetUnicode();
 
     auto rc = ini.LoadFile("example.ini");
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     const char *pv;
     pv = ini.GetValue("section", "key", "default");
@@ -396,22 +764,22 @@ TEST(TestSnippets, TestSimple)
 TEST(TestSnippets, TestLoadFile)
 {
     // load from a data file
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     auto rc = ini.LoadFile("example.ini");
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 }
 
 TEST(TestSnippets, TestLoadString)
 {
     // load from a string
     const std::string example = "[section]\nkey = value\n";
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     auto rc = ini.LoadText(example);
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 }
 
 
@@ -426,18 +794,18 @@ TEST(TestSnippets, TestSectionsAndKeys)
                                 "[section2]\n"
                                 "[section3]\n";
 
-    parsers::INIParser ini;
+    lemon::INIParser ini;
     auto rc = ini.LoadText(example);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
 
 
     // get all sections
-    parsers::INIParser::Entries sections;
+    lemon::INIParser::Entries sections;
     ini.GetAllSections(sections);
 
     // get all keys in a section
-    parsers::INIParser::Entries keys;
+    lemon::INIParser::Entries keys;
     ini.GetAllKeys("section1", keys);
 
 
@@ -445,7 +813,7 @@ TEST(TestSnippets, TestSectionsAndKeys)
     const char *expectedSections[] = {"section1", "section2", "section3", nullptr};
     const char *expectedKeys[] = {"key1", "key2", nullptr};
 
-    parsers::INIParser::Entries::const_iterator it;
+    lemon::INIParser::Entries::const_iterator it;
     int i;
 
     for (i = 0, it = sections.begin(); it != sections.end(); ++i, ++it) {
@@ -476,9 +844,9 @@ TEST(TestSnippets, TestGettingValues)
 
     bool utf8 = true;
     bool multiKey = true;
-    parsers::INIParser ini(utf8, multiKey);
+    lemon::INIParser ini(utf8, multiKey);
     auto rc = ini.LoadText(example);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
 
     // get the value of a key that doesn't exist
@@ -503,15 +871,15 @@ TEST(TestSnippets, TestGettingValues)
     ASSERT_EQ(hasMulti, true);
 
     // get all values of a key with multiple values
-    parsers::INIParser::Entries values;
+    lemon::INIParser::Entries values;
     ini.GetAllValues("section1", "key2", values);
 
     // sort the values into a known order, in this case we want
     // the original load order
-    values.sort(parsers::INIParser::Entry::LoadOrder());
+    values.sort(lemon::INIParser::Entry::LoadOrder());
 
     // output all of the items
-    parsers::INIParser::Entries::const_iterator it;
+    lemon::INIParser::Entries::const_iterator it;
     for (it = values.begin(); it != values.end(); ++it) {
         // printf("value = '%s'\n", it->item);
     }
@@ -533,7 +901,7 @@ TEST(TestSnippets, TestModifyingData)
 {
     bool utf8 = true;
     bool multiKey = false;
-    parsers::INIParser ini(utf8, multiKey);
+    lemon::INIParser ini(utf8, multiKey);
     int rc;
 
 
@@ -541,13 +909,13 @@ TEST(TestSnippets, TestModifyingData)
     rc = ini.SetValue("section1", nullptr, nullptr);
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_INSERTED);
+    ASSERT_EQ(rc, lemon::INI_INSERTED);
 
     // not an error to add one that already exists
     rc = ini.SetValue("section1", nullptr, nullptr);
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_UPDATED);
+    ASSERT_EQ(rc, lemon::INI_UPDATED);
 
     // get the value of a key that doesn't exist
     const char *pv;
@@ -558,7 +926,7 @@ TEST(TestSnippets, TestModifyingData)
     rc = ini.SetValue("section2", "key1", "value1");
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_INSERTED);
+    ASSERT_EQ(rc, lemon::INI_INSERTED);
 
     // ensure it is set to expected value
     pv = ini.GetValue("section2", "key1", nullptr);
@@ -568,7 +936,7 @@ TEST(TestSnippets, TestModifyingData)
     rc = ini.SetValue("section2", "key1", "value2");
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_UPDATED);
+    ASSERT_EQ(rc, lemon::INI_UPDATED);
 
     // ensure it is set to expected value
     pv = ini.GetValue("section2", "key1", nullptr);
@@ -591,9 +959,9 @@ TEST(TestSnippets, TestDeletingData)
                                 "[section3]\n";
 
     bool utf8 = true;
-    parsers::INIParser ini(utf8);
+    lemon::INIParser ini(utf8);
     auto rc = ini.LoadText(example);
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
 
     // deleting a key from a section. Optionally the entire
@@ -617,7 +985,7 @@ TEST(TestSnippets, TestDeletingData)
 TEST(TestSnippets, TestSavingData)
 {
     bool utf8 = true;
-    parsers::INIParser ini(utf8);
+    lemon::INIParser ini(utf8);
     int rc;
 
 
@@ -626,13 +994,13 @@ TEST(TestSnippets, TestSavingData)
     rc = ini.Dump(data);
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 
     // save the data back to the file
     rc = ini.DumpFile("example2.ini");
     if (rc < 0) { /* handle error */
     };
-    ASSERT_EQ(rc, parsers::INI_OK);
+    ASSERT_EQ(rc, lemon::INI_OK);
 }
 
 
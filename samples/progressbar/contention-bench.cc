@@ -0,0 +1,73 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "progressbar.h"
+
+/**
+ * `threads` workers advancing one bar by a step at a time, written to `file`, returns the milliseconds taken.
+ */
+static long Advance(const char *file, size_t threads, size_t steps, bool background)
+{
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    auto start = std::chrono::steady_clock::now();
+    {
+        ProgressBar bar("{progress} {elapsed} | {bar} | {remaining}", std::tuple<int, int>(-1, -1), fd, true, false,
+                        threads * steps, 80, 40);
+        if (background) {
+            bar.render_in_background(20);
+        }
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([&bar, steps]() {
+                for (size_t k = 0; k < steps; k++) {
+                    bar.advance(1);
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    close(fd);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+static size_t Size(const char *file, bool &completed)
+{
+    std::stringstream ss;
+    ss << std::ifstream(file).rdbuf();
+    std::string output = ss.str();
+    size_t last = output.rfind("\r");
+    completed = last != std::string::npos && output.compare(last, 13, "\r\x1B[2K100.0 00") == 0;
+    return output.size();
+}
+
+int main()
+{
+    size_t threads = getarg(8, "--threads"), steps = getarg(100000, "--steps");
+
+    bool completed;
+    long synchronous = Advance("contention-bench.sync", threads, steps, false);
+    size_t written = Size("contention-bench.sync", completed);
+    std::cout << "synchronous: " << threads << " x " << steps << " steps in " << synchronous << " ms, " << written
+              << " bytes written" << std::endl;
+
+    long background = Advance("contention-bench.background", threads, steps, true);
+    written = Size("contention-bench.background", completed);
+    std::cout << "in background: " << threads << " x " << steps << " steps in " << background << " ms, " << written
+              << " bytes written" << std::endl;
+    if (!completed) {
+        std::cerr << "the last frame drawn in background is not the final state" << std::endl;
+        return 1;
+    }
+    return 0;
+}
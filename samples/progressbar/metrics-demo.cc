@@ -0,0 +1,83 @@
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "progressbar.h"
+
+int main()
+{
+    size_t threads = getarg(4, "--threads"), items = getarg(500, "--items");
+
+    // a batch job: no terminal, rates reported to the logs
+    ProgressBar bar("", std::tuple<int, int>(-1, -1), STDOUT_FILENO, true, true, threads * items);
+    // workers take items from a shared queue, the faster ones take more
+    std::atomic<size_t> queued{threads * items};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([&bar, &queued, i]() {
+            for (size_t left = queued.load(); left > 0;) {
+                if (queued.compare_exchange_weak(left, left - 1)) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(1000 * (i + 1)));
+                    bar.advance(1, 4096);
+                }
+            }
+        });
+    }
+
+    auto next = std::chrono::steady_clock::now();
+    ProgressBar::ProgressMetrics::Snapshot snapshot;
+    do {
+        next += std::chrono::milliseconds(250);
+        std::this_thread::sleep_until(next);
+        snapshot = bar.snapshot();
+        std::cout << snapshot.to_string() << std::endl;
+    } while (snapshot.items < threads * items);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    bool accounted = snapshot.items == threads * items && snapshot.bytes == snapshot.items * 4096
+                     && snapshot.workers.size() <= threads && snapshot.remaining == 0.0;
+    snapshot = bar.snapshot(); // workers exited, their counters retired
+    accounted &= snapshot.items == threads * items && snapshot.workers.empty();
+
+    // short-lived threads, which leave only their totals behind
+    {
+        ProgressBar::ProgressMetrics metrics;
+        for (int i = 0; i < 100; i++) {
+            std::thread([&metrics]() { metrics.add(10, 100); }).join();
+        }
+        auto retired = metrics.snapshot(100.0);
+        accounted &= retired.items == 1000 && retired.bytes == 10000 && retired.workers.empty();
+    }
+
+    // metrics gone before the thread which added to them
+    {
+        std::atomic<bool> added{false}, gone{false};
+        auto metrics = std::make_unique<ProgressBar::ProgressMetrics>();
+        std::thread late([&]() {
+            metrics->add(1, 0);
+            added = true;
+            while (!gone) {
+                std::this_thread::yield();
+            }
+        });
+        while (!added) {
+            std::this_thread::yield();
+        }
+        metrics.reset();
+        gone = true;
+        late.join();
+    }
+
+    if (!accounted) {
+        std::cerr << "items are not all accounted for" << std::endl;
+        return 1;
+    }
+    return 0;
+}
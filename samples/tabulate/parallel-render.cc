@@ -0,0 +1,67 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <iostream>
+
+#define THREADPOOL_TRACE(fmt, ...)
+
+#include "cxxopt.h"
+#include "tabulate.h"
+#include "threadpool.h"
+
+/**
+ * A report of `rows` rows with wrapped, CJK and colored cells, the kind printed by the profiler and benchmarks.
+ */
+static tabulate::Table Report(size_t rows)
+{
+    tabulate::Table table;
+    table.add("id", "name", "城市", "status", "notes");
+    for (size_t i = 0; i < rows; i++) {
+        table.add(std::to_string(i), "service-" + std::to_string(i * 7919 % 1000), i % 3 ? "東京" : "Paris",
+                  i % 5 ? "ok" : "degraded", "restarted " + std::to_string(i % 7) + " times since the last deployment");
+    }
+    table.format().multi_bytes_character(true);
+    table.column(3).format().color(tabulate::Color::green);
+    table.column(4).format().width(24);
+    return table;
+}
+
+int main()
+{
+    size_t rows = getarg(20000, "--rows"), threads = getarg(std::thread::hardware_concurrency(), "--threads");
+    using std::chrono::duration_cast, std::chrono::milliseconds;
+
+    auto start = std::chrono::steady_clock::now();
+    tabulate::Table table = Report(rows);
+    auto built = std::chrono::steady_clock::now();
+    std::string xterm = table.xterm(), markdown = table.markdown(), latex = table.latex();
+    auto done = std::chrono::steady_clock::now();
+    std::cout << rows << " rows built in " << duration_cast<milliseconds>(built - start).count()
+              << " ms, rendered in " << duration_cast<milliseconds>(done - built).count() << " ms" << std::endl;
+
+    // blocks of rows rendered on the pool, appended in order
+    multiprocessing::threadpool pool(threads);
+    table.set_thread_pool(&pool);
+    start = std::chrono::steady_clock::now();
+    bool same = table.xterm() == xterm && table.markdown() == markdown && table.latex() == latex;
+    done = std::chrono::steady_clock::now();
+    std::cout << "rendered in " << duration_cast<milliseconds>(done - start).count() << " ms on " << threads
+              << " threads" << std::endl;
+    if (!same) {
+        std::cerr << "rendering on the pool differs" << std::endl;
+        return 1;
+    }
+
+    // from a worker of the pool itself, with no other worker to render the blocks queued
+    multiprocessing::threadpool single(1);
+    table.set_thread_pool(&single);
+    std::packaged_task<std::string()> nested([&table]() { return table.xterm(); });
+    auto future = nested.get_future();
+    single.push([&nested]() { nested(); });
+    if (future.wait_for(std::chrono::seconds(30)) != std::future_status::ready || future.get() != xterm) {
+        std::cerr << "rendering from a worker of the pool failed" << std::endl;
+        return 1;
+    }
+    std::cout << "rendered from a worker of the pool" << std::endl;
+    return 0;
+}
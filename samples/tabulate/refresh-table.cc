@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <sys/select.h>
 
+#include "cxxopt.h"
 #include "tabulate.h"
 using namespace tabulate;
 
@@ -34,37 +35,48 @@ int getch_noblocking(void)
     return select(1, &rfds, NULL, NULL, &tv) >= 1 ? getchar() : -1;
 }
 
-int main()
+static Table Processes(std::mt19937 &gen)
 {
-    std::cout << "\x1b[s";
-    while (true) {
-        Table process_table;
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(0, 1);
+    std::uniform_real_distribution<> dis(0, 1);
+    Table process_table;
+    process_table.add("PID", "%CPU", "%MEM", "User", "NI");
+    process_table.add("4297", round(dis(gen) * 100), round(dis(gen) * 100), "ubuntu", "20");
+    process_table.add("12671", round(dis(gen) * 100), round(dis(gen) * 100), "root", "0");
+    process_table.add("810", round(dis(gen) * 100), round(dis(gen) * 100), "root", "-20");
 
-        process_table.add("PID", "%CPU", "%MEM", "User", "NI");
-        process_table.add("4297", round(dis(gen) * 100), round(dis(gen) * 100), "ubuntu", "20");
-        process_table.add("12671", round(dis(gen) * 100), round(dis(gen) * 100), "root", "0");
-        process_table.add("810", round(dis(gen) * 100), round(dis(gen) * 100), "root", "-20");
+    process_table.column(2).format().align(Align::center);
+    process_table.column(3).format().align(Align::right);
+    process_table.column(4).format().align(Align::right);
 
-        process_table.column(2).format().align(Align::center);
-        process_table.column(3).format().align(Align::right);
-        process_table.column(4).format().align(Align::right);
+    for (size_t i = 0; i < 5; ++i) {
+        process_table[0][i].format().color(Color::yellow).align(Align::center).styles(Style::bold);
+    }
+    return process_table;
+}
 
-        for (size_t i = 0; i < 5; ++i) {
-            process_table[0][i].format().color(Color::yellow).align(Align::center).styles(Style::bold);
-        }
+int main()
+{
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    LiveTable live(STDOUT_FILENO, getarg(10, "--fps"));
+    size_t frames = 0, redraws = 0;
 
-        std::cout << "\x1b[u";
-        std::cout << process_table.xterm() << std::endl;
-        std::cout << "\nPress ENTER to exit..." << std::endl;
+    // nothing else may be written to the terminal between frames
+    std::cout << "Press ENTER to exit..." << std::endl;
+    while (true) {
+        if (live.due()) {
+            std::string frame = Processes(gen).xterm();
+            live.update(frame, true);
+            frames++, redraws += frame.size() + 1;
+        }
 
         if (getch_noblocking() == '\n') {
             break;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
+    std::cout << frames << " frames, " << live.written() << " bytes written, " << redraws << " bytes as full redraws"
+              << std::endl;
     return 0;
 }
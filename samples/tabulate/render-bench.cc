@@ -0,0 +1,111 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "cxxopt.h"
+#include "tabulate.h"
+
+/**
+ * A table of `rows` rows mixing ASCII, CJK and colored cells, the shape of a report printed by a tool.
+ */
+template <typename Output>
+static void Report(Output &output, size_t rows)
+{
+    output.add("id", "name", "城市", "status", "latency");
+    for (size_t i = 0; i < rows; i++) {
+        output.add(std::to_string(i), "service-" + std::to_string(i * 7919 % 1000), i % 3 ? "東京" : "Paris",
+                   i % 5 ? "ok" : "degraded", std::to_string(i % 97) + " ms");
+    }
+}
+
+static tabulate::Table Report(size_t rows)
+{
+    tabulate::Table table;
+    Report(table, rows);
+    table.format().multi_bytes_character(true);
+    table.column(3).format().color(tabulate::Color::green);
+    table.column(4).format().align(tabulate::Align::right);
+    return table;
+}
+
+/**
+ * The same report streamed, with widths measured on the first `sample` rows.
+ */
+static void Report(tabulate::TableStream &stream, size_t rows, size_t sample)
+{
+    for (size_t i = 0; i < 5; i++) {
+        stream.header(i).multi_bytes_character(true);
+        stream.column(i).multi_bytes_character(true);
+    }
+    stream.header(3).color(tabulate::Color::green);
+    stream.column(3).color(tabulate::Color::green);
+    stream.header(4).align(tabulate::Align::right);
+    stream.column(4).align(tabulate::Align::right);
+    stream.sample(sample);
+    Report(stream, rows);
+    stream.finish();
+}
+
+static long MaxRSS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main()
+{
+    size_t rows = getarg(2000, "--rows"), streamed = getarg(100000, "--streamed");
+
+    // widths of the CJK cells must be two columns per character whatever the locale
+    std::string sample = Report(2).xterm();
+    size_t first = sample.find('\n'), second = sample.find('\n', first + 1);
+    if (tabulate::display_width_of(sample.substr(0, first), "", true)
+        != tabulate::display_width_of(sample.substr(first + 1, second - first - 1), "", true)) {
+        std::cerr << "misaligned rows:\n" << sample << std::endl;
+        return 1;
+    }
+
+    // measured on all the rows, a stream renders what the table does
+    using Stream = tabulate::TableStream;
+    for (auto output : {Stream::XTERM, Stream::XTERM_NO_COLOR, Stream::MARKDOWN, Stream::LATEX}) {
+        tabulate::Table table = Report(50);
+        std::string expected = output == Stream::MARKDOWN ? table.markdown()
+                               : output == Stream::LATEX  ? table.latex()
+                                                          : table.xterm(output == Stream::XTERM_NO_COLOR);
+        std::ostringstream ss;
+        tabulate::TableStream stream(ss, output, 256);
+        Report(stream, 50, 51);
+        if (ss.str() != expected + "\n") {
+            std::cerr << "streamed output " << output << " differs:\n" << ss.str() << "expected:\n" << expected << std::endl;
+            return 1;
+        }
+    }
+
+    using std::chrono::duration_cast, std::chrono::milliseconds;
+    {
+        int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        long rss = MaxRSS();
+        auto start = std::chrono::steady_clock::now();
+        tabulate::TableStream stream(fd);
+        Report(stream, streamed, 100);
+        auto done = std::chrono::steady_clock::now();
+        close(fd);
+        std::cout << streamed << " rows streamed in " << duration_cast<milliseconds>(done - start).count()
+                  << " ms, max RSS grew by " << MaxRSS() - rss << " KB" << std::endl;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    tabulate::Table table = Report(rows);
+    auto built = std::chrono::steady_clock::now();
+    std::string rendered = table.xterm();
+    auto done = std::chrono::steady_clock::now();
+    std::cout << rows << " rows built in " << duration_cast<milliseconds>(built - start).count() << " ms, "
+              << rendered.size() << " bytes rendered in " << duration_cast<milliseconds>(done - built).count()
+              << " ms" << std::endl;
+    return 0;
+}